@@ -0,0 +1,328 @@
+#pragma once
+
+#ifdef __APPLE__ //Mac OSX has a different name for the header file
+#include <OpenCL/opencl.h>
+#else
+#include <CL/opencl.h>
+#endif
+
+#include <array>
+#include <deque>
+#include <cctype>
+#include <mutex>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+#include <filesystem>
+#include <condition_variable>
+
+// Include after stb_image.h and stb_image_write.h: including them here
+// again would repeat their implementation in texture.cpp
+#include "mem_pool.hpp"
+#include "trace.hpp"
+#include "image_io.hpp"
+
+// Fixed set of worker threads running submitted tasks in order
+class thread_pool
+{
+public:
+    explicit thread_pool(unsigned threads)
+    {
+        for(unsigned i = 0; i < std::max(threads, 1u); ++i)
+            workers_.emplace_back([this, i]
+            {
+                tracer::get().name_thread("worker " + std::to_string(i));
+                for(;;)
+                {
+                    std::function<void()> task;
+                    {
+                        std::unique_lock<std::mutex> lock{mutex_};
+                        ready_.wait(lock, [this]{ return stop_ || !tasks_.empty(); });
+                        if(tasks_.empty()) return;
+                        task = std::move(tasks_.front());
+                        tasks_.pop_front();
+                    }
+                    task();
+                }
+            });
+    }
+
+    // Runs the queued tasks, then joins
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            stop_ = true;
+        }
+        ready_.notify_all();
+        for(auto& t : workers_) t.join();
+    }
+
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator=(thread_pool const&) = delete;
+
+    template<typename F>
+    auto submit(F f) -> std::future<decltype(f())>
+    {
+        auto task = std::make_shared<std::packaged_task<decltype(f())()>>(std::move(f));
+        auto result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            tasks_.emplace_back([task]{ (*task)(); });
+        }
+        ready_.notify_one();
+        return result;
+    }
+
+private:
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    bool stop_ = false;
+};
+
+// Image files named by 'args': directories contribute the images they
+// contain (not recursively), in name order
+inline std::vector<std::string> batch_files(std::vector<std::string> const& args)
+{
+    namespace fs = std::filesystem;
+    std::vector<std::string> files;
+    for(auto const& arg : args)
+    {
+        std::error_code error;
+        if(!fs::is_directory(arg, error)){ files.push_back(arg); continue; }
+
+        std::vector<std::string> found;
+        for(auto const& entry : fs::directory_iterator(arg, error))
+        {
+            auto ext = entry.path().extension().string();
+            std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return (char)std::tolower(c); });
+            if(entry.is_regular_file() && (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tga"))
+                found.push_back(entry.path().string());
+        }
+        std::sort(found.begin(), found.end());
+        files.insert(files.end(), found.begin(), found.end());
+    }
+    return files;
+}
+
+// Runs the RGBA8 buffer kernel 'sobel_tiled(src, dst, w, h)' of sobel.cl
+// over a list of files, writing '<out_dir>/<name>.png' for each.
+//
+// run() overlaps the stages of different images: decoding and encoding on
+// a thread pool, uploads, kernels and downloads on three queues chained by
+// events, so one image uploads while the previous computes and an earlier
+// one downloads. At most 'depth' images are decoded ahead and at most
+// 'depth' wait for encoding, which bounds host and device memory.
+// run_sequential() does the same work one step at a time, as a baseline.
+class batch_pipeline
+{
+public:
+    struct result
+    {
+        size_t images = 0;
+        size_t failed = 0;
+        double seconds = 0.0;
+        double pixels = 0.0;
+
+        double images_per_second() const { return seconds > 0.0 ? images / seconds : 0.0; }
+    };
+
+    batch_pipeline(cl_context context, cl_device_id device, cl_kernel kernel, size_t tile, mem_pool& pool, cl_int* status)
+        : kernel_{kernel}, tile_{tile}, pool_{pool}
+    {
+        cl_command_queue_properties cqps = CL_QUEUE_PROFILING_ENABLE;
+        std::array<cl_queue_properties, 3> qps = { CL_QUEUE_PROPERTIES, cqps, 0 };
+        for(auto& q : queues_)
+        {
+            q = clCreateCommandQueueWithProperties(context, device, qps.data(), status);
+            if(*status != CL_SUCCESS){ q = nullptr; return; }
+        }
+        auto& trace = tracer::get();
+        const char* names[3] = { "upload", "compute", "download" };
+        for(int i = 0; i < 3; ++i)
+        {
+            clocks_[i] = device_clock{queues_[i]};
+            trace.name_lane(lane + i, std::string("batch ") + names[i]);
+        }
+    }
+
+    ~batch_pipeline()
+    {
+        for(auto q : queues_) if(q) clReleaseCommandQueue(q);
+    }
+
+    batch_pipeline(batch_pipeline const&) = delete;
+    batch_pipeline& operator=(batch_pipeline const&) = delete;
+
+    result run_sequential(std::vector<std::string> const& files, std::string const& out_dir, cl_int* status)
+    {
+        result r;
+        auto t0 = std::chrono::high_resolution_clock::now();
+        for(auto const& path : files)
+        {
+            trace_span span{"sequential image", "batch"};
+            auto d = decode(path);
+            if(!d.pixels){ ++r.failed; continue; }
+            std::unique_ptr<unsigned char, void(*)(void*)> pixels{d.pixels, stbi_image_free};
+
+            const size_t bytes = size_t(d.w) * d.h * 4;
+            auto src = pool_.buffer(CL_MEM_READ_ONLY  | CL_MEM_HOST_WRITE_ONLY, bytes, status);
+            if(*status != CL_SUCCESS) return r;
+            auto dst = pool_.buffer(CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, bytes, status);
+            if(*status != CL_SUCCESS) return r;
+            std::vector<unsigned char> out(bytes);
+
+            cl_command_queue queue = queues_[1];
+            *status = clEnqueueWriteBuffer(queue, src.get(), true, 0, bytes, pixels.get(), 0, nullptr, nullptr);
+            if(*status != CL_SUCCESS) return r;
+            *status = enqueue_kernel(queue, src.get(), dst.get(), d.w, d.h, 0, nullptr, nullptr);
+            if(*status != CL_SUCCESS) return r;
+            *status = clEnqueueReadBuffer(queue, dst.get(), true, 0, bytes, out.data(), 0, nullptr, nullptr);
+            if(*status != CL_SUCCESS) return r;
+            pixels.reset();
+
+            if(encode(output_path(out_dir, path), out.data(), d.w, d.h)){ ++r.images; r.pixels += double(d.w) * d.h; }
+            else ++r.failed;
+        }
+        r.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+        return r;
+    }
+
+    result run(std::vector<std::string> const& files, std::string const& out_dir, size_t depth, cl_int* status)
+    {
+        result r;
+        *status = CL_SUCCESS;
+        depth = std::max<size_t>(depth, 1);
+        thread_pool workers{std::max(2u, std::thread::hardware_concurrency())};
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        std::deque<std::future<decoded>> decodes;
+        std::deque<std::future<bool>> encodes;
+        size_t next = 0;
+        auto decode_next = [&]
+        {
+            if(next < files.size()) decodes.push_back(workers.submit([this, path = files[next++]]{ return decode(path); }));
+        };
+        auto finish_oldest = [&]
+        {
+            if(encodes.front().get()) ++r.images;
+            else                      ++r.failed;
+            encodes.pop_front();
+        };
+
+        for(size_t i = 0; i < depth; ++i) decode_next();
+        while(!decodes.empty())
+        {
+            auto d = decodes.front().get();
+            decodes.pop_front();
+            decode_next();
+            if(!d.pixels){ ++r.failed; continue; }
+
+            trace_span span{"enqueue image", "batch"};
+            const size_t bytes = size_t(d.w) * d.h * 4;
+            auto src = pool_.buffer(CL_MEM_READ_ONLY  | CL_MEM_HOST_WRITE_ONLY, bytes, status);
+            if(*status != CL_SUCCESS){ stbi_image_free(d.pixels); break; }
+            auto dst = pool_.buffer(CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, bytes, status);
+            if(*status != CL_SUCCESS){ stbi_image_free(d.pixels); break; }
+            auto out = std::make_unique<unsigned char[]>(bytes);
+
+            // Each queue is in order; the events chain one image across them
+            cl_event up = nullptr, computed = nullptr, down = nullptr;
+            *status = clEnqueueWriteBuffer(queues_[0], src.get(), false, 0, bytes, d.pixels, 0, nullptr, &up);
+            if(*status == CL_SUCCESS) *status = enqueue_kernel(queues_[1], src.get(), dst.get(), d.w, d.h, 1, &up, &computed);
+            if(*status == CL_SUCCESS) *status = clEnqueueReadBuffer(queues_[2], dst.get(), false, 0, bytes, out.get(), 1, &computed, &down);
+            for(auto q : queues_) if(*status == CL_SUCCESS) *status = clFlush(q);
+            if(*status != CL_SUCCESS){ for(auto q : queues_) clFinish(q); stbi_image_free(d.pixels); break; }
+
+            trace_device(clocks_[0], up, "upload", lane + 0);
+            trace_device(clocks_[1], computed, "sobel_tiled", lane + 1);
+            trace_device(clocks_[2], down, "download", lane + 2);
+            clReleaseEvent(up);
+            clReleaseEvent(computed);
+            r.pixels += double(d.w) * d.h;
+
+            // The buffers go back to the pool once the download is done
+            encodes.push_back(workers.submit([this, d, down, src = std::move(src), dst = std::move(dst), out = std::move(out),
+                                              path = output_path(out_dir, d.path)]() mutable
+            {
+                cl_int wait = clWaitForEvents(1, &down);
+                clReleaseEvent(down);
+                stbi_image_free(d.pixels);
+                src = mem_pool::handle{};
+                dst = mem_pool::handle{};
+                return wait == CL_SUCCESS && encode(path, out.get(), d.w, d.h);
+            }));
+            while(encodes.size() > depth) finish_oldest();
+        }
+
+        // On an error, let the images in flight finish before reporting it
+        for(auto q : queues_) clFinish(q);
+        while(!encodes.empty()) finish_oldest();
+        for(auto& f : decodes) if(auto p = f.get().pixels) stbi_image_free(p);
+        r.seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+        return r;
+    }
+
+private:
+    static constexpr int lane = 1;      // lane 0 is the queue of texture.cpp
+
+    struct decoded
+    {
+        std::string path;
+        unsigned char* pixels = nullptr;
+        int w = 0, h = 0;
+    };
+
+    static decoded decode(std::string const& path)
+    {
+        trace_span span{"decode", "io"};
+        decoded d;
+        d.path = path;
+        int ch = 0;
+        d.pixels = stbi_load(path.c_str(), &d.w, &d.h, &ch, 4);
+        if(!d.pixels) std::cout << "Cannot decode " << path << ": " << stbi_failure_reason() << "\n";
+        return d;
+    }
+
+    static bool encode(std::string const& path, unsigned char const* pixels, int w, int h)
+    {
+        trace_span span{"encode", "io"};
+        // One thread per image: the pool already encodes several at once
+        bool ok = write_image(path, w, h, pixels, {6, 1});
+        if(!ok) std::cout << "Cannot write " << path << "\n";
+        return ok;
+    }
+
+    static std::string output_path(std::string const& out_dir, std::string const& input)
+    {
+        return (std::filesystem::path(out_dir) / std::filesystem::path(input).stem()).string() + ".png";
+    }
+
+    cl_int enqueue_kernel(cl_command_queue queue, cl_mem src, cl_mem dst, int w, int h,
+                          cl_uint waits, cl_event const* wait_list, cl_event* event)
+    {
+        cl_int status = clSetKernelArg(kernel_, 0, sizeof(src), &src);
+        if(status == CL_SUCCESS) status = clSetKernelArg(kernel_, 1, sizeof(dst), &dst);
+        if(status == CL_SUCCESS) status = clSetKernelArg(kernel_, 2, sizeof(w), &w);
+        if(status == CL_SUCCESS) status = clSetKernelArg(kernel_, 3, sizeof(h), &h);
+        if(status != CL_SUCCESS) return status;
+
+        size_t local[2]  = { tile_, tile_ };
+        size_t global[2] = { (w + tile_ - 1) / tile_ * tile_, (h + tile_ - 1) / tile_ * tile_ };
+        return clEnqueueNDRangeKernel(queue, kernel_, 2, nullptr, global, local, waits, wait_list, event);
+    }
+
+    cl_kernel kernel_;
+    size_t tile_;
+    mem_pool& pool_;
+    std::array<cl_command_queue, 3> queues_ = {};     // upload, compute, download
+    std::array<device_clock, 3> clocks_;
+};
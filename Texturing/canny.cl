@@ -0,0 +1,163 @@
+// Canny edges over RGBA8 buffers, one kernel per stage:
+//   canny_smooth      luma blurred by the 5x5 binomial filter
+//   canny_gradient    squared Sobel magnitude and its direction, rounded
+//                     to one of four axes
+//   canny_suppress    non-maximum suppression along that axis and the
+//                     double threshold: 0 no edge, 1 weak, 2 strong
+//   canny_hysteresis  weak pixels connected to strong ones become strong,
+//                     rounds repeated by the host until none changes
+//   canny_output      strong pixels white, the rest black, opaque
+// Edges are clamped like the sampler of 'sobel'. Magnitudes stay squared
+// and contraction is off, so every value is a plain sum of products that
+// the host reference reproduces bit for bit. The sources are compiled as
+// one program, so contraction is restored to the default at the end of
+// this file for those that follow.
+
+#pragma OPENCL FP_CONTRACT OFF
+
+#ifndef CANNY_TILE
+#define CANNY_TILE 16
+#endif
+
+constant float canny_binomial[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+
+float canny_luma(global const uchar4* src, int x, int y, int w, int h)
+{
+    const float4 p = convert_float4(src[clamp(y, 0, h - 1) * w + clamp(x, 0, w - 1)]) * (1.0f / 255.0f);
+    return 0.299f * p.x + 0.587f * p.y + 0.114f * p.z;
+}
+
+kernel void canny_smooth(global const uchar4* src, global float* smooth, int w, int h)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= w || y >= h) return;
+
+    float acc = 0.0f;
+    for(int j = 0; j < 5; ++j)
+    {
+        float row = 0.0f;
+        for(int i = 0; i < 5; ++i)
+            row += canny_binomial[i] * canny_luma(src, x + i - 2, y + j - 2, w, h);
+        acc += canny_binomial[j] * row;
+    }
+    smooth[y * w + x] = acc;
+}
+
+// Directions: 0 across columns (left, right), 1 along the main diagonal,
+// 2 across rows (above, below), 3 along the anti-diagonal
+kernel void canny_gradient(global const float* smooth, global float* mag2, global uchar* dir, int w, int h)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= w || y >= h) return;
+
+    float S[9];
+    for(int j = 0; j < 3; ++j)
+        for(int i = 0; i < 3; ++i)
+            S[j * 3 + i] = smooth[clamp(y + j - 1, 0, h - 1) * w + clamp(x + i - 1, 0, w - 1)];
+
+    const float gx = S[0] - S[2] + 2.0f * (S[3] - S[5]) + S[6] - S[8];
+    const float gy = S[0] + S[2] + 2.0f * (S[1] - S[7]) - S[6] - S[8];
+    const float ax = fabs(gx), ay = fabs(gy);
+
+    // tan(22.5 degrees) splits the axes
+    uchar d;
+    if(ay <= 0.41421356f * ax)      d = 0;
+    else if(ax <= 0.41421356f * ay) d = 2;
+    else                            d = (gx > 0.0f) == (gy > 0.0f) ? 1 : 3;
+
+    mag2[y * w + x] = gx * gx + gy * gy;
+    dir[y * w + x] = d;
+}
+
+// The image border is never an edge. On a plateau along the axis the
+// first pixel wins, so edges stay one pixel thin.
+kernel void canny_suppress(global const float* mag2, global const uchar* dir, global uchar* cls,
+                           int w, int h, float low2, float high2)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= w || y >= h) return;
+
+    const int i = y * w + x;
+    uchar c = 0;
+    if(x > 0 && y > 0 && x < w - 1 && y < h - 1)
+    {
+        const int d = dir[i];
+        const int step = d == 0 ? 1 : d == 1 ? w + 1 : d == 2 ? w : w - 1;
+        const float m = mag2[i];
+        if(m > mag2[i - step] && m >= mag2[i + step])
+            c = m >= high2 ? 2 : m >= low2 ? 1 : 0;
+    }
+    cls[i] = c;
+}
+
+// One round of hysteresis. A work-group loads its tile with a one pixel
+// halo and promotes weak pixels next to strong ones in local memory until
+// the tile settles, so a round follows an edge across the whole tile
+// rather than a single pixel. Promotions only ever go from weak to strong,
+// which makes the unsynchronized neighbour reads harmless: a stale read
+// just defers a promotion to the next pass. '*changed' is set when the
+// round promoted anything; the global size is rounded up to whole tiles.
+kernel __attribute__((reqd_work_group_size(CANNY_TILE, CANNY_TILE, 1)))
+void canny_hysteresis(global uchar* cls, int w, int h, global int* changed)
+{
+    local uchar tile[CANNY_TILE + 2][CANNY_TILE + 2];
+    local int again;
+
+    const int lx = get_local_id(0);
+    const int ly = get_local_id(1);
+    const int x0 = get_group_id(0) * CANNY_TILE - 1;
+    const int y0 = get_group_id(1) * CANNY_TILE - 1;
+
+    for(int ty = ly; ty < CANNY_TILE + 2; ty += CANNY_TILE)
+        for(int tx = lx; tx < CANNY_TILE + 2; tx += CANNY_TILE)
+        {
+            const int sx = x0 + tx, sy = y0 + ty;
+            tile[ty][tx] = sx >= 0 && sy >= 0 && sx < w && sy < h ? cls[sy * w + sx] : 0;
+        }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    const uchar before = tile[ly + 1][lx + 1];
+
+    for(;;)
+    {
+        if(lx == 0 && ly == 0) again = 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if(tile[ly + 1][lx + 1] == 1 &&
+           (tile[ly][lx]     == 2 || tile[ly][lx + 1]     == 2 || tile[ly][lx + 2]     == 2 ||
+            tile[ly + 1][lx] == 2 ||                             tile[ly + 1][lx + 2] == 2 ||
+            tile[ly + 2][lx] == 2 || tile[ly + 2][lx + 1] == 2 || tile[ly + 2][lx + 2] == 2))
+        {
+            tile[ly + 1][lx + 1] = 2;
+            again = 1;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        const int repeat = again;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if(!repeat) break;
+    }
+
+    if(x < w && y < h && tile[ly + 1][lx + 1] != before)
+    {
+        cls[y * w + x] = 2;
+        *changed = 1;
+    }
+}
+
+kernel void canny_output(global const uchar* cls, global uchar4* dst, int w, int h)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= w || y >= h) return;
+
+    const uchar v = cls[y * w + x] == 2 ? 255 : 0;
+    dst[y * w + x] = (uchar4)(v, v, v, 255);
+}
+
+#pragma OPENCL FP_CONTRACT DEFAULT
@@ -0,0 +1,256 @@
+#pragma once
+
+#ifdef __APPLE__ //Mac OSX has a different name for the header file
+#include <OpenCL/opencl.h>
+#else
+#include <CL/opencl.h>
+#endif
+
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "mem_pool.hpp"
+#include "kernel_args.hpp"
+#include "separable.hpp"
+
+// Canny edge detection on RGBA8 images: the device pipeline of canny.cl
+// and a host reference computing the same values in the same order, so
+// the two agree pixel for pixel. Thresholds apply to the Sobel magnitude
+// of the smoothed luma in [0, 1] (at most 4 sqrt(2)); both return white
+// edges on black, opaque.
+
+// Milliseconds per stage, device time from profiling events
+struct canny_times
+{
+    double smooth, gradient, suppress, hysteresis, output;
+    int rounds;                     // hysteresis rounds, the last one changing nothing
+};
+
+namespace canny_detail
+{
+    constexpr float binomial[5] = { 1.0f / 16.0f, 4.0f / 16.0f, 6.0f / 16.0f, 4.0f / 16.0f, 1.0f / 16.0f };
+
+    inline double elapsed_ms(std::chrono::high_resolution_clock::time_point t0)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+    }
+}
+
+inline void canny_cpu(unsigned char const* src, unsigned char* dst, int w, int h, float low, float high, canny_times* times = nullptr)
+{
+    using namespace canny_detail;
+    using separable_detail::parallel_rows;
+    const size_t n = size_t(w) * h;
+    std::vector<float> luma(n), smooth(n), mag2(n);
+    std::vector<unsigned char> dir(n), cls(n);
+    canny_times t = {};
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    parallel_rows(h, [&](int y0, int y1)
+    {
+        for(int y = y0; y < y1; ++y)
+            for(int x = 0; x < w; ++x)
+            {
+                unsigned char const* p = src + (size_t(y) * w + x) * 4;
+                luma[size_t(y) * w + x] = 0.299f * (p[0] * (1.0f / 255.0f)) + 0.587f * (p[1] * (1.0f / 255.0f)) + 0.114f * (p[2] * (1.0f / 255.0f));
+            }
+    });
+    auto at = [w, h](std::vector<float> const& plane, int x, int y)
+    {
+        return plane[size_t(std::min(std::max(y, 0), h - 1)) * w + std::min(std::max(x, 0), w - 1)];
+    };
+    parallel_rows(h, [&](int y0, int y1)
+    {
+        for(int y = y0; y < y1; ++y)
+            for(int x = 0; x < w; ++x)
+            {
+                float acc = 0.0f;
+                for(int j = 0; j < 5; ++j)
+                {
+                    float row = 0.0f;
+                    for(int i = 0; i < 5; ++i) row += binomial[i] * at(luma, x + i - 2, y + j - 2);
+                    acc += binomial[j] * row;
+                }
+                smooth[size_t(y) * w + x] = acc;
+            }
+    });
+    t.smooth = elapsed_ms(t0);
+
+    t0 = std::chrono::high_resolution_clock::now();
+    parallel_rows(h, [&](int y0, int y1)
+    {
+        for(int y = y0; y < y1; ++y)
+            for(int x = 0; x < w; ++x)
+            {
+                float S[9];
+                for(int j = 0; j < 3; ++j)
+                    for(int i = 0; i < 3; ++i) S[j * 3 + i] = at(smooth, x + i - 1, y + j - 1);
+                const float gx = S[0] - S[2] + 2.0f * (S[3] - S[5]) + S[6] - S[8];
+                const float gy = S[0] + S[2] + 2.0f * (S[1] - S[7]) - S[6] - S[8];
+                const float ax = std::fabs(gx), ay = std::fabs(gy);
+                unsigned char d;
+                if(ay <= 0.41421356f * ax)      d = 0;
+                else if(ax <= 0.41421356f * ay) d = 2;
+                else                            d = (gx > 0.0f) == (gy > 0.0f) ? 1 : 3;
+                mag2[size_t(y) * w + x] = gx * gx + gy * gy;
+                dir[size_t(y) * w + x] = d;
+            }
+    });
+    t.gradient = elapsed_ms(t0);
+
+    t0 = std::chrono::high_resolution_clock::now();
+    const float low2 = low * low, high2 = high * high;
+    std::vector<size_t> stack;
+    parallel_rows(h, [&](int y0, int y1)
+    {
+        for(int y = y0; y < y1; ++y)
+            for(int x = 0; x < w; ++x)
+            {
+                const size_t i = size_t(y) * w + x;
+                unsigned char c = 0;
+                if(x > 0 && y > 0 && x < w - 1 && y < h - 1)
+                {
+                    const int d = dir[i];
+                    const size_t step = d == 0 ? 1 : d == 1 ? w + 1 : d == 2 ? w : w - 1;
+                    const float m = mag2[i];
+                    if(m > mag2[i - step] && m >= mag2[i + step])
+                        c = m >= high2 ? 2 : m >= low2 ? 1 : 0;
+                }
+                cls[i] = c;
+            }
+    });
+    t.suppress = elapsed_ms(t0);
+
+    // Flood fill from every strong pixel through its weak 8-neighbours
+    t0 = std::chrono::high_resolution_clock::now();
+    for(size_t i = 0; i < n; ++i)
+        if(cls[i] == 2) stack.push_back(i);
+    while(!stack.empty())
+    {
+        const size_t i = stack.back();
+        stack.pop_back();
+        const int x = int(i % w), y = int(i / w);
+        for(int dy = -1; dy <= 1; ++dy)
+            for(int dx = -1; dx <= 1; ++dx)
+            {
+                const int nx = x + dx, ny = y + dy;
+                if(nx < 0 || ny < 0 || nx >= w || ny >= h) continue;
+                const size_t j = size_t(ny) * w + nx;
+                if(cls[j] == 1){ cls[j] = 2; stack.push_back(j); }
+            }
+    }
+    t.hysteresis = elapsed_ms(t0);
+
+    t0 = std::chrono::high_resolution_clock::now();
+    for(size_t i = 0; i < n; ++i)
+    {
+        const unsigned char v = cls[i] == 2 ? 255 : 0;
+        dst[4 * i] = dst[4 * i + 1] = dst[4 * i + 2] = v;
+        dst[4 * i + 3] = 255;
+    }
+    t.output = elapsed_ms(t0);
+    if(times) *times = t;
+}
+
+// The kernels of canny.cl from a built program, run on RGBA8 buffers with
+// the intermediates taken from a pool. 'tile' is the CANNY_TILE the program
+// was built with. The queue needs profiling enabled for the stage times.
+class canny_detector
+{
+public:
+    canny_detector(cl_program program, size_t tile, cl_int* status) : tile_(tile)
+    {
+        char const* names[5] = { "canny_smooth", "canny_gradient", "canny_suppress", "canny_hysteresis", "canny_output" };
+        for(int k = 0; k < 5; ++k)
+        {
+            kernels_[k] = clCreateKernel(program, names[k], status);
+            if(*status != CL_SUCCESS) return;
+        }
+    }
+
+    ~canny_detector()
+    {
+        for(auto kernel : kernels_)
+            if(kernel) clReleaseKernel(kernel);
+    }
+
+    canny_detector(canny_detector const&) = delete;
+    canny_detector& operator=(canny_detector const&) = delete;
+
+    // Edges of 'src' into 'dst', blocking until done
+    cl_int run(cl_command_queue queue, mem_pool& pool, cl_mem src, cl_mem dst, int w, int h,
+               float low, float high, canny_times* times = nullptr)
+    {
+        using namespace canny_detail;
+        enum { smooth, gradient, suppress, hysteresis, output };
+        const size_t n = size_t(w) * h;
+        cl_int status = CL_SUCCESS;
+        auto buf_smooth = pool.buffer(CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, n * sizeof(float), &status);
+        if(status != CL_SUCCESS) return status;
+        auto buf_mag2 = pool.buffer(CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, n * sizeof(float), &status);
+        if(status != CL_SUCCESS) return status;
+        auto buf_dir = pool.buffer(CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, n, &status);
+        if(status != CL_SUCCESS) return status;
+        auto buf_cls = pool.buffer(CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, n, &status);
+        if(status != CL_SUCCESS) return status;
+        auto buf_changed = pool.buffer(CL_MEM_READ_WRITE, sizeof(cl_int), &status);
+        if(status != CL_SUCCESS) return status;
+
+        cl_mem s = buf_smooth.get(), m = buf_mag2.get(), d = buf_dir.get(), c = buf_cls.get(), changed = buf_changed.get();
+        const float low2 = low * low, high2 = high * high;
+        if((status = set_args(kernels_[smooth], src, s, w, h)) != CL_SUCCESS) return status;
+        if((status = set_args(kernels_[gradient], s, m, d, w, h)) != CL_SUCCESS) return status;
+        if((status = set_args(kernels_[suppress], m, d, c, w, h, low2, high2)) != CL_SUCCESS) return status;
+        if((status = set_args(kernels_[hysteresis], c, w, h, changed)) != CL_SUCCESS) return status;
+        if((status = set_args(kernels_[output], c, dst, w, h)) != CL_SUCCESS) return status;
+
+        canny_times t = {};
+        double* stage_ms[5] = { &t.smooth, &t.gradient, &t.suppress, &t.hysteresis, &t.output };
+        const size_t dims[2] = { (size_t)w, (size_t)h };
+        auto enqueue = [&](int k, size_t const* global, size_t const* local)
+        {
+            cl_event event;
+            status = clEnqueueNDRangeKernel(queue, kernels_[k], 2, nullptr, global, local, 0, nullptr, &event);
+            if(status != CL_SUCCESS) return;
+            status = clWaitForEvents(1, &event);
+            cl_ulong start = 0, end = 0;
+            if(status == CL_SUCCESS) status = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr);
+            if(status == CL_SUCCESS) status = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr);
+            *stage_ms[k] += (end - start) * 1e-6;
+            clReleaseEvent(event);
+        };
+
+        for(int k : { smooth, gradient, suppress })
+        {
+            enqueue(k, dims, nullptr);
+            if(status != CL_SUCCESS) return status;
+        }
+
+        // Rounds until one promotes nothing; each one settles whole tiles,
+        // so an edge needs about one round per tile it crosses
+        const size_t tiles[2] = { (w + tile_ - 1) / tile_ * tile_, (h + tile_ - 1) / tile_ * tile_ };
+        const size_t local[2] = { tile_, tile_ };
+        for(cl_int promoted = 1; promoted; )
+        {
+            const cl_int zero = 0;
+            status = clEnqueueWriteBuffer(queue, changed, false, 0, sizeof(zero), &zero, 0, nullptr, nullptr);
+            if(status != CL_SUCCESS) return status;
+            enqueue(hysteresis, tiles, local);
+            if(status != CL_SUCCESS) return status;
+            status = clEnqueueReadBuffer(queue, changed, true, 0, sizeof(promoted), &promoted, 0, nullptr, nullptr);
+            if(status != CL_SUCCESS) return status;
+            ++t.rounds;
+        }
+
+        enqueue(output, dims, nullptr);
+        if(status != CL_SUCCESS) return status;
+        if(times) *times = t;
+        return CL_SUCCESS;
+    }
+
+private:
+    cl_kernel kernels_[5] = {};
+    size_t tile_;
+};
@@ -0,0 +1,37 @@
+// KxK convolution of RGBA8 buffers, specialized when the program is built:
+//
+//   -D RADIUS=r -D COEFFS=c0,c1,...    (2r+1)^2 coefficients, row-major
+//
+// The coefficients end up in a constant table indexed by compile-time
+// values only, so the loops below unroll into straight multiply-adds.
+// Color channels are convolved on the 0..255 scale and saturated, alpha is
+// copied from the center pixel. Edges are clamped like the other kernels.
+
+#ifndef RADIUS
+#error "RADIUS and COEFFS must be defined when building convolution.cl"
+#endif
+
+#define SIZE (2 * RADIUS + 1)
+
+constant float coeffs[SIZE * SIZE] = { COEFFS };
+
+kernel void convolve(global const uchar4* src, global uchar4* dst, int w, int h)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= w || y >= h) return;
+
+    float4 acc = (float4)(0.0f);
+    #pragma unroll
+    for(int dy = 0; dy < SIZE; ++dy)
+    {
+        global const uchar4* row = src + clamp(y + dy - RADIUS, 0, h - 1) * w;
+        #pragma unroll
+        for(int dx = 0; dx < SIZE; ++dx)
+            acc += coeffs[dy * SIZE + dx] * convert_float4(row[clamp(x + dx - RADIUS, 0, w - 1)]);
+    }
+
+    uchar4 res = convert_uchar4_sat_rte(acc);
+    res.w = src[y * w + x].w;
+    dst[y * w + x] = res;
+}
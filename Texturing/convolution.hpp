@@ -0,0 +1,250 @@
+#pragma once
+
+#ifdef __APPLE__ //Mac OSX has a different name for the header file
+#include <OpenCL/opencl.h>
+#else
+#include <CL/opencl.h>
+#endif
+
+#include <map>
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+#include "separable.hpp"
+
+// Arbitrary KxK filters on interleaved RGBA8 images. On the device every
+// distinct filter gets its own build of convolution.cl with the radius and
+// coefficients as defines; on the host the common radii 1..3 are templates
+// whose taps are expanded at compile time. Both convolve the color
+// channels on the 0..255 scale, saturate, and keep the center alpha.
+
+struct filter2d
+{
+    int radius = 0;
+    std::vector<float> coeffs;      // (2 radius + 1)^2, row-major
+
+    int size() const { return 2 * radius + 1; }
+
+    // col_taps (vertical) times row_taps (horizontal), both of one length
+    static filter2d outer(std::vector<float> const& col_taps, std::vector<float> const& row_taps)
+    {
+        filter2d f;
+        f.radius = (int)row_taps.size() / 2;
+        for(float c : col_taps)
+            for(float r : row_taps) f.coeffs.push_back(c * r);
+        return f;
+    }
+
+    static filter2d sharpen()
+    {
+        return { 1, { 0.0f, -1.0f, 0.0f,  -1.0f, 5.0f, -1.0f,  0.0f, -1.0f, 0.0f } };
+    }
+
+    static filter2d laplacian()
+    {
+        return { 1, { 1.0f, 1.0f, 1.0f,  1.0f, -8.0f, 1.0f,  1.0f, 1.0f, 1.0f } };
+    }
+};
+
+// Build options baking 'f' into convolution.cl. The coefficients are
+// written as hexadecimal floats, so they reach the device bit-exact and
+// equal filters give equal strings.
+inline std::string convolution_options(filter2d const& f)
+{
+    std::string options = "-D RADIUS=" + std::to_string(f.radius) + " -D COEFFS=";
+    char text[64];
+    for(size_t i = 0; i < f.coeffs.size(); ++i)
+    {
+        std::snprintf(text, sizeof(text), "%s%af", i == 0 ? "" : ",", (double)f.coeffs[i]);
+        options += text;
+    }
+    return options;
+}
+
+// Compiled variants of convolution.cl, one program per filter, built on
+// first use. Not thread-safe: the kernels returned share their arguments
+// between callers, so use one engine per host thread.
+class convolution_engine
+{
+public:
+    struct statistics
+    {
+        size_t lookups;
+        size_t builds;
+        double build_ms;            // total time spent in clBuildProgram
+    };
+
+    convolution_engine(cl_context context, cl_device_id device, std::string source)
+        : context_{context}, device_{device}, source_{std::move(source)}
+    {
+        clRetainContext(context_);
+    }
+
+    ~convolution_engine()
+    {
+        for(auto& v : variants_)
+        {
+            clReleaseKernel(v.second.kernel);
+            clReleaseProgram(v.second.program);
+        }
+        clReleaseContext(context_);
+    }
+
+    convolution_engine(convolution_engine const&) = delete;
+    convolution_engine& operator=(convolution_engine const&) = delete;
+
+    // Kernel 'convolve(src, dst, w, h)' for 'f', owned by the engine. On a
+    // build failure returns nullptr with the status set, see build_log().
+    cl_kernel kernel(filter2d const& f, cl_int* status)
+    {
+        ++stats_.lookups;
+        if(f.coeffs.size() != size_t(f.size()) * f.size()){ *status = CL_INVALID_VALUE; return nullptr; }
+
+        auto options = convolution_options(f);
+        auto it = variants_.find(options);
+        if(it != variants_.end()){ *status = CL_SUCCESS; return it->second.kernel; }
+
+        size_t      sourceSize = source_.size();
+        const char* sourcePtr  = source_.c_str();
+        auto program = clCreateProgramWithSource(context_, 1, &sourcePtr, &sourceSize, status);
+        if(*status != CL_SUCCESS) return nullptr;
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        *status = clBuildProgram(program, 1, &device_, options.c_str(), nullptr, nullptr);
+        stats_.build_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+        ++stats_.builds;
+        if(*status != CL_SUCCESS)
+        {
+            size_t len = 0;
+            clGetProgramBuildInfo(program, device_, CL_PROGRAM_BUILD_LOG, 0, nullptr, &len);
+            log_.assign(len, '\0');
+            clGetProgramBuildInfo(program, device_, CL_PROGRAM_BUILD_LOG, len, &log_[0], nullptr);
+            clReleaseProgram(program);
+            return nullptr;
+        }
+
+        auto kernel = clCreateKernel(program, "convolve", status);
+        if(*status != CL_SUCCESS){ clReleaseProgram(program); return nullptr; }
+
+        variants_.emplace(std::move(options), variant{program, kernel});
+        return kernel;
+    }
+
+    std::string const& build_log() const { return log_; }
+    statistics stats() const { return stats_; }
+
+private:
+    struct variant
+    {
+        cl_program program;
+        cl_kernel kernel;
+    };
+
+    cl_context context_;
+    cl_device_id device_;
+    std::string source_;
+    std::map<std::string, variant> variants_;
+    std::string log_;
+    statistics stats_ = {};
+};
+
+namespace convolution_detail
+{
+    // Source with 'radius' clamped pixels around it, so taps never branch
+    inline std::vector<unsigned char> padded(unsigned char const* src, int w, int h, int radius)
+    {
+        const int pw = w + 2 * radius;
+        std::vector<unsigned char> out(size_t(pw) * (h + 2 * radius) * 4);
+        separable_detail::parallel_rows(h + 2 * radius, [&](int y0, int y1)
+        {
+            for(int y = y0; y < y1; ++y)
+            {
+                unsigned char const* row = src + size_t(std::min(std::max(y - radius, 0), h - 1)) * w * 4;
+                unsigned char* o = out.data() + size_t(y) * pw * 4;
+                for(int x = 0; x < pw; ++x)
+                    std::memcpy(o + 4 * x, row + 4 * std::min(std::max(x - radius, 0), w - 1), 4);
+            }
+        });
+        return out;
+    }
+
+    inline unsigned char saturate(float v)
+    {
+        return (unsigned char)std::nearbyint(std::min(std::max(v, 0.0f), 255.0f));
+    }
+
+    // Sum of the K*K taps at byte offset i, in the order of convolution.cl,
+    // expanded at compile time
+    template<int R, int... I>
+    inline float taps(unsigned char const* const* rows, float const* coeffs, size_t i, std::integer_sequence<int, I...>)
+    {
+        constexpr int K = 2 * R + 1;
+        float acc = 0.0f;
+        ((acc += coeffs[I] * rows[I / K][i + 4 * (I % K)]), ...);
+        return acc;
+    }
+
+    template<typename F>
+    void each_row(unsigned char const* src, unsigned char* dst, int w, int h, int radius, F body)
+    {
+        auto pad = padded(src, w, h, radius);
+        const size_t pitch = size_t(w + 2 * radius) * 4;
+        separable_detail::parallel_rows(h, [&](int y0, int y1)
+        {
+            std::vector<unsigned char const*> rows(2 * radius + 1);
+            for(int y = y0; y < y1; ++y)
+            {
+                for(int k = 0; k <= 2 * radius; ++k) rows[k] = pad.data() + (y + k) * pitch;
+                unsigned char* d = dst + size_t(y) * w * 4;
+                body(rows.data(), d);
+                for(int x = 0; x < w; ++x) d[4 * x + 3] = src[(size_t(y) * w + x) * 4 + 3];
+            }
+        });
+    }
+}
+
+// Convolution with the radius fixed at compile time: no loops over taps
+template<int R>
+void convolve_cpu(unsigned char const* src, unsigned char* dst, int w, int h, float const* coeffs)
+{
+    using namespace convolution_detail;
+    each_row(src, dst, w, h, R, [&](unsigned char const* const* rows, unsigned char* d)
+    {
+        for(size_t i = 0; i < size_t(w) * 4; ++i)
+            d[i] = saturate(taps<R>(rows, coeffs, i, std::make_integer_sequence<int, (2 * R + 1) * (2 * R + 1)>{}));
+    });
+}
+
+// Any radius, with loops over the taps
+inline void convolve_cpu_generic(unsigned char const* src, unsigned char* dst, int w, int h, filter2d const& f)
+{
+    using namespace convolution_detail;
+    const int K = f.size();
+    each_row(src, dst, w, h, f.radius, [&](unsigned char const* const* rows, unsigned char* d)
+    {
+        for(size_t i = 0; i < size_t(w) * 4; ++i)
+        {
+            float acc = 0.0f;
+            for(int k = 0; k < K * K; ++k) acc += f.coeffs[k] * rows[k / K][i + 4 * (k % K)];
+            d[i] = saturate(acc);
+        }
+    });
+}
+
+inline void convolve_cpu(unsigned char const* src, unsigned char* dst, int w, int h, filter2d const& f)
+{
+    switch(f.radius)
+    {
+        case 1:  convolve_cpu<1>(src, dst, w, h, f.coeffs.data()); break;
+        case 2:  convolve_cpu<2>(src, dst, w, h, f.coeffs.data()); break;
+        case 3:  convolve_cpu<3>(src, dst, w, h, f.coeffs.data()); break;
+        default: convolve_cpu_generic(src, dst, w, h, f);           break;
+    }
+}
@@ -0,0 +1,397 @@
+#pragma once
+
+#ifdef __APPLE__ //Mac OSX has a different name for the header file
+#include <OpenCL/opencl.h>
+#else
+#include <CL/opencl.h>
+#endif
+
+#include <map>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+#include "mem_pool.hpp"
+#include "convolution.hpp"
+
+// Chains of image filters that run on the device from the source upload to
+// the final read-back. Stages are declared as nodes; compile() turns the
+// graph into OpenCL kernels:
+//
+//   filter_graph g;
+//   auto edges = g.threshold(g.sobel(g.blur(g.grayscale(g.source()), 2)), 0.25f);
+//   auto out   = g.composite(g.source(), edges, blend::max);
+//   auto plan  = g.compile(context, device, out, true, &status);
+//   plan->run(queue, pool, src, dst, w, h);
+//
+// Point-wise stages (grayscale, threshold, composite, ...) are fused: they
+// are evaluated inside the kernel of the neighbourhood stage that consumes
+// or produces them, recomputed per tap where needed. Only neighbourhood
+// stages read by offsets or by several consumers, and the output, are
+// stored. Stored intermediates are RGBA8 buffers from a mem_pool, handed
+// back as soon as their last reader is enqueued, so later stages reuse
+// them. Every stage clamps its result to [0, 1] and edges are clamped, so
+// fused and unfused plans differ only by the rounding of the stored
+// intermediates (which edge detection and thresholds can amplify).
+
+enum class blend { add, multiply, max, mix };
+
+class filter_graph
+{
+public:
+    using node = int;
+
+    class plan;
+
+    filter_graph() { nodes_.push_back({ kind::source }); }
+
+    // The input image, always node 0
+    node source() const { return 0; }
+
+    node grayscale(node in)                 { return add({ kind::grayscale, { in } }); }
+    node invert(node in)                    { return add({ kind::invert, { in } }); }
+    node threshold(node in, float level)    { return add({ kind::threshold, { in }, level }); }
+    node composite(node a, node b, blend mode, float weight = 0.5f)
+    {
+        return add({ kind::composite, { a, b }, weight, {}, mode });
+    }
+
+    // Neighbourhood stages, edges clamped
+    node convolve(node in, filter2d f)      { return add({ kind::convolve, { in }, 0.0f, std::move(f) }); }
+    node blur(node in, int radius)          { return convolve(in, filter2d::outer(gaussian_taps(radius), gaussian_taps(radius))); }
+    node sobel(node in)                     { return add({ kind::sobel, { in } }); }
+
+    // OpenCL source of the kernels for 'output', one per stored node;
+    // 'fuse' false stores every node, for comparison
+    std::string source_code(node output, bool fuse) const
+    {
+        auto stored = stored_nodes(output, fuse);
+        std::string code = prelude();
+        int k = 0;
+        for(node n = 1; n < (node)nodes_.size(); ++n)
+            if(stored[n]) code += kernel_code(n, k++, stored);
+        return code;
+    }
+
+    // Builds the kernels for 'output'; nullptr with 'status' set on failure,
+    // with the build log in 'log' if given
+    std::unique_ptr<plan> compile(cl_context context, cl_device_id device, node output, bool fuse,
+                                  cl_int* status, std::string* log = nullptr) const;
+
+private:
+    enum class kind { source, grayscale, invert, threshold, composite, convolve, sobel };
+
+    struct node_info
+    {
+        kind type = kind::source;
+        std::vector<node> inputs = {};
+        float param = 0.0f;
+        filter2d filter = {};
+        blend mode = blend::add;
+    };
+
+    node add(node_info info)
+    {
+        nodes_.push_back(std::move(info));
+        return (node)nodes_.size() - 1;
+    }
+
+    static bool neighbourhood(kind k) { return k == kind::convolve || k == kind::sobel; }
+
+    // Nodes with a buffer of their own. Inputs always precede their
+    // consumers, so one backward pass sees every consumer of a node first.
+    std::vector<bool> stored_nodes(node output, bool fuse) const
+    {
+        const size_t n = nodes_.size();
+        std::vector<bool> used(n, false), stored(n, false), by_offset(n, false);
+        std::vector<int> consumers(n, 0);
+        used[output] = true;
+        for(node i = output; i >= 0; --i)
+        {
+            if(!used[i]) continue;
+            stored[i] = i == 0 || i == output || !fuse
+                     || (neighbourhood(nodes_[i].type) && (by_offset[i] || consumers[i] > 1));
+            for(node in : nodes_[i].inputs)
+            {
+                used[in] = true;
+                ++consumers[in];
+                // Read at other pixels: directly, or through fused point-wise stages
+                if(neighbourhood(nodes_[i].type) || (!stored[i] && by_offset[i])) by_offset[in] = true;
+            }
+        }
+        return stored;
+    }
+
+    static std::string prelude()
+    {
+        return
+            "float4 load_rgba8(global const uchar4* src, int x, int y, int w, int h)\n"
+            "{\n"
+            "    return convert_float4(src[clamp(y, 0, h - 1) * w + clamp(x, 0, w - 1)]) * (1.0f / 255.0f);\n"
+            "}\n\n";
+    }
+
+    static std::string literal(float v)
+    {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%af", (double)v);
+        return text;
+    }
+
+    // Kernel 'stage<k>' computing node 'root' from the stored nodes it reads.
+    // Each node of the kernel becomes a function of the pixel coordinates.
+    std::string kernel_code(node root, int k, std::vector<bool> const& stored) const
+    {
+        // Nodes of this kernel, in order, and the stored nodes it reads
+        std::vector<node> members, inputs;
+        std::vector<bool> seen(nodes_.size(), false);
+        collect(root, root, stored, seen, members, inputs);
+
+        const std::string K = "s" + std::to_string(k) + "_";
+        std::string params, args;
+        for(size_t i = 0; i < inputs.size(); ++i)
+        {
+            params += "global const uchar4* in" + std::to_string(i) + ", ";
+            args   += "in" + std::to_string(i) + ", ";
+        }
+        params += "int w, int h";
+        args   += "w, h";
+
+        auto call = [&](node n, std::string const& x, std::string const& y)
+        {
+            return K + "n" + std::to_string(n) + "(" + args + ", " + x + ", " + y + ")";
+        };
+
+        std::string code;
+        for(node n : members)
+        {
+            code += "float4 " + K + "n" + std::to_string(n) + "(" + params + ", int x, int y)\n{\n";
+            auto const& info = nodes_[n];
+            if(n != root && stored[n])
+            {
+                auto slot = std::find(inputs.begin(), inputs.end(), n) - inputs.begin();
+                code += "    return load_rgba8(in" + std::to_string(slot) + ", x, y, w, h);\n}\n\n";
+                continue;
+            }
+
+            std::string a = info.inputs.empty() ? "" : call(info.inputs[0], "x", "y");
+            switch(info.type)
+            {
+            case kind::source: break;
+            case kind::grayscale:
+                code += "    float4 v = " + a + ";\n"
+                        "    float l = 0.299f * v.x + 0.587f * v.y + 0.114f * v.z;\n"
+                        "    return (float4)(l, l, l, v.w);\n";
+                break;
+            case kind::invert:
+                code += "    float4 v = " + a + ";\n"
+                        "    return (float4)(1.0f - v.x, 1.0f - v.y, 1.0f - v.z, v.w);\n";
+                break;
+            case kind::threshold:
+                code += "    float4 v = " + a + ";\n"
+                        "    float l = 0.299f * v.x + 0.587f * v.y + 0.114f * v.z >= " + literal(info.param) + " ? 1.0f : 0.0f;\n"
+                        "    return (float4)(l, l, l, v.w);\n";
+                break;
+            case kind::composite:
+            {
+                code += "    float4 a = " + a + ";\n"
+                        "    float4 b = " + call(info.inputs[1], "x", "y") + ";\n";
+                const char* expr = info.mode == blend::add      ? "a + b"
+                                 : info.mode == blend::multiply ? "a * b"
+                                 : info.mode == blend::max      ? "fmax(a, b)"
+                                 :                                "mix(a, b, w_)";
+                if(info.mode == blend::mix) code += "    const float w_ = " + literal(info.param) + ";\n";
+                code += "    return clamp(" + std::string(expr) + ", 0.0f, 1.0f);\n";
+                break;
+            }
+            case kind::convolve:
+            {
+                const int r = info.filter.radius, size = info.filter.size();
+                code += "    float4 acc = (float4)(0.0f);\n";
+                for(int dy = -r; dy <= r; ++dy)
+                    for(int dx = -r; dx <= r; ++dx)
+                    {
+                        float c = info.filter.coeffs[(dy + r) * size + dx + r];
+                        if(c == 0.0f) continue;
+                        code += "    acc += " + literal(c) + " * " + call(info.inputs[0], "x + (" + std::to_string(dx) + ")", "y + (" + std::to_string(dy) + ")") + ";\n";
+                    }
+                code += "    acc = clamp(acc, 0.0f, 1.0f);\n"
+                        "    acc.w = " + a + ".w;\n"
+                        "    return acc;\n";
+                break;
+            }
+            case kind::sobel:
+            {
+                code += "    float4 D[9];\n";
+                for(int i = 0; i < 9; ++i)
+                    code += "    D[" + std::to_string(i) + "] = " + call(info.inputs[0], "x + (" + std::to_string(i % 3 - 1) + ")", "y + (" + std::to_string(i / 3 - 1) + ")") + ";\n";
+                code += "    float4 resx = D[0] - D[2] + 2.0f * (D[3] - D[5]) + D[6] - D[8];\n"
+                        "    float4 resy = D[0] + D[2] + 2.0f * (D[1] - D[7]) - D[6] - D[8];\n"
+                        "    float4 res = clamp(D[4] * (sqrt(dot(resx, resx)+dot(resy, resy))), 0.0f, 1.0f);\n"
+                        "    res.w = 1.0f;\n"
+                        "    return res;\n";
+                break;
+            }
+            }
+            code += "}\n\n";
+        }
+
+        code += "kernel void stage" + std::to_string(k) + "(" + params + ", global uchar4* out)\n{\n"
+                "    const int x = get_global_id(0);\n"
+                "    const int y = get_global_id(1);\n"
+                "    if(x >= w || y >= h) return;\n"
+                "    out[y * w + x] = convert_uchar4_sat_rte(" + call(root, "x", "y") + " * 255.0f);\n"
+                "}\n\n";
+        return code;
+    }
+
+    // Post-order walk from 'n': inlined nodes recurse, stored ones are inputs
+    void collect(node n, node root, std::vector<bool> const& stored, std::vector<bool>& seen,
+                 std::vector<node>& members, std::vector<node>& inputs) const
+    {
+        if(seen[n]) return;
+        seen[n] = true;
+        if(n != root && stored[n]) inputs.push_back(n);
+        else
+            for(node in : nodes_[n].inputs) collect(in, root, stored, seen, members, inputs);
+        members.push_back(n);
+    }
+
+    std::vector<node_info> nodes_;
+};
+
+// Compiled filter_graph: one kernel per stored node, in dependency order
+class filter_graph::plan
+{
+public:
+    ~plan()
+    {
+        for(auto& s : stages_) clReleaseKernel(s.kernel);
+        if(program_) clReleaseProgram(program_);
+    }
+
+    plan(plan const&) = delete;
+    plan& operator=(plan const&) = delete;
+
+    size_t kernels() const { return stages_.size(); }
+    std::string const& source_code() const { return source_; }
+
+    // Filters the w x h RGBA8 buffer 'src' into 'dst'. Intermediates come
+    // from 'pool' and go back to it before returning; the queue must be
+    // in-order, as a buffer handed back may be rewritten by the next stage.
+    // Kernel events are appended to 'events' if given, the caller releases them.
+    cl_int run(cl_command_queue queue, mem_pool& pool, cl_mem src, cl_mem dst, int w, int h,
+               std::vector<cl_event>* events = nullptr) const
+    {
+        cl_int status = CL_SUCCESS;
+        const size_t bytes = sizeof(cl_uchar4) * w * h;
+        size_t dims[2] = { (size_t)w, (size_t)h };
+
+        if(stages_.empty()) return clEnqueueCopyBuffer(queue, src, dst, 0, 0, bytes, 0, nullptr, nullptr);
+
+        std::map<node, mem_pool::handle> buffers;
+        for(size_t s = 0; s < stages_.size(); ++s)
+        {
+            auto const& stage = stages_[s];
+            cl_mem out = dst;
+            if(s + 1 < stages_.size())
+            {
+                auto buffer = pool.buffer(CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, bytes, &status);
+                if(status != CL_SUCCESS) return status;
+                out = buffer.get();
+                buffers[stage.output] = std::move(buffer);
+            }
+
+            cl_uint arg = 0;
+            for(node in : stage.inputs)
+            {
+                cl_mem mem = in == 0 ? src : buffers.at(in).get();
+                status = clSetKernelArg(stage.kernel, arg++, sizeof(mem), &mem);
+                if(status != CL_SUCCESS) return status;
+            }
+            status = clSetKernelArg(stage.kernel, arg++, sizeof(w), &w);
+            if(status == CL_SUCCESS) status = clSetKernelArg(stage.kernel, arg++, sizeof(h), &h);
+            if(status == CL_SUCCESS) status = clSetKernelArg(stage.kernel, arg++, sizeof(out), &out);
+            if(status != CL_SUCCESS) return status;
+
+            cl_event event;
+            status = clEnqueueNDRangeKernel(queue, stage.kernel, 2, nullptr, dims, nullptr, 0, nullptr, events ? &event : nullptr);
+            if(status != CL_SUCCESS) return status;
+            if(events) events->push_back(event);
+
+            // Back to the pool after the last reader; later stages may reuse it
+            for(node done : stage.last_use) buffers.erase(done);
+        }
+        return status;
+    }
+
+private:
+    friend class filter_graph;
+    plan() = default;
+
+    struct stage
+    {
+        node output;
+        std::vector<node> inputs;       // stored nodes read, in argument order
+        std::vector<node> last_use;     // inputs no later stage reads
+        cl_kernel kernel;
+    };
+
+    cl_program program_ = nullptr;
+    std::vector<stage> stages_;
+    std::string source_;
+};
+
+inline std::unique_ptr<filter_graph::plan> filter_graph::compile(cl_context context, cl_device_id device, node output, bool fuse,
+                                                                 cl_int* status, std::string* log) const
+{
+    std::unique_ptr<plan> p{ new plan };
+    p->source_ = source_code(output, fuse);
+
+    size_t      sourceSize = p->source_.size();
+    const char* sourcePtr  = p->source_.c_str();
+    p->program_ = clCreateProgramWithSource(context, 1, &sourcePtr, &sourceSize, status);
+    if(*status != CL_SUCCESS){ p->program_ = nullptr; return nullptr; }
+
+    *status = clBuildProgram(p->program_, 1, &device, nullptr, nullptr, nullptr);
+    if(*status != CL_SUCCESS)
+    {
+        if(log)
+        {
+            size_t len = 0;
+            clGetProgramBuildInfo(p->program_, device, CL_PROGRAM_BUILD_LOG, 0, nullptr, &len);
+            log->assign(len, '\0');
+            clGetProgramBuildInfo(p->program_, device, CL_PROGRAM_BUILD_LOG, len, &(*log)[0], nullptr);
+        }
+        return nullptr;
+    }
+
+    auto stored = stored_nodes(output, fuse);
+    int k = 0;
+    for(node n = 1; n < (node)nodes_.size(); ++n)
+    {
+        if(!stored[n]) continue;
+        plan::stage s;
+        s.output = n;
+        std::vector<node> members;
+        std::vector<bool> seen(nodes_.size(), false);
+        collect(n, n, stored, seen, members, s.inputs);
+        s.kernel = clCreateKernel(p->program_, ("stage" + std::to_string(k++)).c_str(), status);
+        if(*status != CL_SUCCESS) return nullptr;
+        p->stages_.push_back(std::move(s));
+    }
+
+    // An input is dead after the last stage that reads it
+    for(size_t i = 0; i < p->stages_.size(); ++i)
+        for(node in : p->stages_[i].inputs)
+        {
+            bool later = false;
+            for(size_t j = i + 1; j < p->stages_.size(); ++j)
+                later = later || std::find(p->stages_[j].inputs.begin(), p->stages_[j].inputs.end(), in) != p->stages_[j].inputs.end();
+            if(!later && in != 0) p->stages_[i].last_use.push_back(in);
+        }
+    return p;
+}
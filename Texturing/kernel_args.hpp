@@ -0,0 +1,17 @@
+#pragma once
+
+#ifdef __APPLE__ //Mac OSX has a different name for the header file
+#include <OpenCL/opencl.h>
+#else
+#include <CL/opencl.h>
+#endif
+
+// Sets the arguments of 'kernel' in order, stops at the first failure
+template<typename... Ts>
+cl_int set_args(cl_kernel kernel, Ts const&... args)
+{
+    cl_uint index = 0;
+    cl_int status = CL_SUCCESS;
+    ((status = status == CL_SUCCESS ? clSetKernelArg(kernel, index++, sizeof(Ts), &args) : status), ...);
+    return status;
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#ifdef __APPLE__ //Mac OSX has a different name for the header file
+#include <OpenCL/opencl.h>
+#else
+#include <CL/opencl.h>
+#endif
+
+#include <vector>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <utility>
+#include <algorithm>
+
+// Recycles cl_mem objects between calls instead of creating and releasing
+// them every time. Buffers are rounded up to a size class (four steps per
+// power of two) so close sizes share a free list. Images are reused only
+// for the exact flags, format and extent: a larger image would move the
+// edge the samplers clamp to. Host pointer flags are not supported, upload
+// with clEnqueueWrite* instead.
+class mem_pool
+{
+public:
+    struct statistics
+    {
+        size_t acquires;
+        size_t hits;                // served from a free list
+        size_t bytes_in_use;        // by live handles
+        size_t peak_in_use;
+        size_t bytes_reserved;      // allocated on the device, free or not
+        size_t peak_reserved;
+
+        double hit_rate() const { return acquires == 0 ? 0.0 : (double)hits / acquires; }
+    };
+
+    // Returns its memory object to the pool when destroyed
+    class handle
+    {
+    public:
+        handle() = default;
+        handle(handle&& other) noexcept { swap(other); }
+        handle& operator=(handle&& other) noexcept { handle{ std::move(other) }.swap(*this); return *this; }
+        ~handle() { if(mem_) pool_->release(key_, mem_, bytes_); }
+
+        cl_mem get() const { return mem_; }
+        size_t bytes() const { return bytes_; }
+
+        void swap(handle& other) noexcept
+        {
+            std::swap(pool_, other.pool_);
+            std::swap(key_, other.key_);
+            std::swap(mem_, other.mem_);
+            std::swap(bytes_, other.bytes_);
+        }
+
+    private:
+        friend class mem_pool;
+        using key_type = std::tuple<cl_mem_object_type, cl_mem_flags, cl_channel_order, cl_channel_type, size_t, size_t>;
+        handle(mem_pool* pool, key_type key, cl_mem mem, size_t bytes) : pool_{pool}, key_{key}, mem_{mem}, bytes_{bytes} {}
+
+        mem_pool* pool_  = nullptr;
+        key_type  key_   = {};
+        cl_mem    mem_   = nullptr;
+        size_t    bytes_ = 0;
+    };
+
+    explicit mem_pool(cl_context context) : context_{context} { clRetainContext(context_); }
+
+    // Handles must not outlive the pool
+    ~mem_pool()
+    {
+        trim();
+        clReleaseContext(context_);
+    }
+
+    mem_pool(mem_pool const&) = delete;
+    mem_pool& operator=(mem_pool const&) = delete;
+
+    static size_t size_class(size_t bytes)
+    {
+        const size_t page = 4096;
+        if(bytes <= 4 * page) return std::max<size_t>((bytes + page - 1) / page, 1) * page;
+
+        size_t pow = 4 * page;
+        while(pow * 2 < bytes) pow *= 2;
+        const size_t step = pow / 4;
+        return (bytes + step - 1) / step * step;
+    }
+
+    // On failure the handle is empty and 'status' holds the error
+    handle buffer(cl_mem_flags flags, size_t bytes, cl_int* status)
+    {
+        const auto cls = size_class(bytes);
+        return acquire(handle::key_type{ CL_MEM_OBJECT_BUFFER, flags, 0, 0, cls, 0 }, status, [&](cl_int* s)
+        {
+            return clCreateBuffer(context_, flags, cls, nullptr, s);
+        });
+    }
+
+    handle image2d(cl_mem_flags flags, cl_image_format const& format, size_t width, size_t height, cl_int* status)
+    {
+        return acquire(handle::key_type{ CL_MEM_OBJECT_IMAGE2D, flags, format.image_channel_order, format.image_channel_data_type, width, height }, status, [&](cl_int* s)
+        {
+            cl_image_desc desc = {};
+            desc.image_type   = CL_MEM_OBJECT_IMAGE2D;
+            desc.image_width  = width;
+            desc.image_height = height;
+            return clCreateImage(context_, flags, &format, &desc, nullptr, s);
+        });
+    }
+
+    // Releases every object not held by a handle
+    void trim()
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        for(auto& bucket : free_)
+        {
+            for(auto& entry : bucket.second)
+            {
+                stats_.bytes_reserved -= entry.second;
+                clReleaseMemObject(entry.first);
+            }
+            bucket.second.clear();
+        }
+    }
+
+    statistics stats() const
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        return stats_;
+    }
+
+private:
+    template<typename Create>
+    handle acquire(handle::key_type const& key, cl_int* status, Create create)
+    {
+        *status = CL_SUCCESS;
+        if(std::get<1>(key) & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR)){ *status = CL_INVALID_VALUE; return handle{}; }
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            ++stats_.acquires;
+            auto it = free_.find(key);
+            if(it != free_.end() && !it->second.empty())
+            {
+                auto entry = it->second.back();
+                it->second.pop_back();
+                ++stats_.hits;
+                use(entry.second);
+                return handle{this, key, entry.first, entry.second};
+            }
+        }
+
+        // Miss: create outside the lock, the driver may take a while
+        cl_mem mem = create(status);
+        if(*status != CL_SUCCESS) return handle{};
+
+        size_t bytes = 0;
+        *status = clGetMemObjectInfo(mem, CL_MEM_SIZE, sizeof(bytes), &bytes, nullptr);
+        if(*status != CL_SUCCESS){ clReleaseMemObject(mem); return handle{}; }
+
+        std::lock_guard<std::mutex> lock{mutex_};
+        stats_.bytes_reserved += bytes;
+        stats_.peak_reserved = std::max(stats_.peak_reserved, stats_.bytes_reserved);
+        use(bytes);
+        return handle{this, key, mem, bytes};
+    }
+
+    void use(size_t bytes)
+    {
+        stats_.bytes_in_use += bytes;
+        stats_.peak_in_use = std::max(stats_.peak_in_use, stats_.bytes_in_use);
+    }
+
+    void release(handle::key_type const& key, cl_mem mem, size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stats_.bytes_in_use -= bytes;
+        free_[key].emplace_back(mem, bytes);
+    }
+
+    cl_context context_;
+    mutable std::mutex mutex_;
+    std::map<handle::key_type, std::vector<std::pair<cl_mem, size_t>>> free_;
+    statistics stats_ = {0, 0, 0, 0, 0, 0};
+};
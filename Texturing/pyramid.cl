@@ -0,0 +1,42 @@
+// Image pyramids over RGBA8 levels packed in one buffer, the atlas: each
+// level starts 'offset' pixels in and is read by the launch producing the
+// next, so the whole pyramid is one chain of launches with no host work
+// in between. A level is half the size of the one above, rounded up.
+//
+// The Gaussian filter is the 5x5 binomial kernel around (2x, 2y), the box
+// filter the 2x2 block at (2x, 2y); edges are clamped. Both work in
+// integers with the weights summing to a power of two, rounded to nearest,
+// so the host reference in pyramid.hpp gives the same bytes.
+
+constant uint pyramid_binomial[5] = { 1, 4, 6, 4, 1 };
+
+kernel void pyramid_down(global uchar4* atlas, int src_offset, int sw, int sh,
+                         int dst_offset, int dw, int dh, int gaussian)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= dw || y >= dh) return;
+
+    global const uchar4* src = atlas + src_offset;
+    uint4 acc = (uint4)(0);
+    if(gaussian)
+    {
+        for(int j = 0; j < 5; ++j)
+        {
+            global const uchar4* row = src + clamp(2 * y + j - 2, 0, sh - 1) * sw;
+            uint4 line = (uint4)(0);
+            for(int i = 0; i < 5; ++i)
+                line += pyramid_binomial[i] * convert_uint4(row[clamp(2 * x + i - 2, 0, sw - 1)]);
+            acc += pyramid_binomial[j] * line;
+        }
+        acc = (acc + 128) >> 8;
+    }
+    else
+    {
+        const int x1 = min(2 * x + 1, sw - 1), y1 = min(2 * y + 1, sh - 1);
+        acc = convert_uint4(src[2 * y * sw + 2 * x]) + convert_uint4(src[2 * y * sw + x1])
+            + convert_uint4(src[y1 * sw + 2 * x]) + convert_uint4(src[y1 * sw + x1]);
+        acc = (acc + 2) >> 2;
+    }
+    atlas[dst_offset + y * dw + x] = convert_uchar4(acc);
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#ifdef __APPLE__ //Mac OSX has a different name for the header file
+#include <OpenCL/opencl.h>
+#else
+#include <CL/opencl.h>
+#endif
+
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "kernel_args.hpp"
+#include "separable.hpp"
+
+// Image pyramids of RGBA8 images in one packed buffer, built on the device
+// by pyramid.cl or on the host with the same integer math. Every level
+// starts on an 'alignment' boundary (4096 bytes by default, a multiple of
+// any device's CL_DEVICE_MEM_BASE_ADDR_ALIGN in practice), so a level can
+// be taken as a sub-buffer and handed to any buffer kernel, the tiled
+// Sobel among them.
+
+enum class pyramid_filter { gaussian, box };
+
+struct pyramid_level
+{
+    size_t offset;                  // bytes from the start of the atlas
+    int width, height;
+
+    size_t bytes() const { return size_t(width) * height * 4; }
+};
+
+struct pyramid_layout
+{
+    std::vector<pyramid_level> levels;
+    size_t bytes = 0;               // of the whole atlas
+};
+
+// Levels from w x h down to 1x1, or 'max_levels' of them if not 0
+inline pyramid_layout make_pyramid_layout(int w, int h, int max_levels = 0, size_t alignment = 4096)
+{
+    pyramid_layout layout;
+    for(;;)
+    {
+        layout.levels.push_back({ layout.bytes, w, h });
+        layout.bytes += (layout.levels.back().bytes() + alignment - 1) / alignment * alignment;
+        if((w == 1 && h == 1) || (int)layout.levels.size() == max_levels) break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+    return layout;
+}
+
+// Level 0 copied from 'src', the others filtered down from it into 'atlas'
+inline void build_pyramid_cpu(unsigned char const* src, unsigned char* atlas, pyramid_layout const& layout, pyramid_filter filter)
+{
+    static constexpr unsigned binomial[5] = { 1, 4, 6, 4, 1 };
+    std::memcpy(atlas + layout.levels[0].offset, src, layout.levels[0].bytes());
+    for(size_t k = 1; k < layout.levels.size(); ++k)
+    {
+        auto const& from = layout.levels[k - 1];
+        auto const& to = layout.levels[k];
+        unsigned char const* s = atlas + from.offset;
+        unsigned char* d = atlas + to.offset;
+        const int sw = from.width, sh = from.height;
+        auto at = [&](int x, int y, int c)
+        {
+            return (unsigned)s[(size_t(std::min(std::max(y, 0), sh - 1)) * sw + std::min(std::max(x, 0), sw - 1)) * 4 + c];
+        };
+        separable_detail::parallel_rows(to.height, [&](int y0, int y1)
+        {
+            for(int y = y0; y < y1; ++y)
+                for(int x = 0; x < to.width; ++x)
+                    for(int c = 0; c < 4; ++c)
+                    {
+                        unsigned acc = 0;
+                        if(filter == pyramid_filter::gaussian)
+                        {
+                            for(int j = 0; j < 5; ++j)
+                            {
+                                unsigned line = 0;
+                                for(int i = 0; i < 5; ++i) line += binomial[i] * at(2 * x + i - 2, 2 * y + j - 2, c);
+                                acc += binomial[j] * line;
+                            }
+                            acc = (acc + 128) >> 8;
+                        }
+                        else
+                            acc = (at(2 * x, 2 * y, c) + at(2 * x + 1, 2 * y, c) + at(2 * x, 2 * y + 1, c) + at(2 * x + 1, 2 * y + 1, c) + 2) >> 2;
+                        d[(size_t(y) * to.width + x) * 4 + c] = (unsigned char)acc;
+                    }
+        });
+    }
+}
+
+// Level 'k' of an atlas buffer as a sub-buffer, owned by the caller;
+// 'flags' 0 inherits those of the atlas
+inline cl_mem pyramid_level_buffer(cl_mem atlas, pyramid_layout const& layout, size_t k, cl_mem_flags flags, cl_int* status)
+{
+    const cl_buffer_region region = { layout.levels[k].offset, layout.levels[k].bytes() };
+    return clCreateSubBuffer(atlas, flags, CL_BUFFER_CREATE_TYPE_REGION, &region, status);
+}
+
+// The kernel of pyramid.cl from a built program
+class pyramid_builder
+{
+public:
+    pyramid_builder(cl_program program, cl_int* status)
+    {
+        kernel_ = clCreateKernel(program, "pyramid_down", status);
+    }
+
+    ~pyramid_builder()
+    {
+        if(kernel_) clReleaseKernel(kernel_);
+    }
+
+    pyramid_builder(pyramid_builder const&) = delete;
+    pyramid_builder& operator=(pyramid_builder const&) = delete;
+
+    // Enqueues levels 1 and below from level 0, already in 'atlas' or
+    // written by the command of 'level0' (nullptr: none to wait for). The
+    // first launch waits for 'level0' and each later one for the one before,
+    // so the chain also holds on out-of-order queues, and nothing blocks.
+    // Kernel events are appended to 'events' if given, the caller releases
+    // them; 'level0' stays the caller's.
+    cl_int build(cl_command_queue queue, cl_mem atlas, pyramid_layout const& layout, pyramid_filter filter,
+                 cl_event level0 = nullptr, std::vector<cl_event>* events = nullptr)
+    {
+        const cl_int gaussian = filter == pyramid_filter::gaussian;
+        cl_event previous = level0;
+        cl_int status = CL_SUCCESS;
+        for(size_t k = 1; k < layout.levels.size() && status == CL_SUCCESS; ++k)
+        {
+            auto const& from = layout.levels[k - 1];
+            auto const& to = layout.levels[k];
+            const cl_int src_offset = cl_int(from.offset / 4), dst_offset = cl_int(to.offset / 4);
+            status = set_args(kernel_, atlas, src_offset, from.width, from.height, dst_offset, to.width, to.height, gaussian);
+            if(status != CL_SUCCESS) break;
+
+            const size_t dims[2] = { (size_t)to.width, (size_t)to.height };
+            cl_event event;
+            status = clEnqueueNDRangeKernel(queue, kernel_, 2, nullptr, dims, nullptr, previous ? 1 : 0, previous ? &previous : nullptr, &event);
+            if(status != CL_SUCCESS) break;
+            if(events) events->push_back(event);
+            else if(previous != level0) clReleaseEvent(previous);
+            previous = event;
+        }
+        if(!events && previous != level0) clReleaseEvent(previous);
+        return status;
+    }
+
+private:
+    cl_kernel kernel_ = nullptr;
+};
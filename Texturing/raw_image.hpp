@@ -0,0 +1,194 @@
+#pragma once
+
+#ifdef __APPLE__ //Mac OSX has a different name for the header file
+#include <OpenCL/opencl.h>
+#else
+#include <CL/opencl.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <utility>
+#include <algorithm>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "aligned_allocator.hpp"
+
+// Raw image container: a 4096-byte header followed by the rows as they lie
+// in memory, so loading is a mmap and the pixels start page-aligned, ready
+// for CL_MEM_USE_HOST_PTR (zero-copy on CPU and integrated devices) or the
+// host filters. Fields are little-endian, as on every machine this runs on.
+//
+//   offset  0  magic "RAWIMG\0\1"
+//           8  width, height            uint32
+//          16  format                   uint32, raw_format
+//          20  reserved                 uint32, 0
+//          24  stride                   uint64, bytes per row
+//          32  data offset              uint64, 4096
+//
+// Rows are 'stride' bytes apart, a multiple of the pixel size; the writer
+// packs them tightly unless asked to align them.
+
+enum class raw_format : uint32_t { rgba8 = 1, rgba32f = 2 };
+
+inline size_t pixel_bytes(raw_format f) { return f == raw_format::rgba32f ? 16 : 4; }
+
+namespace raw_image_detail
+{
+    constexpr char magic[8] = { 'R', 'A', 'W', 'I', 'M', 'G', 0, 1 };
+    constexpr size_t header_bytes = 4096;
+
+    struct header
+    {
+        char magic[8];
+        uint32_t width, height;
+        uint32_t format;
+        uint32_t reserved;
+        uint64_t stride;
+        uint64_t offset;
+    };
+    static_assert(sizeof(header) == 40, "Packed header layout");
+
+    // The pixel rows must fit in the file; a crafted stride must not wrap
+    // the size computed for them around
+    inline bool consistent(header const& hd, size_t file_bytes)
+    {
+        const auto bpp = pixel_bytes(raw_format(hd.format));
+        if(std::memcmp(hd.magic, magic, 8) != 0 || hd.width == 0 || hd.height == 0) return false;
+        if(hd.format != uint32_t(raw_format::rgba8) && hd.format != uint32_t(raw_format::rgba32f)) return false;
+        if(hd.stride < uint64_t(hd.width) * bpp || hd.stride % bpp != 0 || hd.offset != header_bytes) return false;
+        if(hd.offset > file_bytes || hd.stride > (file_bytes - hd.offset) / hd.height) return false;
+        return true;
+    }
+}
+
+// 'src' rows 'src_stride' bytes apart (0: tight), each row of the file
+// padded to a multiple of 'row_alignment' bytes (1: tight)
+inline bool write_raw_image(std::string const& path, int w, int h, raw_format format, void const* src,
+                            size_t src_stride = 0, size_t row_alignment = 1)
+{
+    using namespace raw_image_detail;
+    const size_t row = size_t(w) * pixel_bytes(format);
+    if(src_stride == 0) src_stride = row;
+    row_alignment = std::max<size_t>(row_alignment, 1);
+    const size_t stride = (row + row_alignment - 1) / row_alignment * row_alignment;
+    if(w <= 0 || h <= 0 || stride % pixel_bytes(format) != 0) return false;
+
+    std::vector<char> head(header_bytes, 0);
+    header hd = {};
+    std::memcpy(hd.magic, magic, 8);
+    hd.width = (uint32_t)w;
+    hd.height = (uint32_t)h;
+    hd.format = uint32_t(format);
+    hd.stride = stride;
+    hd.offset = header_bytes;
+    std::memcpy(head.data(), &hd, sizeof(hd));
+
+    std::ofstream file(path, std::ios::binary);
+    file.write(head.data(), std::streamsize(head.size()));
+    std::vector<char> pad(stride - row, 0);
+    for(int y = 0; y < h && file; ++y)
+    {
+        file.write(static_cast<char const*>(src) + size_t(y) * src_stride, std::streamsize(row));
+        file.write(pad.data(), std::streamsize(pad.size()));
+    }
+    return bool(file);
+}
+
+// A raw image file mapped read-write and private: writes, including those
+// of an OpenCL runtime owning the pixels through CL_MEM_USE_HOST_PTR, stay
+// in memory and never reach the file. Pages are read on first touch unless
+// 'populate' asks for all of them up front. Where mmap is unavailable the
+// file is read into page-aligned memory instead. Check valid().
+class mapped_image
+{
+public:
+    explicit mapped_image(std::string const& path, bool populate = false)
+    {
+        using namespace raw_image_detail;
+#ifdef __linux__
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0) return;
+        struct stat st;
+        if(::fstat(fd, &st) == 0 && size_t(st.st_size) >= header_bytes)
+        {
+            void* p = ::mmap(nullptr, size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE | (populate ? MAP_POPULATE : 0), fd, 0);
+            if(p != MAP_FAILED){ map_ = static_cast<unsigned char*>(p); length_ = size_t(st.st_size); }
+        }
+        ::close(fd);
+        if(!map_) return;
+        if(!populate) ::madvise(map_, length_, MADV_SEQUENTIAL);
+        base_ = map_;
+#else
+        (void)populate;
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if(!file) return;
+        copy_.resize(size_t(file.tellg()));
+        file.seekg(0);
+        if(!file.read(reinterpret_cast<char*>(copy_.data()), std::streamsize(copy_.size()))) return;
+        base_ = copy_.data();
+        length_ = copy_.size();
+#endif
+        if(length_ >= sizeof(header_)) std::memcpy(&header_, base_, sizeof(header_));
+        if(!consistent(header_, length_)) header_ = {};
+    }
+
+    ~mapped_image()
+    {
+#ifdef __linux__
+        if(map_) ::munmap(map_, length_);
+#endif
+    }
+
+    mapped_image(mapped_image const&) = delete;
+    mapped_image& operator=(mapped_image const&) = delete;
+
+    bool valid() const { return header_.width != 0; }
+    int width() const { return (int)header_.width; }
+    int height() const { return (int)header_.height; }
+    raw_format format() const { return raw_format(header_.format); }
+    size_t stride() const { return header_.stride; }
+    bool tight() const { return stride() == size_t(width()) * pixel_bytes(format()); }
+
+    unsigned char* pixels() { return valid() ? base_ + header_.offset : nullptr; }
+    unsigned char const* pixels() const { return valid() ? base_ + header_.offset : nullptr; }
+
+    // 2D image over the mapped pixels, owned by the caller. The mapping
+    // must outlive it.
+    cl_mem image(cl_context context, cl_mem_flags flags, cl_int* status)
+    {
+        if(!valid()){ *status = CL_INVALID_HOST_PTR; return nullptr; }
+        cl_image_format fmt = { CL_RGBA, cl_channel_type(format() == raw_format::rgba32f ? CL_FLOAT : CL_UNORM_INT8) };
+        cl_image_desc desc = {};
+        desc.image_type = CL_MEM_OBJECT_IMAGE2D;
+        desc.image_width = width();
+        desc.image_height = height();
+        desc.image_row_pitch = stride();
+        return clCreateImage(context, flags | CL_MEM_USE_HOST_PTR, &fmt, &desc, pixels(), status);
+    }
+
+    // Buffer over the mapped pixels (padding included), owned by the caller
+    cl_mem buffer(cl_context context, cl_mem_flags flags, cl_int* status)
+    {
+        if(!valid()){ *status = CL_INVALID_HOST_PTR; return nullptr; }
+        return clCreateBuffer(context, flags | CL_MEM_USE_HOST_PTR, stride() * height(), pixels(), status);
+    }
+
+private:
+    raw_image_detail::header header_ = {};
+    unsigned char* base_ = nullptr;
+    size_t length_ = 0;
+    unsigned char* map_ = nullptr;
+#ifndef __linux__
+    std::vector<unsigned char, aligned_allocator<unsigned char, 4096>> copy_;
+#endif
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <algorithm>
+
+// Roofline of one target (the threaded host or an OpenCL device) as
+// measured by the 'roofline' calibration program: STREAM-style bandwidths
+// in GB/s and peak arithmetic in GFLOP/s. The attainable performance of a
+// kernel doing F flops on B bytes of memory traffic is
+//     min(peak, F / B * bandwidth),
+// so a result is reported as a fraction of that bound.
+//
+// The calibration file has one line per target, tab separated:
+//     name  copy  scale  add  triad  gflops
+// 'host' is the threaded CPU, other names are CL_DEVICE_NAME.
+struct roofline
+{
+    std::string name;
+    double copy, scale, add, triad;     // GB/s
+    double gflops;
+
+    double bandwidth() const { return triad; }
+    double attainable_gflops(double flops, double bytes) const
+    {
+        return bytes <= 0.0 ? gflops : std::min(gflops, flops / bytes * bandwidth());
+    }
+};
+
+static const char roofline_file[] = "./../../roofline.txt";
+
+inline std::vector<roofline> load_rooflines(std::string const& path = roofline_file)
+{
+    std::vector<roofline> res;
+    std::ifstream in{ path };
+    for (std::string line; std::getline(in, line);)
+    {
+        std::istringstream fields{ line };
+        roofline r;
+        if (std::getline(fields, r.name, '\t') && fields >> r.copy >> r.scale >> r.add >> r.triad >> r.gflops)
+            res.push_back(r);
+    }
+    return res;
+}
+
+inline void save_rooflines(std::vector<roofline> const& rooflines, std::string const& path = roofline_file)
+{
+    std::ofstream out{ path };
+    for (auto const& r : rooflines)
+        out << r.name << '\t' << r.copy << '\t' << r.scale << '\t' << r.add << '\t' << r.triad << '\t' << r.gflops << '\n';
+}
+
+// Device names often carry trailing NULs and blanks from clGetDeviceInfo
+inline std::string trimmed_name(std::string name)
+{
+    while (!name.empty() && (name.back() == '\0' || name.back() == ' ')) name.pop_back();
+    return name;
+}
+
+inline bool find_roofline(std::string const& name, roofline& out, std::string const& path = roofline_file)
+{
+    auto all = load_rooflines(path);
+    auto it = std::find_if(all.begin(), all.end(), [&](roofline const& r){ return r.name == trimmed_name(name); });
+    if (it == all.end()) return false;
+    out = *it;
+    return true;
+}
+
+// ", 12.3 GB/s, 4.5 GFLOP/s, 81 % of the roofline (memory-bound)", or a
+// hint to run the calibration when the target has no entry
+inline std::string describe_roofline(std::string const& name, double bytes, double flops, double seconds)
+{
+    roofline r;
+    if (!find_roofline(name, r)) return ", no roofline for '" + trimmed_name(name) + "' (run roofline first)";
+    if (seconds <= 0.0) return {};
+
+    const double gbs = bytes / seconds * 1e-9, gflops = flops / seconds * 1e-9;
+    const bool memory_bound = r.attainable_gflops(flops, bytes) < r.gflops;
+    const double percent = memory_bound ? 100.0 * gbs / r.bandwidth() : 100.0 * gflops / r.gflops;
+
+    char text[192];
+    std::snprintf(text, sizeof(text), ", %.2f GB/s, %.2f GFLOP/s, %.0f %% of the roofline (%s-bound)",
+                  gbs, gflops, percent, memory_bound ? "memory" : "compute");
+    return text;
+}
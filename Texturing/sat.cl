@@ -0,0 +1,123 @@
+// Summed-area tables over RGBA8 buffers and the filters they make O(1):
+// table(x, y) holds the sum over [0, x] x [0, y], so the sum over any
+// window is four lookups whatever its size. The sums are 64-bit integers,
+// exact for any image that fits in memory, and kept as ulong4 per pixel:
+// the four channels, or the integer luma and its square.
+//
+// The table is built in two passes: 'sat_rows' scans each row in a
+// work-group through local memory, 'sat_cols' then runs down each column
+// in place; both read and write memory in coalesced rows.
+//
+// Windows are cut at the image border and averaged over the pixels they
+// keep, rather than clamped to the edge like the other filters.
+
+#ifndef SAT_GROUP
+#define SAT_GROUP 256
+#endif
+
+// Integer luma, identical on the host
+uint sat_luma(uchar4 p)
+{
+    return (77 * p.x + 150 * p.y + 29 * p.z + 128) >> 8;
+}
+
+ulong4 sat_value(uchar4 p, int luma)
+{
+    if(!luma) return convert_ulong4(p);
+    const ulong l = sat_luma(p);
+    return (ulong4)(l, l * l, 0, 0);
+}
+
+// One work-group per row, walking it in chunks of SAT_GROUP pixels: an
+// inclusive scan of the chunk in local memory plus the carry of the ones
+// before. 'luma' selects the values summed, see sat_value.
+kernel __attribute__((reqd_work_group_size(SAT_GROUP, 1, 1)))
+void sat_rows(global const uchar4* src, global ulong4* sat, int w, int h, int luma)
+{
+    local ulong4 scan[SAT_GROUP];
+
+    const int lid = get_local_id(0);
+    const int y = get_group_id(1);
+    ulong4 carry = (ulong4)(0);
+
+    for(int x0 = 0; x0 < w; x0 += SAT_GROUP)
+    {
+        const int x = x0 + lid;
+        scan[lid] = x < w ? sat_value(src[y * w + x], luma) : (ulong4)(0);
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for(int offset = 1; offset < SAT_GROUP; offset <<= 1)
+        {
+            const ulong4 left = lid >= offset ? scan[lid - offset] : (ulong4)(0);
+            barrier(CLK_LOCAL_MEM_FENCE);
+            scan[lid] += left;
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+
+        if(x < w) sat[y * w + x] = carry + scan[lid];
+        carry += scan[SAT_GROUP - 1];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+// One work-item per column, adjacent items on adjacent columns
+kernel void sat_cols(global ulong4* sat, int w, int h)
+{
+    const int x = get_global_id(0);
+    if(x >= w) return;
+
+    ulong4 acc = (ulong4)(0);
+    for(int y = 0; y < h; ++y)
+    {
+        acc += sat[y * w + x];
+        sat[y * w + x] = acc;
+    }
+}
+
+// Sum over the window [x0, x1] x [y0, y1], inside the image
+ulong4 sat_window(global const ulong4* sat, int w, int x0, int y0, int x1, int y1)
+{
+    ulong4 s = sat[y1 * w + x1];
+    if(x0 > 0)           s -= sat[y1 * w + x0 - 1];
+    if(y0 > 0)           s -= sat[(y0 - 1) * w + x1];
+    if(x0 > 0 && y0 > 0) s += sat[(y0 - 1) * w + x0 - 1];
+    return s;
+}
+
+// Window of 'radius' around (x, y) cut at the border, and its pixel count
+#define SAT_WINDOW(sat, radius)                                                 \
+    const int x = get_global_id(0);                                             \
+    const int y = get_global_id(1);                                             \
+    if(x >= w || y >= h) return;                                                \
+    const int x0 = max(x - radius, 0), x1 = min(x + radius, w - 1);             \
+    const int y0 = max(y - radius, 0), y1 = min(y + radius, h - 1);             \
+    const ulong n = (ulong)(x1 - x0 + 1) * (ulong)(y1 - y0 + 1);                \
+    const ulong4 s = sat_window(sat, w, x0, y0, x1, y1)
+
+// Mean of every channel over the window, rounded to nearest; the table
+// holds the channels
+kernel void sat_box_blur(global const ulong4* sat, global uchar4* dst, int w, int h, int radius)
+{
+    SAT_WINDOW(sat, radius);
+    dst[y * w + x] = convert_uchar4((s + n / 2) / n);
+}
+
+// Mean and variance of the luma over the window; the table holds the
+// luma and its square. The variance is n sum(l^2) - sum(l)^2 over n^2,
+// with an exact integer numerator.
+kernel void sat_mean_variance(global const ulong4* sat, global float2* stats, int w, int h, int radius)
+{
+    SAT_WINDOW(sat, radius);
+    stats[y * w + x] = (float2)((float)s.x / (float)n, (float)(n * s.y - s.x * s.x) / (float)(n * n));
+}
+
+// White where the luma exceeds the local mean minus 'offset', black
+// elsewhere, compared in integers; the table holds the luma
+kernel void sat_threshold(global const ulong4* sat, global const uchar4* src, global uchar4* dst,
+                          int w, int h, int radius, int offset)
+{
+    SAT_WINDOW(sat, radius);
+    const long l = sat_luma(src[y * w + x]);
+    const uchar v = l * (long)n > (long)s.x - (long)offset * (long)n ? 255 : 0;
+    dst[y * w + x] = (uchar4)(v, v, v, 255);
+}
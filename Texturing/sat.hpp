@@ -0,0 +1,223 @@
+#pragma once
+
+#ifdef __APPLE__ //Mac OSX has a different name for the header file
+#include <OpenCL/opencl.h>
+#else
+#include <CL/opencl.h>
+#endif
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "kernel_args.hpp"
+#include "separable.hpp"
+
+// Summed-area tables of RGBA8 images and the constant-time window filters
+// on top of them: box blur, local mean and variance, adaptive threshold.
+// The device side is sat.cl; the host functions below build and read the
+// same tables (four uint64 per pixel) and give identical integer results.
+
+// What a table sums: the four channels, or the integer luma and its
+// square (in the first two of the four slots)
+enum class sat_values { rgba, luma };
+
+namespace sat_detail
+{
+    inline uint64_t luma(unsigned char const* p)
+    {
+        return (77u * p[0] + 150u * p[1] + 29u * p[2] + 128u) >> 8;
+    }
+
+    // Sums over [x0, x1] x [y0, y1] into 'out'
+    inline void window(uint64_t const* sat, int w, int x0, int y0, int x1, int y1, uint64_t* out)
+    {
+        for(int c = 0; c < 4; ++c)
+        {
+            uint64_t s = sat[(size_t(y1) * w + x1) * 4 + c];
+            if(x0 > 0)           s -= sat[(size_t(y1) * w + x0 - 1) * 4 + c];
+            if(y0 > 0)           s -= sat[(size_t(y0 - 1) * w + x1) * 4 + c];
+            if(x0 > 0 && y0 > 0) s += sat[(size_t(y0 - 1) * w + x0 - 1) * 4 + c];
+            out[c] = s;
+        }
+    }
+
+    // body(x, y, n, sums) for every pixel, the window of 'radius' cut at
+    // the border like in sat.cl
+    template<typename F>
+    void each_window(uint64_t const* sat, int w, int h, int radius, F body)
+    {
+        separable_detail::parallel_rows(h, [&](int ya, int yb)
+        {
+            uint64_t s[4];
+            for(int y = ya; y < yb; ++y)
+                for(int x = 0; x < w; ++x)
+                {
+                    const int x0 = std::max(x - radius, 0), x1 = std::min(x + radius, w - 1);
+                    const int y0 = std::max(y - radius, 0), y1 = std::min(y + radius, h - 1);
+                    window(sat, w, x0, y0, x1, y1, s);
+                    body(x, y, uint64_t(x1 - x0 + 1) * uint64_t(y1 - y0 + 1), s);
+                }
+        });
+    }
+}
+
+// Rows are scanned on all threads, then columns, each thread running down
+// its own range of columns so every row it touches is one contiguous run.
+// 'sat' holds w * h * 4 values.
+inline void build_sat_cpu(unsigned char const* src, uint64_t* sat, int w, int h, sat_values values)
+{
+    using separable_detail::parallel_rows;
+    parallel_rows(h, [&](int y0, int y1)
+    {
+        for(int y = y0; y < y1; ++y)
+        {
+            uint64_t acc[4] = {};
+            for(int x = 0; x < w; ++x)
+            {
+                unsigned char const* p = src + (size_t(y) * w + x) * 4;
+                uint64_t* t = sat + (size_t(y) * w + x) * 4;
+                if(values == sat_values::rgba)
+                    for(int c = 0; c < 4; ++c) acc[c] += p[c];
+                else
+                {
+                    const uint64_t l = sat_detail::luma(p);
+                    acc[0] += l;
+                    acc[1] += l * l;
+                }
+                std::copy(acc, acc + 4, t);
+            }
+        }
+    });
+    parallel_rows(w, [&](int x0, int x1)            // column ranges
+    {
+        for(int y = 1; y < h; ++y)
+        {
+            uint64_t* t = sat + size_t(y) * w * 4;
+            uint64_t const* above = t - size_t(w) * 4;
+            for(size_t i = size_t(x0) * 4; i < size_t(x1) * 4; ++i) t[i] += above[i];
+        }
+    });
+}
+
+// From an RGBA table
+inline void box_blur_cpu(uint64_t const* sat, unsigned char* dst, int w, int h, int radius)
+{
+    sat_detail::each_window(sat, w, h, radius, [&](int x, int y, uint64_t n, uint64_t const* s)
+    {
+        for(int c = 0; c < 4; ++c) dst[(size_t(y) * w + x) * 4 + c] = (unsigned char)((s[c] + n / 2) / n);
+    });
+}
+
+// From a luma table, mean and variance interleaved in 'stats'
+inline void mean_variance_cpu(uint64_t const* sat, float* stats, int w, int h, int radius)
+{
+    sat_detail::each_window(sat, w, h, radius, [&](int x, int y, uint64_t n, uint64_t const* s)
+    {
+        stats[(size_t(y) * w + x) * 2]     = (float)s[0] / (float)n;
+        stats[(size_t(y) * w + x) * 2 + 1] = (float)(n * s[1] - s[0] * s[0]) / (float)(n * n);
+    });
+}
+
+// From a luma table of 'src'
+inline void adaptive_threshold_cpu(uint64_t const* sat, unsigned char const* src, unsigned char* dst, int w, int h, int radius, int offset)
+{
+    sat_detail::each_window(sat, w, h, radius, [&](int x, int y, uint64_t n, uint64_t const* s)
+    {
+        const size_t i = (size_t(y) * w + x) * 4;
+        const int64_t l = (int64_t)sat_detail::luma(src + i);
+        const unsigned char v = l * (int64_t)n > (int64_t)s[0] - (int64_t)offset * (int64_t)n ? 255 : 0;
+        dst[i] = dst[i + 1] = dst[i + 2] = v;
+        dst[i + 3] = 255;
+    });
+}
+
+// The kernels of sat.cl from a built program. Tables are buffers of
+// w * h * 4 * sizeof(cl_ulong) bytes. Calls only enqueue; kernel events
+// are appended to 'events' if given, the caller releases them.
+class sat_engine
+{
+public:
+    sat_engine(cl_program program, cl_int* status)
+    {
+        char const* names[5] = { "sat_rows", "sat_cols", "sat_box_blur", "sat_mean_variance", "sat_threshold" };
+        for(int k = 0; k < 5; ++k)
+        {
+            kernels_[k] = clCreateKernel(program, names[k], status);
+            if(*status != CL_SUCCESS) return;
+        }
+        // The row scan's work-group size, as compiled (SAT_GROUP)
+        size_t group[3] = {};
+        *status = clGetKernelWorkGroupInfo(kernels_[rows], nullptr, CL_KERNEL_COMPILE_WORK_GROUP_SIZE, sizeof(group), group, nullptr);
+        group_ = group[0];
+    }
+
+    ~sat_engine()
+    {
+        for(auto kernel : kernels_)
+            if(kernel) clReleaseKernel(kernel);
+    }
+
+    sat_engine(sat_engine const&) = delete;
+    sat_engine& operator=(sat_engine const&) = delete;
+
+    static size_t table_bytes(int w, int h) { return size_t(w) * h * 4 * sizeof(cl_ulong); }
+
+    cl_int build(cl_command_queue queue, cl_mem src, cl_mem table, int w, int h, sat_values values,
+                 std::vector<cl_event>* events = nullptr)
+    {
+        const cl_int luma = values == sat_values::luma;
+        cl_int status = set_args(kernels_[rows], src, table, w, h, luma);
+        if(status != CL_SUCCESS) return status;
+        const size_t row_global[2] = { group_, (size_t)h }, row_local[2] = { group_, 1 };
+        status = enqueue(queue, kernels_[rows], row_global, row_local, events);
+        if(status != CL_SUCCESS) return status;
+
+        status = set_args(kernels_[cols], table, w, h);
+        if(status != CL_SUCCESS) return status;
+        const size_t col_global[2] = { (size_t)w, 1 };
+        return enqueue(queue, kernels_[cols], col_global, nullptr, events);
+    }
+
+    // From an RGBA table
+    cl_int box_blur(cl_command_queue queue, cl_mem table, cl_mem dst, int w, int h, int radius,
+                    std::vector<cl_event>* events = nullptr)
+    {
+        cl_int status = set_args(kernels_[box], table, dst, w, h, radius);
+        return status != CL_SUCCESS ? status : enqueue(queue, kernels_[box], dims(w, h).data(), nullptr, events);
+    }
+
+    // From a luma table into float2 'stats'
+    cl_int mean_variance(cl_command_queue queue, cl_mem table, cl_mem stats, int w, int h, int radius,
+                         std::vector<cl_event>* events = nullptr)
+    {
+        cl_int status = set_args(kernels_[moments], table, stats, w, h, radius);
+        return status != CL_SUCCESS ? status : enqueue(queue, kernels_[moments], dims(w, h).data(), nullptr, events);
+    }
+
+    // From a luma table of 'src'
+    cl_int threshold(cl_command_queue queue, cl_mem table, cl_mem src, cl_mem dst, int w, int h, int radius, int offset,
+                     std::vector<cl_event>* events = nullptr)
+    {
+        cl_int status = set_args(kernels_[binarize], table, src, dst, w, h, radius, offset);
+        return status != CL_SUCCESS ? status : enqueue(queue, kernels_[binarize], dims(w, h).data(), nullptr, events);
+    }
+
+private:
+    enum { rows, cols, box, moments, binarize };
+
+    static std::array<size_t, 2> dims(int w, int h) { return { (size_t)w, (size_t)h }; }
+
+    static cl_int enqueue(cl_command_queue queue, cl_kernel kernel, size_t const* global, size_t const* local,
+                          std::vector<cl_event>* events)
+    {
+        cl_event event;
+        cl_int status = clEnqueueNDRangeKernel(queue, kernel, 2, nullptr, global, local, 0, nullptr, events ? &event : nullptr);
+        if(status == CL_SUCCESS && events) events->push_back(event);
+        return status;
+    }
+
+    cl_kernel kernels_[5] = {};
+    size_t group_ = 0;
+};
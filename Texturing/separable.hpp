@@ -0,0 +1,184 @@
+#pragma once
+
+#include <vector>
+#include <future>
+#include <thread>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+// Separable filters on interleaved RGBA8 images, on the host. Same two
+// passes and edge clamping as separable.cl: a horizontal pass into a float
+// intermediate (4 floats per pixel), then a vertical pass back to RGBA8.
+// Both passes are 1D FIRs over contiguous floats (stride 4 across a row,
+// one row pitch down a column), computed 8 lanes at a time with vector
+// extensions and split into row bands over the hardware threads.
+
+// Normalized taps of length 2 * radius + 1
+inline std::vector<float> box_taps(int radius)
+{
+    return std::vector<float>(2 * radius + 1, 1.0f / (2 * radius + 1));
+}
+
+inline std::vector<float> gaussian_taps(int radius, float sigma = 0.0f)
+{
+    if(sigma <= 0.0f) sigma = std::max(0.5f, radius / 2.0f);
+    std::vector<float> taps(2 * radius + 1);
+    float sum = 0.0f;
+    for(int k = -radius; k <= radius; ++k) sum += taps[k + radius] = std::exp(-0.5f * k * k / (sigma * sigma));
+    for(auto& t : taps) t /= sum;
+    return taps;
+}
+
+namespace separable_detail
+{
+#if defined(__GNUC__)
+    typedef float float8 __attribute__((vector_size(32)));
+    constexpr int lanes = 8;
+
+    // Through memory, so 32 byte vectors never cross a call boundary by value
+    inline void load(float8& v, float const* p) { std::memcpy(&v, p, sizeof(v)); }
+    inline void store(float* p, float8 const& v) { std::memcpy(p, &v, sizeof(v)); }
+#else
+    constexpr int lanes = 1;
+#endif
+
+    // out[i] = sum_k taps[k] * rows[k][i] for i < n
+    inline void fir(float const* const* rows, float const* taps, int count, float* out, size_t n)
+    {
+        size_t i = 0;
+#if defined(__GNUC__)
+        for(; i + lanes <= n; i += lanes)
+        {
+            float8 acc, v;
+            load(acc, rows[0] + i);
+            acc *= taps[0];
+            for(int k = 1; k < count; ++k)
+            {
+                load(v, rows[k] + i);
+                acc += taps[k] * v;
+            }
+            store(out + i, acc);
+        }
+#endif
+        for(; i < n; ++i)
+        {
+            float acc = taps[0] * rows[0][i];
+            for(int k = 1; k < count; ++k) acc += taps[k] * rows[k][i];
+            out[i] = acc;
+        }
+    }
+
+    // Row y as floats in [0, 1] with 'radius' clamped pixels on both sides
+    inline void padded_row(unsigned char const* src, int w, int y, int radius, float* out)
+    {
+        unsigned char const* row = src + size_t(y) * w * 4;
+        for(int x = -radius; x < w + radius; ++x)
+        {
+            unsigned char const* p = row + 4 * std::min(std::max(x, 0), w - 1);
+            for(int c = 0; c < 4; ++c) out[4 * (x + radius) + c] = p[c] * (1.0f / 255.0f);
+        }
+    }
+
+    inline unsigned char to_rgba8(float v)
+    {
+        return (unsigned char)std::nearbyint(std::min(std::max(v, 0.0f), 1.0f) * 255.0f);
+    }
+
+    // Runs body(y0, y1) on bands of rows, one per hardware thread
+    template<typename F>
+    void parallel_rows(int h, F body)
+    {
+        int n = std::max(1, std::min(h, (int)std::thread::hardware_concurrency()));
+        std::vector<std::future<void>> futures(n);
+        for(int k = 0; k < n; ++k) futures[k] = std::async(std::launch::async, body, k * h / n, (k + 1) * h / n);
+        for(auto& f : futures) f.get();
+    }
+
+    // Clamped row pointers of rows y - radius .. y + radius of a float plane
+    inline void column(float const* plane, int w, int h, int y, int radius, std::vector<float const*>& rows)
+    {
+        rows.resize(2 * radius + 1);
+        for(int k = -radius; k <= radius; ++k)
+            rows[k + radius] = plane + size_t(std::min(std::max(y + k, 0), h - 1)) * w * 4;
+    }
+}
+
+// dst = col_taps (vertical) * row_taps (horizontal) * src, saturated
+inline void separable_filter_cpu(unsigned char const* src, unsigned char* dst, int w, int h,
+                                 std::vector<float> const& row_taps, std::vector<float> const& col_taps)
+{
+    using namespace separable_detail;
+    const int rr = (int)row_taps.size() / 2, cr = (int)col_taps.size() / 2;
+    std::vector<float> tmp(size_t(w) * h * 4);
+
+    parallel_rows(h, [&](int y0, int y1)
+    {
+        std::vector<float> pad((w + 2 * rr) * 4);
+        std::vector<float const*> taps_in(row_taps.size());
+        for(int y = y0; y < y1; ++y)
+        {
+            padded_row(src, w, y, rr, pad.data());
+            for(int k = 0; k <= 2 * rr; ++k) taps_in[k] = pad.data() + 4 * k;
+            fir(taps_in.data(), row_taps.data(), 2 * rr + 1, tmp.data() + size_t(y) * w * 4, size_t(w) * 4);
+        }
+    });
+
+    parallel_rows(h, [&](int y0, int y1)
+    {
+        std::vector<float> out(size_t(w) * 4);
+        std::vector<float const*> rows;
+        for(int y = y0; y < y1; ++y)
+        {
+            column(tmp.data(), w, h, y, cr, rows);
+            fir(rows.data(), col_taps.data(), 2 * cr + 1, out.data(), out.size());
+            unsigned char* d = dst + size_t(y) * w * 4;
+            for(size_t i = 0; i < out.size(); ++i) d[i] = to_rgba8(out[i]);
+        }
+    });
+}
+
+// Sobel as in sobel.cl (center pixel scaled by the gradient magnitude,
+// opaque), from the [1 0 -1] and [1 2 1] passes
+inline void sobel_separable_cpu(unsigned char const* src, unsigned char* dst, int w, int h)
+{
+    using namespace separable_detail;
+    const float diff_taps[3] = { 1.0f, 0.0f, -1.0f }, smooth_taps[3] = { 1.0f, 2.0f, 1.0f };
+    std::vector<float> diff(size_t(w) * h * 4), smooth(size_t(w) * h * 4);
+
+    parallel_rows(h, [&](int y0, int y1)
+    {
+        std::vector<float> pad((w + 2) * 4);
+        float const* in[3] = { pad.data(), pad.data() + 4, pad.data() + 8 };
+        for(int y = y0; y < y1; ++y)
+        {
+            padded_row(src, w, y, 1, pad.data());
+            fir(in, diff_taps, 3, diff.data() + size_t(y) * w * 4, size_t(w) * 4);
+            fir(in, smooth_taps, 3, smooth.data() + size_t(y) * w * 4, size_t(w) * 4);
+        }
+    });
+
+    parallel_rows(h, [&](int y0, int y1)
+    {
+        std::vector<float> gx(size_t(w) * 4), gy(size_t(w) * 4);
+        std::vector<float const*> rows;
+        for(int y = y0; y < y1; ++y)
+        {
+            column(diff.data(), w, h, y, 1, rows);
+            fir(rows.data(), smooth_taps, 3, gx.data(), gx.size());
+            column(smooth.data(), w, h, y, 1, rows);
+            fir(rows.data(), diff_taps, 3, gy.data(), gy.size());
+
+            unsigned char const* s = src + size_t(y) * w * 4;
+            unsigned char* d = dst + size_t(y) * w * 4;
+            for(int x = 0; x < w; ++x)
+            {
+                float const* a = &gx[4 * x];
+                float const* b = &gy[4 * x];
+                float mag = std::sqrt(a[0]*a[0] + a[1]*a[1] + a[2]*a[2] + a[3]*a[3] + b[0]*b[0] + b[1]*b[1] + b[2]*b[2] + b[3]*b[3]);
+                for(int c = 0; c < 3; ++c) d[4 * x + c] = to_rgba8(s[4 * x + c] * (1.0f / 255.0f) * mag);
+                d[4 * x + 3] = 255;
+            }
+        }
+    });
+}
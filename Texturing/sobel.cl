@@ -30,7 +30,66 @@ __kernel void sobel(read_only image2d_t src, write_only image2d_t dst)
         float4 resy = D[0] + D[2] + 2.0f * (D[1] - D[7]) - D[6] - D[8];
 
         //write_imagef(dst, (int2)(x, y), D[4] * (0.25f + 0.75f * sqrt(dot(resx, resx)+dot(resy, resy))));
-        write_imagef(dst, (int2)(x, y), clamp(D[4] * (sqrt(dot(resx, resx)+dot(resy, resy))), 0.0f, 1.0f));
+        float4 res = clamp(D[4] * (sqrt(dot(resx, resx)+dot(resy, resy))), 0.0f, 1.0f);
+        res.w = 1.0f; //opaque, the output is written as RGBA8
+        write_imagef(dst, (int2)(x, y), res);
     }
 
-}
\ No newline at end of file
+}
+
+#ifndef TILE_W
+#define TILE_W 16
+#endif
+#ifndef TILE_H
+#define TILE_H 16
+#endif
+
+// Buffer variant of 'sobel' for devices without a texture cache, where the
+// nine reads per pixel all go to memory. A work-group loads its tile plus
+// a one pixel halo into local memory once, clamped to the edge like the
+// sampler, and computes every output of the tile from there. The global
+// size is rounded up to whole tiles, so the edge groups are masked.
+__kernel __attribute__((reqd_work_group_size(TILE_W, TILE_H, 1)))
+void sobel_tiled(__global const uchar4* src, __global uchar4* dst, int w, int h)
+{
+    __local float4 tile[TILE_H + 2][TILE_W + 2];
+
+    const int lx = get_local_id(0);
+    const int ly = get_local_id(1);
+    const int x0 = get_group_id(0) * TILE_W - 1;
+    const int y0 = get_group_id(1) * TILE_H - 1;
+
+    for(int ty = ly; ty < TILE_H + 2; ty += TILE_H)
+    {
+        for(int tx = lx; tx < TILE_W + 2; tx += TILE_W)
+        {
+            const int sx = clamp(x0 + tx, 0, w - 1);
+            const int sy = clamp(y0 + ty, 0, h - 1);
+            tile[ty][tx] = convert_float4(src[sy * w + sx]) * (1.0f / 255.0f);
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+    if(x >= w || y >= h) return;
+
+    //pixels:
+    float4 D[9];
+    D[0] = tile[ly + 0][lx + 0];
+    D[1] = tile[ly + 0][lx + 1];
+    D[2] = tile[ly + 0][lx + 2];
+    D[3] = tile[ly + 1][lx + 0];
+    D[4] = tile[ly + 1][lx + 1];
+    D[5] = tile[ly + 1][lx + 2];
+    D[6] = tile[ly + 2][lx + 0];
+    D[7] = tile[ly + 2][lx + 1];
+    D[8] = tile[ly + 2][lx + 2];
+
+    float4 resx = D[0] - D[2] + 2.0f * (D[3] - D[5]) + D[6] - D[8];
+    float4 resy = D[0] + D[2] + 2.0f * (D[1] - D[7]) - D[6] - D[8];
+
+    float4 res = clamp(D[4] * (sqrt(dot(resx, resx)+dot(resy, resy))), 0.0f, 1.0f);
+    res.w = 1.0f;
+    dst[y * w + x] = convert_uchar4_sat_rte(res * 255.0f);
+}
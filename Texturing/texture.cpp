@@ -11,6 +11,10 @@
 #include <algorithm>
 #include <random>
 #include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 
@@ -20,41 +24,303 @@
 #include <CL/opencl.h>
 #endif
 
+#include "mem_pool.hpp"
+#include "kernel_args.hpp"
+#include "aligned_allocator.hpp"
+#include "roofline.hpp"
+#include "trace.hpp"
+#include "perf_counter.hpp"
+#include "separable.hpp"
+#include "convolution.hpp"
+#include "filter_graph.hpp"
+#include "batch.hpp"
+#include "tiles.hpp"
+#include "sobel_cpu.hpp"
+#include "image_io.hpp"
+#include "raw_image.hpp"
+#include "canny.hpp"
+#include "sat.hpp"
+#include "pyramid.hpp"
+
 struct rawcolor { unsigned char r, g, b, a; };
 struct rawcolor3{ unsigned char r, g, b; };
 struct color    { float         r, g, b, a; };
 
-int main()
+// Execution time of a finished command on a profiling queue
+double event_ms(cl_event event, cl_int* status)
+{
+    cl_ulong start = 0, end = 0;
+    *status = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr);
+    if(*status == CL_SUCCESS) *status = clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr);
+    return (end - start) * 1e-6;
+}
+
+// Pixels differing by more than 'tolerance' steps in a color channel or at
+// all in alpha, outside a 'border' of first rows and columns
+template<typename A, typename B>
+size_t count_mismatches(A const& a, B const& b, int w, int h, int border, int tolerance = 1)
+{
+    size_t mismatches = 0;
+    for(int y = border; y < h; ++y)
+    {
+        for(int x = border; x < w; ++x)
+        {
+            auto p = a[y*w + x], q = b[y*w + x];
+            if(std::abs(p.r - q.r) > tolerance || std::abs(p.g - q.g) > tolerance || std::abs(p.b - q.b) > tolerance || p.a != q.a) ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+std::string load_source(std::string const& path)
+{
+    std::ifstream file(path);
+    if(!file.is_open()) throw std::runtime_error{"Could not open kernel file at: " + path};
+    return std::string( std::istreambuf_iterator<char>(file), (std::istreambuf_iterator<char>()));
+}
+
+// Whole decimal number in 'text', false if anything else is there
+bool parse_count(char const* text, size_t* value)
+{
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long long v = std::strtoull(text, &end, 10);
+    if(!std::isdigit((unsigned char)text[0]) || *end != '\0' || errno == ERANGE) return false;
+    *value = (size_t)v;
+    return true;
+}
+
+void print_usage(char const* program)
+{
+    std::cout << "Usage: " << program << " [options] [image_or_directory...]\n"
+                 "  image_or_directory...          run the Sobel filter over these in batch mode\n"
+                 "  -o out_dir                     batch output directory\n"
+                 "  -d depth                       images in flight in batch mode\n"
+                 "  --stream in.pam out.pam        filter an image of any size in tiles\n"
+                 "  --backend cpu|opencl           [--isa scalar|avx2|avx512] for the CPU backend\n"
+                 "  --format png|ppm|pam|pfm|qoi   format of the result\n"
+                 "  --level 0..9                   compression level of the result\n"
+                 "  --input image.png|.qoi|.raw    another input (.raw is mapped)\n"
+                 "  --convert in.png out.raw       write a raw image and compare loading it\n";
+}
+
+int main(int argc, char* argv[])
 {
     static const std::string input_filename   = "../../Texturing/input.png";
 
-    int w = 0;//width
-    int h = 0;//height
-    int ch = 0;//number of components
+    // texturing [-o out_dir] [-d depth] image_or_directory...
+    // runs the Sobel filter over the given images in batch mode instead,
+    // texturing --stream in.pam out.pam over an image of any size in tiles,
+    // texturing --backend cpu [--isa scalar|avx2|avx512] without OpenCL,
+    // --format png|ppm|pam|pfm|qoi and --level 0..9 for the result,
+    // --input image.png|image.qoi|image.raw for another input (.raw is mapped),
+    // texturing --convert in.png out.raw writes a raw image and compares
+    // loading it with decoding the original
+    std::vector<std::string> batch_args;
+    std::string stream_in, stream_out;
+    std::string input_path = input_filename, convert_in, convert_out;
+    std::string backend = "opencl";
+    cpu_isa isa = detect_isa();
+    std::string result_format = "png";
+    encode_options encoding;
+    std::string batch_out = "../../Texturing/batch_out";
+    size_t batch_depth = 4;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if     (arg == "-o" && i + 1 < argc) batch_out = argv[++i];
+        else if(arg == "-d" && i + 1 < argc)
+        {
+            if(!parse_count(argv[++i], &batch_depth) || batch_depth == 0)
+            {
+                std::cout << "Invalid batch depth: " << argv[i] << "\n";
+                print_usage(argv[0]);
+                return -1;
+            }
+        }
+        else if(arg == "--stream" && i + 2 < argc){ stream_in = argv[++i]; stream_out = argv[++i]; }
+        else if(arg == "--backend" && i + 1 < argc) backend = argv[++i];
+        else if(arg == "--isa" && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if(name != "scalar" && name != "avx2" && name != "avx512")
+            {
+                std::cout << "Unknown instruction set: " << name << "\n";
+                print_usage(argv[0]);
+                return -1;
+            }
+            const cpu_isa wanted = name == "avx512" ? cpu_isa::avx512 : name == "avx2" ? cpu_isa::avx2 : cpu_isa::scalar;
+            isa = std::min(wanted, detect_isa());
+            if(isa != wanted) std::cout << isa_name(wanted) << " is not supported by this CPU, using " << isa_name(isa) << "\n";
+        }
+        else if(arg == "--format" && i + 1 < argc) result_format = argv[++i];
+        else if(arg == "--level" && i + 1 < argc)
+        {
+            size_t level = 0;
+            if(!parse_count(argv[++i], &level) || level > 9)
+            {
+                std::cout << "Invalid compression level: " << argv[i] << "\n";
+                print_usage(argv[0]);
+                return -1;
+            }
+            encoding.level = (int)level;
+        }
+        else if(arg == "--input" && i + 1 < argc) input_path = argv[++i];
+        else if(arg == "--convert" && i + 2 < argc){ convert_in = argv[++i]; convert_out = argv[++i]; }
+        else if(arg.size() > 1 && arg[0] == '-')
+        {
+            std::cout << "Unknown option or missing value: " << arg << "\n";
+            print_usage(argv[0]);
+            return -1;
+        }
+        else                                 batch_args.push_back(arg);
+    }
 
-    // Load image:
-    rawcolor* data0 = reinterpret_cast<rawcolor*>(stbi_load(input_filename.c_str(), &w, &h, &ch, 4 /* we expect 4 components */));
-    if(!data0)
+    // Batch and streaming run the device kernels only
+    if(backend == "cpu" && (!batch_args.empty() || !stream_in.empty()))
     {
-        std::cout << "Error: could not open input file: " << input_filename << "\n";
+        std::cout << "Batch mode and --stream need the OpenCL backend\n";
+        print_usage(argv[0]);
         return -1;
     }
-    else
+
+    const std::string result_path = "../../Texturing/result." + result_format;
+    if(format_of(result_path) == image_format::unknown){ std::cout << "Unknown output format: " << result_format << "\n"; return -1; }
+
+    int w = 0;//width
+    int h = 0;//height
+    int ch = 0;//number of components
+
+    tracer& trace = tracer::get();
+    trace.name_thread("main");
+
+    // Converter: decode once, then time both ways of getting the pixels
+    if(!convert_in.empty())
     {
-        std::cout << "Image (" << input_filename << ") opened successfully. Width x Height x Components = " << w << " x " << h << " x " << ch << "\n";
+        auto pixels = stbi_load(convert_in.c_str(), &w, &h, &ch, 4);
+        if(!pixels){ std::cout << "Error: could not open input file: " << convert_in << "\n"; return -1; }
+        bool ok = write_raw_image(convert_out, w, h, raw_format::rgba8, pixels);
+        if(!ok){ std::cout << "Error writing " << convert_out << "\n"; stbi_image_free(pixels); return -1; }
+        std::cout << "Converted " << convert_in << " (" << w << " x " << h << ") to " << convert_out << "\n";
+
+        const int runs = 5;
+        auto best_ms = [&](auto load)
+        {
+            double best = 1e30;
+            for(int run = 0; run < runs; ++run)
+            {
+                auto t0 = std::chrono::high_resolution_clock::now();
+                ok = load() && ok;
+                best = std::min(best, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count());
+            }
+            return best;
+        };
+        double decode_ms = best_ms([&]
+        {
+            int dw, dh, dc;
+            auto decoded = stbi_load(convert_in.c_str(), &dw, &dh, &dc, 4);
+            stbi_image_free(decoded);
+            return decoded != nullptr;
+        });
+        // Lazily mapped pixels cost their page faults on first use, so
+        // the fair comparison populates the whole mapping
+        double map_ms = best_ms([&]{ return mapped_image{convert_out}.valid(); });
+        double populate_ms = best_ms([&]
+        {
+            mapped_image raw{convert_out, true};
+            return raw.valid() && std::memcmp(raw.pixels(), pixels, size_t(w) * h * 4) == 0;
+        });
+        stbi_image_free(pixels);
+        const double mp = w * (double)h * 1e-6;
+        std::cout << "stbi_load: " << decode_ms << " ms (" << decode_ms / mp << " ms/MP), mapping: " << map_ms << " ms, mapping populated: "
+                  << populate_ms << " ms (" << populate_ms / mp << " ms/MP), " << decode_ms / populate_ms << "x faster"
+                  << (ok ? "" : ", PIXELS DIFFER") << "\n";
+        return ok ? 0 : -1;
     }
 
-    std::vector<color> input(w*h);
-    std::vector<color> output(w*h);
-    if(ch == 4)
+    // Load image:
+    auto trace_start = trace.now();
+    rawcolor* data0 = nullptr;
+    std::unique_ptr<mapped_image> input_map;
+    std::vector<unsigned char> input_qoi;
+    if(batch_args.empty() && stream_in.empty())
     {
-        std::transform(data0, data0+w*h, input.begin(), [](rawcolor c){ return color{c.r/255.0f, c.g/255.0f, c.b/255.0f, c.a/255.0f}; } );
+        if(std::filesystem::path(input_path).extension() == ".raw")
+        {
+            // Mapped, not decoded: the filters read the file's pages in place
+            input_map = std::make_unique<mapped_image>(input_path);
+            if(input_map->valid() && input_map->format() == raw_format::rgba8 && input_map->tight())
+            {
+                w = input_map->width();
+                h = input_map->height();
+                ch = 4;
+                data0 = reinterpret_cast<rawcolor*>(input_map->pixels());
+            }
+            trace.complete("map raw", "io", trace_start, trace.now());
+        }
+        else if(format_of(input_path) == image_format::qoi)
+        {
+            input_qoi = read_qoi(input_path, &w, &h);
+            ch = 4;
+            data0 = input_qoi.empty() ? nullptr : reinterpret_cast<rawcolor*>(input_qoi.data());
+            trace.complete("decode qoi", "io", trace_start, trace.now());
+        }
+        else
+        {
+            data0 = reinterpret_cast<rawcolor*>(stbi_load(input_path.c_str(), &w, &h, &ch, 4 /* we expect 4 components */));
+            trace.complete("decode png", "io", trace_start, trace.now());
+        }
+        if(!data0)
+        {
+            std::cout << "Error: could not open input file: " << input_path << "\n";
+            return -1;
+        }
+        else
+        {
+            std::cout << "Image (" << input_path << ") opened successfully. Width x Height x Components = " << w << " x " << h << " x " << ch << "\n";
+        }
     }
-    else if(ch == 3)
+    auto free_input = [&]
     {
-        std::transform(data0, data0+w*h, input.begin(), [](rawcolor c){ return color{c.r/255.0f, c.g/255.0f, c.b/255.0f, 1.0f}; } );
+        if(input_map)              input_map.reset();
+        else if(!input_qoi.empty()) input_qoi = {};
+        else                        stbi_image_free(data0);
+        data0 = nullptr;
+    };
+
+    // The pixels stay RGBA8 on both sides: stbi already expanded 3 component
+    // images with an opaque alpha, the device normalizes in read_imagef and
+    // quantizes in write_imagef, so there is no host conversion pass.
+    // The output is huge page backed once the image reaches 2 MiB.
+    std::vector<rawcolor, huge_page_allocator<rawcolor>> output(w*h);
+
+    // Native backend: no OpenCL platform needed
+    if(backend == "cpu")
+    {
+        const int runs = 5;
+        // Counters of the fastest run (wall time only unless built with PERF_COUNTERS)
+        perf_counters counters;
+        perf_sample best = {};
+        for(int run = 0; run < runs; ++run)
+        {
+            trace_span run_span{"sobel cpu run", "cpu"};
+            counters.start();
+            sobel_cpu(&data0->r, &output.data()->r, w, h, isa);
+            auto sample = counters.stop();
+            if(run == 0 || sample.ms < best.ms) best = sample;
+        }
+        const double cpu_ms = best.ms;
+        std::cout << "Sobel on the CPU (" << isa_name(isa) << ", " << std::thread::hardware_concurrency() << " threads) took: " << cpu_ms << " ms"
+                  << describe(best)
+                  << describe_roofline("host", (double)w * h * 2 * sizeof(rawcolor), (double)w * h * 76, cpu_ms * 1e-3) << "\n";
+        free_input();
+
+        encode_statistics written;
+        if(!write_image(result_path, w, h, &output.data()->r, encoding, &written)){ std::cout << "Error writing output to file\n"; return -1; }
+        std::cout << "Output written to " << result_path << describe_encode(written, w, h) << "\n";
+        return 0;
     }
-    stbi_image_free(data0);
+    if(backend != "opencl"){ std::cout << "Unknown backend: " << backend << ", expected opencl or cpu\n"; return -1; }
 
     // OpenCL init:
 
@@ -94,6 +360,7 @@ int main()
     const auto device      = devices[platformIdx][deviceIdx];
 
     //print names:
+    std::string device_name;
     {
         size_t vendor_name_length = 0;
         status = clGetPlatformInfo(platform, CL_PLATFORM_VENDOR, 0, nullptr, &vendor_name_length);
@@ -107,7 +374,7 @@ int main()
         status = clGetDeviceInfo(device, CL_DEVICE_NAME, 0, nullptr, &device_name_length);
         if(status != CL_SUCCESS){ std::cout << "Cannot get device name length: " << status << "\n"; return -1; }
 
-        std::string device_name(device_name_length, '\0');
+        device_name.assign(device_name_length, '\0');
         status = clGetDeviceInfo(device, CL_DEVICE_NAME, device_name_length, (void*)device_name.data(), nullptr);
         if(status != CL_SUCCESS){ std::cout << "Cannot get device name: " << status << "\n"; return -1; }
 
@@ -127,15 +394,32 @@ int main()
 	auto queue = clCreateCommandQueueWithProperties(context, device, qps.data(), &status);
     if(status != CL_SUCCESS){ std::cout << "Cannot create command queue: " << status << "\n"; return -1; }
 
-	std::ifstream file("./../../Texturing/sobel.cl");
-    if(!file.is_open()) throw std::runtime_error{"Could not open kernel file at: sobel.cl"};
-	std::string source( std::istreambuf_iterator<char>(file), (std::istreambuf_iterator<char>()));
-	size_t      sourceSize = source.size();
-	const char* sourcePtr  = source.c_str();
-	auto program = clCreateProgramWithSource(context, 1, &sourcePtr, &sourceSize, &status);
+    // Maps the profiling timestamps of the queue onto the trace timeline
+    device_clock clock{queue};
+    trace.name_lane(0, "queue");
+
+    std::array<std::string, 5> sources = { load_source("./../../Texturing/sobel.cl"), load_source("./../../Texturing/separable.cl"),
+                                           load_source("./../../Texturing/canny.cl"), load_source("./../../Texturing/sat.cl"),
+                                           load_source("./../../Texturing/pyramid.cl") };
+    std::array<size_t, 5>      sourceSizes = { sources[0].size(), sources[1].size(), sources[2].size(), sources[3].size(), sources[4].size() };
+    std::array<const char*, 5> sourcePtrs  = { sources[0].c_str(), sources[1].c_str(), sources[2].c_str(), sources[3].c_str(), sources[4].c_str() };
+	auto program = clCreateProgramWithSource(context, 5, sourcePtrs.data(), sourceSizes.data(), &status);
     if(status != CL_SUCCESS){ std::cout << "Cannot create program: " << status << "\n"; return -1; }
 
-	status = clBuildProgram(program, 1, &device, "", nullptr, nullptr);
+    // Tile of the local memory Sobel: 16x16 work-items where the device
+    // allows work-groups that large, 8x8 otherwise; the Canny hysteresis
+    // tiles alike and the summed-area row scan follows with 256 or 64
+    // work-items
+    size_t max_group = 0;
+    status = clGetDeviceInfo(device, CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(max_group), &max_group, nullptr);
+    if(status != CL_SUCCESS){ std::cout << "Cannot get max work-group size: " << status << "\n"; return -1; }
+    const size_t tile = max_group >= 256 ? 16 : 8;
+    const std::string options = "-D TILE_W=" + std::to_string(tile) + " -D TILE_H=" + std::to_string(tile)
+                              + " -D CANNY_TILE=" + std::to_string(tile) + " -D SAT_GROUP=" + std::to_string(tile * tile);
+
+    trace_start = trace.now();
+	status = clBuildProgram(program, 1, &device, options.c_str(), nullptr, nullptr);
+    trace.complete("build program", "opencl", trace_start, trace.now());
 	if (status != CL_SUCCESS)
 	{
         std::cout << "Cannot build program: " << status << "\n";
@@ -149,55 +433,863 @@ int main()
 
 	auto kernel = clCreateKernel(program, "sobel", &status);
     if(status != CL_SUCCESS){ std::cout << "Cannot create kernel: " << status << "\n"; return -1; }
+	auto kernel_tiled = clCreateKernel(program, "sobel_tiled", &status);
+    if(status != CL_SUCCESS){ std::cout << "Cannot create tiled kernel: " << status << "\n"; return -1; }
+    auto kernel_sobel_rows = clCreateKernel(program, "sobel_rows", &status);
+    if(status != CL_SUCCESS){ std::cout << "Cannot create kernel sobel_rows: " << status << "\n"; return -1; }
+    auto kernel_sobel_cols = clCreateKernel(program, "sobel_cols", &status);
+    if(status != CL_SUCCESS){ std::cout << "Cannot create kernel sobel_cols: " << status << "\n"; return -1; }
+    auto kernel_rows = clCreateKernel(program, "separable_rows", &status);
+    if(status != CL_SUCCESS){ std::cout << "Cannot create kernel separable_rows: " << status << "\n"; return -1; }
+    auto kernel_cols = clCreateKernel(program, "separable_cols", &status);
+    if(status != CL_SUCCESS){ std::cout << "Cannot create kernel separable_cols: " << status << "\n"; return -1; }
+
+    auto release = [&]
+    {
+        clReleaseKernel(kernel_cols);
+        clReleaseKernel(kernel_rows);
+        clReleaseKernel(kernel_sobel_cols);
+        clReleaseKernel(kernel_sobel_rows);
+        clReleaseKernel(kernel_tiled);
+        clReleaseKernel(kernel);
+        clReleaseProgram(program);
+        clReleaseCommandQueue(queue);
+        clReleaseContext(context);
+        clReleaseDevice(device);
+    };
+
+    // Streamed through the tiled Sobel strip by strip, so neither the
+    // host nor the device ever holds the whole image
+    if(!stream_in.empty())
+    {
+        pam_reader reader{stream_in};
+        if(!reader.valid()){ std::cout << "Cannot read " << stream_in << ": expected an 8 bit PAM or PPM\n"; return -1; }
+        pam_writer writer{stream_out, reader.width(), reader.height()};
+        if(!writer.valid()){ std::cout << "Cannot write " << stream_out << "\n"; return -1; }
+
+        {
+            tile_executor tiles{context, device, kernel_tiled, 1, tile, &status};
+            if(status != CL_SUCCESS){ std::cout << "Cannot create tile queues: " << status << "\n"; return -1; }
+
+            tile_executor::statistics stats;
+            status = tiles.run(reader.width(), reader.height(),
+                               [&](int y0, int rows, unsigned char* dst){ return reader.read(y0, rows, dst); },
+                               [&](int, int rows, unsigned char const* src){ return writer.write(rows, src); }, &stats);
+            if(status != CL_SUCCESS){ std::cout << "Tiled run failed: " << status << "\n"; return -1; }
+
+            const double pixels = (double)reader.width() * reader.height();
+            std::cout << "Streamed " << reader.width() << " x " << reader.height() << " in " << stats.tiles << " tiles of "
+                      << tiles.tile_width() << " x " << tiles.tile_height() << " (" << stats.strips << " strips): " << stats.seconds << " s, "
+                      << pixels / stats.seconds * 1e-6 << " Mpixel/s, " << stats.host_bytes / 1048576.0 << " MiB host, "
+                      << stats.device_bytes / 1048576.0 << " MiB device\n";
+        }
+        release();
+        return 0;
+    }
+
+    if(!batch_args.empty())
+    {
+        auto files = batch_files(batch_args);
+        std::error_code error;
+        std::filesystem::create_directories(batch_out, error);
+        if(error){ std::cout << "Cannot create output directory " << batch_out << ": " << error.message() << "\n"; return -1; }
+
+        mem_pool pool{context};
+        {
+            batch_pipeline batch{context, device, kernel_tiled, tile, pool, &status};
+            if(status != CL_SUCCESS){ std::cout << "Cannot create batch queues: " << status << "\n"; return -1; }
+
+            auto sequential = batch.run_sequential(files, batch_out, &status);
+            if(status != CL_SUCCESS){ std::cout << "Sequential batch failed: " << status << "\n"; return -1; }
+            auto pipelined = batch.run(files, batch_out, batch_depth, &status);
+            if(status != CL_SUCCESS){ std::cout << "Pipelined batch failed: " << status << "\n"; return -1; }
+
+            std::cout << "Batch of " << files.size() << " files (" << pipelined.failed << " failed) into " << batch_out << "\n";
+            std::cout << "Sequential: " << sequential.images_per_second() << " images/s, "
+                      << sequential.pixels / sequential.seconds * 1e-6 << " Mpixel/s\n";
+            std::cout << "Pipelined (depth " << batch_depth << "): " << pipelined.images_per_second() << " images/s, "
+                      << pipelined.pixels / pipelined.seconds * 1e-6 << " Mpixel/s, "
+                      << pipelined.images_per_second() / sequential.images_per_second() << "x the sequential run\n";
+        }
+        pool.trim();
+        release();
+        return 0;
+    }
 	
-    cl_image_format format = { CL_RGBA, CL_FLOAT };
-	cl_image_desc desc = {};
-	desc.image_type = CL_MEM_OBJECT_IMAGE2D;
-	desc.image_width =  w; //x
-	desc.image_height = h; //y
-	desc.image_depth =  0;
-	
-	cl_mem img_src = clCreateImage(context, CL_MEM_READ_ONLY  | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS, &format, &desc, input.data(), &status);
-    if(status != CL_SUCCESS){ std::cout << "Cannot create source image object: " << status << "\n"; return -1; }
-    cl_mem img_dst = clCreateImage(context, CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR,                          &format, &desc, input.data(), &status);
-	if(status != CL_SUCCESS){ std::cout << "Cannot create destination image object: " << status << "\n"; return -1; }
-
-	status = clSetKernelArg(kernel, 0, sizeof(img_src), &img_src);
-    if(status != CL_SUCCESS){ std::cout << "Cannot set kernel argument 0: " << status << "\n"; return -1; }
-	status = clSetKernelArg(kernel, 1, sizeof(img_dst), &img_dst);
-    if(status != CL_SUCCESS){ std::cout << "Cannot set kernel argument 1: " << status << "\n"; return -1; }
-
-    size_t kernel_dims[2] = {(size_t)w, (size_t)h};
-	status = clEnqueueNDRangeKernel(queue, kernel, 2, nullptr, kernel_dims, nullptr, 0, nullptr, nullptr);
-    if(status != CL_SUCCESS){ std::cout << "Cannot enqueue kernel: " << status << "\n"; return -1; }
-    
-    size_t origin[3] = {0, 0, 0};
-    size_t dims[3] = {(size_t)w, (size_t)h, 1};
-	status = clEnqueueReadImage(queue, img_dst, false, origin, dims, 0, 0, output.data(), 0, nullptr, nullptr);
-	if(status != CL_SUCCESS){ std::cout << "Cannot read back image: " << status << "\n"; return -1; }
-
-    status = clFinish(queue);
-    if(status != CL_SUCCESS){ std::cout << "Cannot finish: " << status << "\n"; return -1; }
-    {
-        std::vector<rawcolor> tmp(w*h*4);
-        std::transform(output.cbegin(), output.cend(), tmp.begin(),
-                [](color c){ return rawcolor{   (unsigned char)(c.r*255.0f),
-                                                (unsigned char)(c.g*255.0f),
-                                                (unsigned char)(c.b*255.0f),
-                                                (unsigned char)(1.0f*255.0f) }; } );
-
-            int res = stbi_write_png("../../Texturing/result.png", w, h, 4, tmp.data(), w*4);
-            if(res == 0){ std::cout << "Error writing output to file\n"; }
-            else        { std::cout << "Output written to file\n"; }
-    }
-
-    clReleaseMemObject(img_src);
-    clReleaseMemObject(img_dst);
-    clReleaseKernel(kernel);
-    clReleaseProgram(program);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
-    clReleaseDevice(device);
+    cl_image_format format = { CL_RGBA, CL_UNORM_INT8 };
+
+    // Images come from a pool, so repeated runs reuse the objects released
+    // by the previous run instead of creating new ones
+    mem_pool pool{context};
+    const int runs = 5;
+    std::vector<double> run_ms;
+    double kernel_ms = 1e30;
+
+    // A mapped input backs the source image itself: no upload, and no copy
+    // at all on devices sharing host memory
+    cl_mem mapped_src = nullptr;
+    if(input_map)
+    {
+        mapped_src = input_map->image(context, CL_MEM_READ_ONLY | CL_MEM_HOST_NO_ACCESS, &status);
+        if(status != CL_SUCCESS){ std::cout << "Cannot create source image over the mapped input: " << status << "\n"; return -1; }
+    }
+
+    for(int run = 0; run < runs; ++run)
+    {
+        trace_span run_span{"sobel run", "opencl"};
+        auto t0 = std::chrono::high_resolution_clock::now();
+
+        mem_pool::handle img_src;
+        if(!mapped_src)
+        {
+            img_src = pool.image2d(CL_MEM_READ_ONLY  | CL_MEM_HOST_WRITE_ONLY, format, w, h, &status);
+            if(status != CL_SUCCESS){ std::cout << "Cannot create source image object: " << status << "\n"; return -1; }
+        }
+        auto img_dst = pool.image2d(CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY,  format, w, h, &status);
+        if(status != CL_SUCCESS){ std::cout << "Cannot create destination image object: " << status << "\n"; return -1; }
+
+        size_t origin[3] = {0, 0, 0};
+        size_t dims[3] = {(size_t)w, (size_t)h, 1};
+        if(!mapped_src)
+        {
+            cl_event write_event;
+            status = clEnqueueWriteImage(queue, img_src.get(), false, origin, dims, 0, 0, data0, 0, nullptr, &write_event);
+            if(status != CL_SUCCESS){ std::cout << "Cannot write source image: " << status << "\n"; return -1; }
+            trace_device(clock, write_event, "write image", 0, "copy");
+            clReleaseEvent(write_event);
+        }
+
+        cl_mem src = mapped_src ? mapped_src : img_src.get(), dst = img_dst.get();
+        status = clSetKernelArg(kernel, 0, sizeof(src), &src);
+        if(status != CL_SUCCESS){ std::cout << "Cannot set kernel argument 0: " << status << "\n"; return -1; }
+        status = clSetKernelArg(kernel, 1, sizeof(dst), &dst);
+        if(status != CL_SUCCESS){ std::cout << "Cannot set kernel argument 1: " << status << "\n"; return -1; }
+
+        size_t kernel_dims[2] = {(size_t)w, (size_t)h};
+        cl_event kernel_event;
+        status = clEnqueueNDRangeKernel(queue, kernel, 2, nullptr, kernel_dims, nullptr, 0, nullptr, &kernel_event);
+        if(status != CL_SUCCESS){ std::cout << "Cannot enqueue kernel: " << status << "\n"; return -1; }
+        trace_device(clock, kernel_event, "sobel");
+
+        cl_event read_event;
+        status = clEnqueueReadImage(queue, img_dst.get(), false, origin, dims, 0, 0, output.data(), 0, nullptr, &read_event);
+        if(status != CL_SUCCESS){ std::cout << "Cannot read back image: " << status << "\n"; return -1; }
+        trace_device(clock, read_event, "read image", 0, "copy");
+        clReleaseEvent(read_event);
+
+        status = clFinish(queue);
+        if(status != CL_SUCCESS){ std::cout << "Cannot finish: " << status << "\n"; return -1; }
+
+        auto t1 = std::chrono::high_resolution_clock::now();
+        run_ms.push_back(std::chrono::duration<double, std::milli>(t1 - t0).count());
+
+        kernel_ms = std::min(kernel_ms, event_ms(kernel_event, &status));
+        if(status != CL_SUCCESS){ std::cout << "Cannot get kernel time: " << status << "\n"; return -1; }
+        clReleaseEvent(kernel_event);
+    }
+    if(mapped_src) clReleaseMemObject(mapped_src);
+
+    // Same filter from plain buffers through the local memory tiles, with
+    // an explicit work-group size and the global size rounded up to tiles
+    std::vector<rawcolor, huge_page_allocator<rawcolor>> output_tiled(w*h);
+    double tiled_ms = 1e30;
+
+    for(int run = 0; run < runs; ++run)
+    {
+        trace_span run_span{"sobel tiled run", "opencl"};
+
+        const size_t bytes = sizeof(rawcolor) * w * h;
+        auto buf_src = pool.buffer(CL_MEM_READ_ONLY  | CL_MEM_HOST_WRITE_ONLY, bytes, &status);
+        if(status != CL_SUCCESS){ std::cout << "Cannot create source buffer: " << status << "\n"; return -1; }
+        auto buf_dst = pool.buffer(CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY,  bytes, &status);
+        if(status != CL_SUCCESS){ std::cout << "Cannot create destination buffer: " << status << "\n"; return -1; }
+
+        status = clEnqueueWriteBuffer(queue, buf_src.get(), false, 0, bytes, data0, 0, nullptr, nullptr);
+        if(status != CL_SUCCESS){ std::cout << "Cannot write source buffer: " << status << "\n"; return -1; }
+
+        cl_mem src = buf_src.get(), dst = buf_dst.get();
+        status = clSetKernelArg(kernel_tiled, 0, sizeof(src), &src);
+        if(status != CL_SUCCESS){ std::cout << "Cannot set tiled kernel argument 0: " << status << "\n"; return -1; }
+        status = clSetKernelArg(kernel_tiled, 1, sizeof(dst), &dst);
+        if(status != CL_SUCCESS){ std::cout << "Cannot set tiled kernel argument 1: " << status << "\n"; return -1; }
+        status = clSetKernelArg(kernel_tiled, 2, sizeof(w), &w);
+        if(status != CL_SUCCESS){ std::cout << "Cannot set tiled kernel argument 2: " << status << "\n"; return -1; }
+        status = clSetKernelArg(kernel_tiled, 3, sizeof(h), &h);
+        if(status != CL_SUCCESS){ std::cout << "Cannot set tiled kernel argument 3: " << status << "\n"; return -1; }
+
+        size_t local_dims[2] = {tile, tile};
+        size_t global_dims[2] = {(w + tile - 1) / tile * tile, (h + tile - 1) / tile * tile};
+        cl_event kernel_event;
+        status = clEnqueueNDRangeKernel(queue, kernel_tiled, 2, nullptr, global_dims, local_dims, 0, nullptr, &kernel_event);
+        if(status != CL_SUCCESS){ std::cout << "Cannot enqueue tiled kernel: " << status << "\n"; return -1; }
+        trace_device(clock, kernel_event, "sobel_tiled");
+
+        status = clEnqueueReadBuffer(queue, buf_dst.get(), false, 0, bytes, output_tiled.data(), 0, nullptr, nullptr);
+        if(status != CL_SUCCESS){ std::cout << "Cannot read back buffer: " << status << "\n"; return -1; }
+
+        status = clFinish(queue);
+        if(status != CL_SUCCESS){ std::cout << "Cannot finish: " << status << "\n"; return -1; }
+
+        tiled_ms = std::min(tiled_ms, event_ms(kernel_event, &status));
+        if(status != CL_SUCCESS){ std::cout << "Cannot get tiled kernel time: " << status << "\n"; return -1; }
+        clReleaseEvent(kernel_event);
+    }
+
+    // The image kernel leaves the first row and column untouched; elsewhere
+    // both round the same float result, allow one step for the normalization
+    {
+        size_t mismatches = count_mismatches(output, output_tiled, w, h, 1);
+        if(mismatches == 0) std::cout << "Tiled Sobel matches the image version.\n";
+        else                std::cout << "Tiled Sobel differs from the image version in " << mismatches << " pixels.\n";
+    }
+
+    // The same kernel through the tile executor, with tiles small enough
+    // to exercise the halos and the stitching: the result must be identical
+    {
+        tile_executor tiles{context, device, kernel_tiled, 1, tile, &status};
+        if(status != CL_SUCCESS){ std::cout << "Cannot create tile queues: " << status << "\n"; return -1; }
+        tiles.set_tile(256, 256);
+
+        std::vector<rawcolor, huge_page_allocator<rawcolor>> output_stitched(w*h);
+        tile_executor::statistics stats;
+        status = tiles.run(w, h,
+                           [&](int y0, int rows, unsigned char* dst){ std::memcpy(dst, data0 + size_t(y0) * w, sizeof(rawcolor) * w * rows); return true; },
+                           [&](int y0, int rows, unsigned char const* src){ std::memcpy(output_stitched.data() + size_t(y0) * w, src, sizeof(rawcolor) * w * rows); return true; },
+                           &stats);
+        if(status != CL_SUCCESS){ std::cout << "Tiled run failed: " << status << "\n"; return -1; }
+
+        bool same = std::memcmp(output_stitched.data(), output_tiled.data(), sizeof(rawcolor) * w * h) == 0;
+        std::cout << "Tile executor: " << stats.tiles << " tiles of " << tiles.tile_width() << " x " << tiles.tile_height() << " in "
+                  << stats.seconds * 1e3 << " ms, " << (same ? "identical to" : "DIFFERENT from") << " the single pass\n";
+    }
+
+    // The native backend on the same image, every instruction set up to
+    // the selected one, against the tiled kernel it mirrors
+    for(int level = 0; level <= (int)isa; ++level)
+    {
+        std::vector<rawcolor, huge_page_allocator<rawcolor>> output_cpu(w*h);
+        perf_counters counters;
+        perf_sample best = {};
+        for(int run = 0; run < runs; ++run)
+        {
+            trace_span run_span{"sobel cpu run", "cpu"};
+            counters.start();
+            sobel_cpu(&data0->r, &output_cpu.data()->r, w, h, cpu_isa(level));
+            auto sample = counters.stop();
+            if(run == 0 || sample.ms < best.ms) best = sample;
+        }
+        const double cpu_ms = best.ms;
+        size_t exact = 0;
+        for(int i = 0; i < w*h; ++i)
+            exact += std::memcmp(&output_cpu[i], &output_tiled[i], sizeof(rawcolor)) == 0;
+        std::cout << "CPU Sobel (" << isa_name(cpu_isa(level)) << "): " << cpu_ms << " ms" << describe(best) << ", " << tiled_ms / cpu_ms << "x the tiled kernel, "
+                  << 100.0 * exact / ((double)w * h) << " % of pixels identical, "
+                  << count_mismatches(output_cpu, output_tiled, w, h, 0) << " off by more than one\n";
+    }
+
+    // Separable filters: Sobel from its [1 0 -1] and [1 2 1] passes, and a
+    // 9x9 Gaussian as an example of a general separable filter, on the
+    // device (row pass, column pass) and on the host (SIMD, threaded)
+    std::vector<rawcolor, huge_page_allocator<rawcolor>> output_separable(w*h), output_cpu(w*h), gaussian_dev(w*h), gaussian_cpu(w*h);
+    const int gaussian_radius = 4;
+    const auto gaussian = gaussian_taps(gaussian_radius);
+    double separable_ms = 1e30, gaussian_ms = 1e30;
+    {
+        const size_t bytes = sizeof(rawcolor) * w * h, float_bytes = sizeof(color) * w * h;
+        cl_mem taps = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR | CL_MEM_HOST_NO_ACCESS,
+                                     gaussian.size() * sizeof(float), (void*)gaussian.data(), &status);
+        if(status != CL_SUCCESS){ std::cout << "Cannot create taps buffer: " << status << "\n"; return -1; }
+
+        size_t dims[2] = {(size_t)w, (size_t)h};
+        for(int run = 0; run < runs; ++run)
+        {
+            trace_span run_span{"separable run", "opencl"};
+
+            auto buf_src = pool.buffer(CL_MEM_READ_ONLY  | CL_MEM_HOST_WRITE_ONLY, bytes, &status);
+            if(status != CL_SUCCESS){ std::cout << "Cannot create source buffer: " << status << "\n"; return -1; }
+            auto buf_diff = pool.buffer(CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, float_bytes, &status);
+            if(status != CL_SUCCESS){ std::cout << "Cannot create intermediate buffer: " << status << "\n"; return -1; }
+            auto buf_smooth = pool.buffer(CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, float_bytes, &status);
+            if(status != CL_SUCCESS){ std::cout << "Cannot create intermediate buffer: " << status << "\n"; return -1; }
+            auto buf_dst = pool.buffer(CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, bytes, &status);
+            if(status != CL_SUCCESS){ std::cout << "Cannot create destination buffer: " << status << "\n"; return -1; }
+
+            status = clEnqueueWriteBuffer(queue, buf_src.get(), false, 0, bytes, data0, 0, nullptr, nullptr);
+            if(status != CL_SUCCESS){ std::cout << "Cannot write source buffer: " << status << "\n"; return -1; }
+
+            cl_mem src = buf_src.get(), diff = buf_diff.get(), smooth = buf_smooth.get(), dst = buf_dst.get();
+            std::array<cl_event, 4> events;
+
+            status = set_args(kernel_sobel_rows, src, diff, smooth, w, h);
+            if(status != CL_SUCCESS){ std::cout << "Cannot set arguments of sobel_rows: " << status << "\n"; return -1; }
+            status = clEnqueueNDRangeKernel(queue, kernel_sobel_rows, 2, nullptr, dims, nullptr, 0, nullptr, &events[0]);
+            if(status != CL_SUCCESS){ std::cout << "Cannot enqueue sobel_rows: " << status << "\n"; return -1; }
+            status = set_args(kernel_sobel_cols, src, diff, smooth, dst, w, h);
+            if(status != CL_SUCCESS){ std::cout << "Cannot set arguments of sobel_cols: " << status << "\n"; return -1; }
+            status = clEnqueueNDRangeKernel(queue, kernel_sobel_cols, 2, nullptr, dims, nullptr, 0, nullptr, &events[1]);
+            if(status != CL_SUCCESS){ std::cout << "Cannot enqueue sobel_cols: " << status << "\n"; return -1; }
+            status = clEnqueueReadBuffer(queue, dst, false, 0, bytes, output_separable.data(), 0, nullptr, nullptr);
+            if(status != CL_SUCCESS){ std::cout << "Cannot read back buffer: " << status << "\n"; return -1; }
+
+            // The Gaussian reuses the first intermediate buffer
+            status = set_args(kernel_rows, src, diff, taps, gaussian_radius, w, h);
+            if(status != CL_SUCCESS){ std::cout << "Cannot set arguments of separable_rows: " << status << "\n"; return -1; }
+            status = clEnqueueNDRangeKernel(queue, kernel_rows, 2, nullptr, dims, nullptr, 0, nullptr, &events[2]);
+            if(status != CL_SUCCESS){ std::cout << "Cannot enqueue separable_rows: " << status << "\n"; return -1; }
+            status = set_args(kernel_cols, diff, dst, taps, gaussian_radius, w, h);
+            if(status != CL_SUCCESS){ std::cout << "Cannot set arguments of separable_cols: " << status << "\n"; return -1; }
+            status = clEnqueueNDRangeKernel(queue, kernel_cols, 2, nullptr, dims, nullptr, 0, nullptr, &events[3]);
+            if(status != CL_SUCCESS){ std::cout << "Cannot enqueue separable_cols: " << status << "\n"; return -1; }
+            status = clEnqueueReadBuffer(queue, dst, false, 0, bytes, gaussian_dev.data(), 0, nullptr, nullptr);
+            if(status != CL_SUCCESS){ std::cout << "Cannot read back buffer: " << status << "\n"; return -1; }
+
+            trace_device(clock, events[0], "sobel_rows");
+            trace_device(clock, events[1], "sobel_cols");
+            trace_device(clock, events[2], "separable_rows");
+            trace_device(clock, events[3], "separable_cols");
+
+            status = clFinish(queue);
+            if(status != CL_SUCCESS){ std::cout << "Cannot finish: " << status << "\n"; return -1; }
+
+            std::array<double, 4> ms;
+            for(size_t e = 0; e < events.size(); ++e)
+            {
+                ms[e] = event_ms(events[e], &status);
+                if(status != CL_SUCCESS){ std::cout << "Cannot get kernel time: " << status << "\n"; return -1; }
+                clReleaseEvent(events[e]);
+            }
+            separable_ms = std::min(separable_ms, ms[0] + ms[1]);
+            gaussian_ms = std::min(gaussian_ms, ms[2] + ms[3]);
+        }
+        clReleaseMemObject(taps);
+    }
+
+    double cpu_ms = 1e30, gaussian_cpu_ms = 1e30;
+    for(int run = 0; run < runs; ++run)
+    {
+        trace_span run_span{"separable host run", "cpu"};
+        auto t0 = std::chrono::high_resolution_clock::now();
+        sobel_separable_cpu(&data0->r, &output_cpu.data()->r, w, h);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        separable_filter_cpu(&data0->r, &gaussian_cpu.data()->r, w, h, gaussian, gaussian);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        cpu_ms = std::min(cpu_ms, std::chrono::duration<double, std::milli>(t1 - t0).count());
+        gaussian_cpu_ms = std::min(gaussian_cpu_ms, std::chrono::duration<double, std::milli>(t2 - t1).count());
+    }
+
+    {
+        size_t dev_mismatches = count_mismatches(output, output_separable, w, h, 1);
+        size_t cpu_mismatches = count_mismatches(output, output_cpu, w, h, 1);
+        size_t gaussian_mismatches = count_mismatches(gaussian_dev, gaussian_cpu, w, h, 0);
+        std::cout << "Separable Sobel: device " << separable_ms << " ms (" << kernel_ms / separable_ms << "x the image version), host "
+                  << cpu_ms << " ms, " << dev_mismatches << " / " << cpu_mismatches << " pixels differ from the image version\n";
+        std::cout << "Separable " << gaussian.size() << "x" << gaussian.size() << " Gaussian: device " << gaussian_ms << " ms, host "
+                  << gaussian_cpu_ms << " ms, " << gaussian_mismatches << " pixels differ between them\n";
+    }
+
+    // General KxK filters, each a specialized build of convolution.cl,
+    // against the host templates for the same radius
+    {
+        convolution_engine engine{context, device, load_source("./../../Texturing/convolution.cl")};
+        const std::pair<const char*, filter2d> filters[] = {
+            { "3x3 sharpen",   filter2d::sharpen() },
+            { "3x3 Laplacian", filter2d::laplacian() },
+            { "5x5 Gaussian",  filter2d::outer(gaussian_taps(2), gaussian_taps(2)) },
+            { "7x7 Gaussian",  filter2d::outer(gaussian_taps(3), gaussian_taps(3)) },
+        };
+        const size_t bytes = sizeof(rawcolor) * w * h;
+        std::vector<rawcolor, huge_page_allocator<rawcolor>> conv_dev(w*h), conv_cpu(w*h);
+        size_t dims[2] = {(size_t)w, (size_t)h};
+
+        for(auto const& f : filters)
+        {
+            double filter_ms = 1e30, filter_cpu_ms = 1e30;
+            for(int run = 0; run < runs; ++run)
+            {
+                trace_span run_span{"convolution run", "opencl"};
+
+                // Built on the first run, looked up afterwards
+                cl_kernel kernel_conv = engine.kernel(f.second, &status);
+                if(status != CL_SUCCESS){ std::cout << "Cannot build convolution for " << f.first << ": " << status << "\n" << engine.build_log() << "\n"; return -1; }
+
+                auto buf_src = pool.buffer(CL_MEM_READ_ONLY  | CL_MEM_HOST_WRITE_ONLY, bytes, &status);
+                if(status != CL_SUCCESS){ std::cout << "Cannot create source buffer: " << status << "\n"; return -1; }
+                auto buf_dst = pool.buffer(CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, bytes, &status);
+                if(status != CL_SUCCESS){ std::cout << "Cannot create destination buffer: " << status << "\n"; return -1; }
+
+                status = clEnqueueWriteBuffer(queue, buf_src.get(), false, 0, bytes, data0, 0, nullptr, nullptr);
+                if(status != CL_SUCCESS){ std::cout << "Cannot write source buffer: " << status << "\n"; return -1; }
+
+                cl_event conv_event;
+                status = set_args(kernel_conv, buf_src.get(), buf_dst.get(), w, h);
+                if(status != CL_SUCCESS){ std::cout << "Cannot set arguments of convolve: " << status << "\n"; return -1; }
+                status = clEnqueueNDRangeKernel(queue, kernel_conv, 2, nullptr, dims, nullptr, 0, nullptr, &conv_event);
+                if(status != CL_SUCCESS){ std::cout << "Cannot enqueue convolve: " << status << "\n"; return -1; }
+                trace_device(clock, conv_event, "convolve");
+                status = clEnqueueReadBuffer(queue, buf_dst.get(), true, 0, bytes, conv_dev.data(), 0, nullptr, nullptr);
+                if(status != CL_SUCCESS){ std::cout << "Cannot read back buffer: " << status << "\n"; return -1; }
+
+                filter_ms = std::min(filter_ms, event_ms(conv_event, &status));
+                if(status != CL_SUCCESS){ std::cout << "Cannot get kernel time: " << status << "\n"; return -1; }
+                clReleaseEvent(conv_event);
+
+                auto t0 = std::chrono::high_resolution_clock::now();
+                convolve_cpu(&data0->r, &conv_cpu.data()->r, w, h, f.second);
+                filter_cpu_ms = std::min(filter_cpu_ms, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count());
+            }
+            std::cout << f.first << " convolution: device " << filter_ms << " ms, host " << filter_cpu_ms << " ms, "
+                      << count_mismatches(conv_dev, conv_cpu, w, h, 0) << " pixels differ between them\n";
+        }
+        auto stats = engine.stats();
+        std::cout << "Convolution variants: " << stats.builds << " builds for " << stats.lookups << " lookups, "
+                  << stats.build_ms << " ms building\n";
+    }
+
+    // A chain of stages as one filter graph: fused and device-resident,
+    // against the same graph with every stage stored
+    {
+        filter_graph graph;
+        auto edges = graph.threshold(graph.sobel(graph.blur(graph.grayscale(graph.source()), 2)), 0.25f);
+        auto result = graph.composite(graph.source(), graph.invert(edges), blend::multiply);
+
+        const size_t bytes = sizeof(rawcolor) * w * h;
+        std::vector<rawcolor, huge_page_allocator<rawcolor>> graph_unfused(w*h), graph_fused(w*h);
+        for(int fuse = 1; fuse >= 0; --fuse)
+        {
+            auto& graph_out = fuse ? graph_fused : graph_unfused;
+            std::string log;
+            trace_start = trace.now();
+            auto plan = graph.compile(context, device, result, fuse == 1, &status, &log);
+            trace.complete("build filter graph", "opencl", trace_start, trace.now());
+            if(status != CL_SUCCESS){ std::cout << "Cannot build filter graph: " << status << "\n" << log << "\n"; return -1; }
+
+            double graph_ms = 1e30, graph_kernel_ms = 1e30;
+            for(int run = 0; run < runs; ++run)
+            {
+                trace_span run_span{"filter graph run", "opencl"};
+                auto t0 = std::chrono::high_resolution_clock::now();
+
+                auto buf_src = pool.buffer(CL_MEM_READ_ONLY  | CL_MEM_HOST_WRITE_ONLY, bytes, &status);
+                if(status != CL_SUCCESS){ std::cout << "Cannot create source buffer: " << status << "\n"; return -1; }
+                auto buf_dst = pool.buffer(CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, bytes, &status);
+                if(status != CL_SUCCESS){ std::cout << "Cannot create destination buffer: " << status << "\n"; return -1; }
+
+                status = clEnqueueWriteBuffer(queue, buf_src.get(), false, 0, bytes, data0, 0, nullptr, nullptr);
+                if(status != CL_SUCCESS){ std::cout << "Cannot write source buffer: " << status << "\n"; return -1; }
+
+                std::vector<cl_event> events;
+                status = plan->run(queue, pool, buf_src.get(), buf_dst.get(), w, h, &events);
+                if(status != CL_SUCCESS){ std::cout << "Cannot run filter graph: " << status << "\n"; return -1; }
+                for(auto e : events) trace_device(clock, e, "filter graph stage");
+
+                status = clEnqueueReadBuffer(queue, buf_dst.get(), true, 0, bytes, graph_out.data(), 0, nullptr, nullptr);
+                if(status != CL_SUCCESS){ std::cout << "Cannot read back buffer: " << status << "\n"; return -1; }
+                graph_ms = std::min(graph_ms, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count());
+
+                double sum = 0.0;
+                for(auto e : events)
+                {
+                    sum += event_ms(e, &status);
+                    if(status != CL_SUCCESS){ std::cout << "Cannot get kernel time: " << status << "\n"; return -1; }
+                    clReleaseEvent(e);
+                }
+                graph_kernel_ms = std::min(graph_kernel_ms, sum);
+            }
+            std::cout << (fuse ? "Fused" : "Unfused") << " filter graph: " << plan->kernels() << " kernels, " << graph_kernel_ms
+                      << " ms on the device, " << graph_ms << " ms with upload and read-back\n";
+        }
+        std::cout << "Fused and unfused graphs differ in " << count_mismatches(graph_fused, graph_unfused, w, h, 0)
+                  << " pixels (rounding of the stored intermediates)\n";
+    }
+
+    // Canny edges, stage by stage on the device and on the host, which
+    // must agree exactly; the edges are written next to the result
+    {
+        const float low = 0.1f, high = 0.3f;
+        canny_detector canny{program, tile, &status};
+        if(status != CL_SUCCESS){ std::cout << "Cannot create Canny kernels: " << status << "\n"; return -1; }
+
+        const size_t bytes = sizeof(rawcolor) * w * h;
+        std::vector<rawcolor, huge_page_allocator<rawcolor>> edges(w*h), edges_cpu(w*h);
+        canny_times best = {}, best_cpu = {};
+        auto total = [](canny_times const& t){ return t.smooth + t.gradient + t.suppress + t.hysteresis + t.output; };
+        for(int run = 0; run < runs; ++run)
+        {
+            trace_span run_span{"canny run", "opencl"};
+            auto buf_src = pool.buffer(CL_MEM_READ_ONLY  | CL_MEM_HOST_WRITE_ONLY, bytes, &status);
+            if(status != CL_SUCCESS){ std::cout << "Cannot create source buffer: " << status << "\n"; return -1; }
+            auto buf_dst = pool.buffer(CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, bytes, &status);
+            if(status != CL_SUCCESS){ std::cout << "Cannot create destination buffer: " << status << "\n"; return -1; }
+
+            status = clEnqueueWriteBuffer(queue, buf_src.get(), false, 0, bytes, data0, 0, nullptr, nullptr);
+            if(status != CL_SUCCESS){ std::cout << "Cannot write source buffer: " << status << "\n"; return -1; }
+
+            canny_times t;
+            status = canny.run(queue, pool, buf_src.get(), buf_dst.get(), w, h, low, high, &t);
+            if(status != CL_SUCCESS){ std::cout << "Cannot run Canny: " << status << "\n"; return -1; }
+            if(run == 0 || total(t) < total(best)) best = t;
+
+            status = clEnqueueReadBuffer(queue, buf_dst.get(), true, 0, bytes, edges.data(), 0, nullptr, nullptr);
+            if(status != CL_SUCCESS){ std::cout << "Cannot read back buffer: " << status << "\n"; return -1; }
+
+            trace_span cpu_span{"canny cpu run", "cpu"};
+            canny_cpu(&data0->r, &edges_cpu.data()->r, w, h, low, high, &t);
+            if(run == 0 || total(t) < total(best_cpu)) best_cpu = t;
+        }
+
+        size_t edge_pixels = 0;
+        for(auto const& p : edges_cpu) edge_pixels += p.r == 255;
+        std::cout << "Canny (" << low << ", " << high << "), ms on the device / host:\n"
+                  << "  smoothing " << best.smooth << " / " << best_cpu.smooth << ", gradient " << best.gradient << " / " << best_cpu.gradient
+                  << ", suppression and thresholds " << best.suppress << " / " << best_cpu.suppress
+                  << ", hysteresis " << best.hysteresis << " (" << best.rounds << " rounds) / " << best_cpu.hysteresis
+                  << ", output " << best.output << " / " << best_cpu.output << "\n"
+                  << "  total " << total(best) << " / " << total(best_cpu) << ", " << 100.0 * edge_pixels / ((double)w * h) << " % edge pixels, "
+                  << count_mismatches(edges, edges_cpu, w, h, 0) << " pixels differ\n";
+
+        const std::string edges_path = "../../Texturing/edges." + result_format;
+        if(!write_image(edges_path, w, h, &edges.data()->r, encoding)) std::cout << "Error writing " << edges_path << "\n";
+    }
+
+    // Summed-area tables: box blurs whose cost does not depend on the
+    // radius, local luma mean and variance, and an adaptive threshold
+    // written next to the result. Device and host share the integer math,
+    // so blurs and thresholds must agree exactly.
+    {
+        const int radii[3] = { 2, 16, 128 };
+        const int threshold_radius = 16, threshold_offset = 8;
+        sat_engine sat{program, &status};
+        if(status != CL_SUCCESS){ std::cout << "Cannot create summed-area table kernels: " << status << "\n"; return -1; }
+
+        const size_t bytes = sizeof(rawcolor) * w * h;
+        auto buf_src = pool.buffer(CL_MEM_READ_ONLY | CL_MEM_HOST_WRITE_ONLY, bytes, &status);
+        if(status != CL_SUCCESS){ std::cout << "Cannot create source buffer: " << status << "\n"; return -1; }
+        auto buf_dst = pool.buffer(CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, bytes, &status);
+        if(status != CL_SUCCESS){ std::cout << "Cannot create destination buffer: " << status << "\n"; return -1; }
+        auto buf_stats = pool.buffer(CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY, sizeof(cl_float2) * w * h, &status);
+        if(status != CL_SUCCESS){ std::cout << "Cannot create statistics buffer: " << status << "\n"; return -1; }
+        auto buf_table = pool.buffer(CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, sat_engine::table_bytes(w, h), &status);
+        if(status != CL_SUCCESS){ std::cout << "Cannot create summed-area table: " << status << "\n"; return -1; }
+        status = clEnqueueWriteBuffer(queue, buf_src.get(), false, 0, bytes, data0, 0, nullptr, nullptr);
+        if(status != CL_SUCCESS){ std::cout << "Cannot write source buffer: " << status << "\n"; return -1; }
+
+        // Device milliseconds of the events, released
+        auto events_ms = [&](std::vector<cl_event>& events)
+        {
+            double sum = 0.0;
+            for(auto e : events)
+            {
+                if(status == CL_SUCCESS) sum += event_ms(e, &status);
+                clReleaseEvent(e);
+            }
+            events.clear();
+            return sum;
+        };
+
+        std::vector<uint64_t> table(size_t(w) * h * 4);
+        std::vector<rawcolor, huge_page_allocator<rawcolor>> out(w*h), out_cpu(w*h);
+        double build_ms = 1e30, build_cpu_ms = 1e30;
+        for(int run = 0; run < runs; ++run)
+        {
+            trace_span run_span{"sat build", "opencl"};
+            std::vector<cl_event> events;
+            status = sat.build(queue, buf_src.get(), buf_table.get(), w, h, sat_values::rgba, &events);
+            if(status != CL_SUCCESS){ std::cout << "Cannot build summed-area table: " << status << "\n"; return -1; }
+            status = clFinish(queue);
+            build_ms = std::min(build_ms, events_ms(events));
+            if(status != CL_SUCCESS){ std::cout << "Cannot get kernel time: " << status << "\n"; return -1; }
+
+            trace_span cpu_span{"sat cpu build", "cpu"};
+            auto t0 = std::chrono::high_resolution_clock::now();
+            build_sat_cpu(&data0->r, table.data(), w, h, sat_values::rgba);
+            build_cpu_ms = std::min(build_cpu_ms, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count());
+        }
+        std::cout << "Summed-area table, ms on the device / host: " << build_ms << " / " << build_cpu_ms << "\n";
+
+        for(int radius : radii)
+        {
+            double blur_ms = 1e30, blur_cpu_ms = 1e30;
+            for(int run = 0; run < runs; ++run)
+            {
+                trace_span run_span{"sat box blur", "opencl"};
+                std::vector<cl_event> events;
+                status = sat.box_blur(queue, buf_table.get(), buf_dst.get(), w, h, radius, &events);
+                if(status != CL_SUCCESS){ std::cout << "Cannot run box blur: " << status << "\n"; return -1; }
+                status = clEnqueueReadBuffer(queue, buf_dst.get(), true, 0, bytes, out.data(), 0, nullptr, nullptr);
+                if(status != CL_SUCCESS){ std::cout << "Cannot read back buffer: " << status << "\n"; return -1; }
+                blur_ms = std::min(blur_ms, events_ms(events));
+                if(status != CL_SUCCESS){ std::cout << "Cannot get kernel time: " << status << "\n"; return -1; }
+
+                trace_span cpu_span{"sat cpu box blur", "cpu"};
+                auto t0 = std::chrono::high_resolution_clock::now();
+                box_blur_cpu(table.data(), &out_cpu.data()->r, w, h, radius);
+                blur_cpu_ms = std::min(blur_cpu_ms, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count());
+            }
+            std::cout << "  box blur of radius " << radius << ": " << blur_ms << " / " << blur_cpu_ms << " ms, "
+                      << count_mismatches(out, out_cpu, w, h, 0, 0) << " pixels differ\n";
+        }
+
+        // Luma and its square, for the local statistics
+        std::vector<cl_event> events;
+        status = sat.build(queue, buf_src.get(), buf_table.get(), w, h, sat_values::luma, &events);
+        if(status != CL_SUCCESS){ std::cout << "Cannot build summed-area table: " << status << "\n"; return -1; }
+        status = sat.mean_variance(queue, buf_table.get(), buf_stats.get(), w, h, threshold_radius, &events);
+        if(status != CL_SUCCESS){ std::cout << "Cannot compute mean and variance: " << status << "\n"; return -1; }
+        status = sat.threshold(queue, buf_table.get(), buf_src.get(), buf_dst.get(), w, h, threshold_radius, threshold_offset, &events);
+        if(status != CL_SUCCESS){ std::cout << "Cannot run adaptive threshold: " << status << "\n"; return -1; }
+        std::vector<float> stats(size_t(w) * h * 2), stats_cpu(size_t(w) * h * 2);
+        status = clEnqueueReadBuffer(queue, buf_stats.get(), false, 0, sizeof(float) * stats.size(), stats.data(), 0, nullptr, nullptr);
+        if(status != CL_SUCCESS){ std::cout << "Cannot read back buffer: " << status << "\n"; return -1; }
+        status = clEnqueueReadBuffer(queue, buf_dst.get(), true, 0, bytes, out.data(), 0, nullptr, nullptr);
+        if(status != CL_SUCCESS){ std::cout << "Cannot read back buffer: " << status << "\n"; return -1; }
+        const double luma_ms = events_ms(events);
+        if(status != CL_SUCCESS){ std::cout << "Cannot get kernel time: " << status << "\n"; return -1; }
+
+        build_sat_cpu(&data0->r, table.data(), w, h, sat_values::luma);
+        mean_variance_cpu(table.data(), stats_cpu.data(), w, h, threshold_radius);
+        adaptive_threshold_cpu(table.data(), &data0->r, &out_cpu.data()->r, w, h, threshold_radius, threshold_offset);
+        double max_rel = 0.0;
+        for(size_t i = 0; i < stats.size(); ++i)
+            max_rel = std::max(max_rel, std::abs((double)stats[i] - stats_cpu[i]) / std::max(1.0, std::abs((double)stats_cpu[i])));
+        std::cout << "  luma table, mean and variance and threshold of radius " << threshold_radius << ": " << luma_ms
+                  << " ms on the device, statistics within " << max_rel << " relative, threshold "
+                  << count_mismatches(out, out_cpu, w, h, 0, 0) << " pixels differ\n";
+
+        const std::string threshold_path = "../../Texturing/threshold." + result_format;
+        if(!write_image(threshold_path, w, h, &out.data()->r, encoding)) std::cout << "Error writing " << threshold_path << "\n";
+    }
+
+    // Pyramids down to 1x1 in one atlas, each a chain of launches after
+    // the upload, against the tiled Sobel at full resolution; then the
+    // tiled Sobel over every Gaussian level through sub-buffers. Levels
+    // must match the host exactly; the Gaussian levels are written side by
+    // side next to the result.
+    {
+        cl_uint align_bits = 0;
+        status = clGetDeviceInfo(device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(align_bits), &align_bits, nullptr);
+        if(status != CL_SUCCESS){ std::cout << "Cannot get base address alignment: " << status << "\n"; return -1; }
+        const auto layout = make_pyramid_layout(w, h, 0, std::max<size_t>(4096, align_bits / 8));
+        const size_t levels = layout.levels.size();
+
+        pyramid_builder pyramid{program, &status};
+        if(status != CL_SUCCESS){ std::cout << "Cannot create pyramid kernel: " << status << "\n"; return -1; }
+        auto buf_atlas = pool.buffer(CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, layout.bytes, &status);
+        if(status != CL_SUCCESS){ std::cout << "Cannot create pyramid atlas: " << status << "\n"; return -1; }
+        auto buf_edges = pool.buffer(CL_MEM_READ_WRITE | CL_MEM_HOST_NO_ACCESS, layout.bytes, &status);
+        if(status != CL_SUCCESS){ std::cout << "Cannot create edge atlas: " << status << "\n"; return -1; }
+
+        std::vector<unsigned char, aligned_allocator<unsigned char, 4096>> atlas(layout.bytes), atlas_cpu(layout.bytes),
+                                                                           edges(layout.bytes), edges_cpu(layout.bytes);
+        for(auto filter : { pyramid_filter::box, pyramid_filter::gaussian })
+        {
+            const bool gaussian = filter == pyramid_filter::gaussian;
+            double chain_ms = 1e30, chain_cpu_ms = 1e30;
+            for(int run = 0; run < runs; ++run)
+            {
+                trace_span run_span{"pyramid run", "opencl"};
+                cl_event upload;
+                status = clEnqueueWriteBuffer(queue, buf_atlas.get(), false, layout.levels[0].offset, layout.levels[0].bytes(), data0, 0, nullptr, &upload);
+                if(status != CL_SUCCESS){ std::cout << "Cannot write pyramid atlas: " << status << "\n"; return -1; }
+
+                std::vector<cl_event> events;
+                status = pyramid.build(queue, buf_atlas.get(), layout, filter, upload, &events);
+                clReleaseEvent(upload);
+                if(status != CL_SUCCESS){ std::cout << "Cannot build pyramid: " << status << "\n"; return -1; }
+                status = clFinish(queue);
+                if(status != CL_SUCCESS){ std::cout << "Cannot finish: " << status << "\n"; return -1; }
+                for(auto e : events) trace_device(clock, e, "pyramid level");
+
+                // From the start of the first level to the end of the last
+                cl_ulong start = 0, end = 0;
+                if(!events.empty()) status = clGetEventProfilingInfo(events.front(), CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr);
+                if(!events.empty() && status == CL_SUCCESS) status = clGetEventProfilingInfo(events.back(), CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr);
+                if(status != CL_SUCCESS){ std::cout << "Cannot get kernel time: " << status << "\n"; return -1; }
+                chain_ms = std::min(chain_ms, (end - start) * 1e-6);
+                for(auto e : events) clReleaseEvent(e);
+
+                trace_span cpu_span{"pyramid cpu run", "cpu"};
+                auto t0 = std::chrono::high_resolution_clock::now();
+                build_pyramid_cpu(&data0->r, atlas_cpu.data(), layout, filter);
+                chain_cpu_ms = std::min(chain_cpu_ms, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count());
+            }
+
+            // The atlas is device-only; levels come back through a copy
+            auto buf_read = pool.buffer(CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY, layout.bytes, &status);
+            if(status != CL_SUCCESS){ std::cout << "Cannot create read-back buffer: " << status << "\n"; return -1; }
+            status = clEnqueueCopyBuffer(queue, buf_atlas.get(), buf_read.get(), 0, 0, layout.bytes, 0, nullptr, nullptr);
+            if(status != CL_SUCCESS){ std::cout << "Cannot copy pyramid atlas: " << status << "\n"; return -1; }
+            status = clEnqueueReadBuffer(queue, buf_read.get(), true, 0, layout.bytes, atlas.data(), 0, nullptr, nullptr);
+            if(status != CL_SUCCESS){ std::cout << "Cannot read back buffer: " << status << "\n"; return -1; }
+
+            size_t mismatches = 0;
+            for(auto const& level : layout.levels)
+                mismatches += count_mismatches((rawcolor const*)(atlas.data() + level.offset), (rawcolor const*)(atlas_cpu.data() + level.offset),
+                                               level.width, level.height, 0, 0);
+            std::cout << (gaussian ? "Gaussian" : "Box") << " pyramid, " << levels << " levels in " << layout.bytes / 1048576.0
+                      << " MiB: " << chain_ms << " ms on the device (" << chain_ms / tiled_ms << "x the full resolution tiled Sobel), "
+                      << chain_cpu_ms << " ms on the host, " << mismatches << " pixels differ\n";
+        }
+
+        // Every level through the tiled Sobel, level to level between the
+        // atlases; the Gaussian pyramid is the last one built
+        double sobel_ms = 0.0;
+        std::vector<cl_mem> views;
+        std::vector<cl_event> events;
+        for(size_t k = 0; k < levels && status == CL_SUCCESS; ++k)
+        {
+            cl_mem src = pyramid_level_buffer(buf_atlas.get(), layout, k, 0, &status);
+            if(status != CL_SUCCESS) break;
+            views.push_back(src);
+            cl_mem dst = pyramid_level_buffer(buf_edges.get(), layout, k, 0, &status);
+            if(status != CL_SUCCESS) break;
+            views.push_back(dst);
+            const cl_int lw = layout.levels[k].width, lh = layout.levels[k].height;
+            status = set_args(kernel_tiled, src, dst, lw, lh);
+            if(status != CL_SUCCESS) break;
+
+            const size_t local_dims[2] = { tile, tile };
+            const size_t global_dims[2] = { (lw + tile - 1) / tile * tile, (lh + tile - 1) / tile * tile };
+            cl_event event;
+            status = clEnqueueNDRangeKernel(queue, kernel_tiled, 2, nullptr, global_dims, local_dims, 0, nullptr, &event);
+            if(status != CL_SUCCESS) break;
+            events.push_back(event);
+        }
+        if(status == CL_SUCCESS) status = clFinish(queue);
+        for(auto e : events)
+        {
+            if(status == CL_SUCCESS)
+            {
+                trace_device(clock, e, "sobel_tiled level");
+                sobel_ms += event_ms(e, &status);
+            }
+            clReleaseEvent(e);
+        }
+        for(auto view : views) clReleaseMemObject(view);
+        if(status != CL_SUCCESS){ std::cout << "Cannot run Sobel on the pyramid: " << status << "\n"; return -1; }
+
+        auto buf_read = pool.buffer(CL_MEM_READ_WRITE | CL_MEM_HOST_READ_ONLY, layout.bytes, &status);
+        if(status != CL_SUCCESS){ std::cout << "Cannot create read-back buffer: " << status << "\n"; return -1; }
+        status = clEnqueueCopyBuffer(queue, buf_edges.get(), buf_read.get(), 0, 0, layout.bytes, 0, nullptr, nullptr);
+        if(status != CL_SUCCESS){ std::cout << "Cannot copy edge atlas: " << status << "\n"; return -1; }
+        status = clEnqueueReadBuffer(queue, buf_read.get(), true, 0, layout.bytes, edges.data(), 0, nullptr, nullptr);
+        if(status != CL_SUCCESS){ std::cout << "Cannot read back buffer: " << status << "\n"; return -1; }
+
+        size_t mismatches = 0;
+        for(auto const& level : layout.levels)
+        {
+            sobel_cpu(atlas.data() + level.offset, edges_cpu.data() + level.offset, level.width, level.height, isa);
+            mismatches += count_mismatches((rawcolor const*)(edges.data() + level.offset), (rawcolor const*)(edges_cpu.data() + level.offset),
+                                           level.width, level.height, 0);
+        }
+        std::cout << "  tiled Sobel over all levels: " << sobel_ms << " ms, " << sobel_ms / tiled_ms << "x level 0 alone, "
+                  << mismatches << " pixels off by more than one from the host\n";
+
+        // Level 0 on the left, the others stacked on its right
+        const int montage_w = w + (levels > 1 ? layout.levels[1].width : 0);
+        int montage_h = 0;
+        for(size_t k = 1; k < levels; ++k) montage_h += layout.levels[k].height;
+        montage_h = std::max(montage_h, h);
+        std::vector<unsigned char> montage(size_t(montage_w) * montage_h * 4, 0);
+        for(size_t k = 0, y0 = 0; k < levels; ++k)
+        {
+            auto const& level = layout.levels[k];
+            const size_t x0 = k == 0 ? 0 : w;
+            for(int y = 0; y < level.height; ++y)
+                std::memcpy(&montage[((y0 + y) * montage_w + x0) * 4], atlas.data() + level.offset + size_t(y) * level.width * 4, size_t(level.width) * 4);
+            if(k > 0) y0 += level.height;
+        }
+        const std::string pyramid_path = "../../Texturing/pyramid." + result_format;
+        if(!write_image(pyramid_path, montage_w, montage_h, montage.data(), encoding)) std::cout << "Error writing " << pyramid_path << "\n";
+    }
+
+    {
+        auto stats = pool.stats();
+        std::cout << "First run: " << run_ms.front() << " ms, later runs: "
+                  << std::accumulate(run_ms.begin() + 1, run_ms.end(), 0.0) / (runs - 1) << " ms\n";
+
+        // Every RGBA8 pixel is read once (neighbours hit the texture cache)
+        // and written once, about 76 flops of gradient and magnitude
+        const double pixels = (double)w * h;
+        std::cout << "Sobel kernel took: " << kernel_ms << " ms"
+                  << describe_roofline(device_name, pixels * 2 * sizeof(rawcolor), pixels * 76, kernel_ms * 1e-3) << "\n";
+        std::cout << "Tiled Sobel kernel (" << tile << "x" << tile << " work-groups) took: " << tiled_ms << " ms"
+                  << describe_roofline(device_name, pixels * 2 * sizeof(rawcolor), pixels * 76, tiled_ms * 1e-3)
+                  << ", " << kernel_ms / tiled_ms << "x the image version\n";
+        std::cout << "Image pool hit rate: " << 100.0 * stats.hit_rate() << " % of " << stats.acquires << " acquires, peak "
+                  << stats.peak_in_use / 1048576.0 << " MiB in use, " << stats.peak_reserved / 1048576.0 << " MiB reserved\n";
+    }
+
+    free_input();
+
+    // Codecs on the result in memory: stb_image_write against the banded
+    // PNG encoder and the fast formats, then decoding PNG with stb_image
+    // against QOI, plain and chunked
+    {
+        const std::string threads = std::to_string(std::thread::hardware_concurrency()) + " threads";
+        auto report = [&](std::string const& name, auto code)
+        {
+            trace_span code_span{"codec", "io"};
+            auto t0 = std::chrono::high_resolution_clock::now();
+            size_t bytes = code();
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+            std::cout << "  " << name << ": " << ms << " ms, " << ms / (w * (double)h * 1e-6) << " ms/MP, " << bytes / 1048576.0 << " MiB\n";
+        };
+        std::cout << "Encoding the result:\n";
+        std::vector<unsigned char> stb_png;
+        report("stbi_write_png", [&]
+        {
+            int len = 0;
+            unsigned char* png = stbi_write_png_to_mem(&output.data()->r, w*4, w, h, 4, &len);
+            stb_png.assign(png, png + len);
+            STBIW_FREE(png);
+            return (size_t)len;
+        });
+        for(int level : {1, 6, 9})
+        {
+            report("PNG level " + std::to_string(level) + ", 1 thread", [&]{ return encode_image(image_format::png, w, h, &output.data()->r, {level, 1}).size(); });
+            report("PNG level " + std::to_string(level) + ", " + threads,
+                   [&]{ return encode_image(image_format::png, w, h, &output.data()->r, {level, 0}).size(); });
+        }
+        for(auto format : {image_format::ppm, image_format::pam, image_format::pfm})
+            report(format_name(format), [&]{ return encode_image(format, w, h, &output.data()->r).size(); });
+        std::vector<unsigned char> qoi, qoi_chunked;
+        report("QOI, 1 thread", [&]{ qoi = encode_image(image_format::qoi, w, h, &output.data()->r, {0, 1}); return qoi.size(); });
+        report("QOI, " + threads, [&]{ qoi_chunked = encode_image(image_format::qoi, w, h, &output.data()->r, {0, 0}); return qoi_chunked.size(); });
+
+        std::cout << "Decoding the result (sizes are of the pixels):\n";
+        bool same = true;
+        report("stbi_load_from_memory, PNG", [&]
+        {
+            int dw = 0, dh = 0, dc = 0;
+            auto pixels = stbi_load_from_memory(stb_png.data(), (int)stb_png.size(), &dw, &dh, &dc, 4);
+            same = same && pixels && std::memcmp(pixels, output.data(), sizeof(rawcolor) * w * h) == 0;
+            stbi_image_free(pixels);
+            return sizeof(rawcolor) * dw * dh;
+        });
+        auto decode = [&](std::vector<unsigned char> const& encoded, int n)
+        {
+            int dw = 0, dh = 0;
+            auto pixels = decode_qoi(encoded.data(), encoded.size(), &dw, &dh, n);
+            same = same && pixels.size() == sizeof(rawcolor) * w * h && std::memcmp(pixels.data(), output.data(), pixels.size()) == 0;
+            return pixels.size();
+        };
+        report("QOI", [&]{ return decode(qoi, 1); });
+        report("chunked QOI, 1 thread", [&]{ return decode(qoi_chunked, 1); });
+        report("chunked QOI, " + threads, [&]{ return decode(qoi_chunked, 0); });
+        if(!same) std::cout << "  DECODED PIXELS DIFFER from the result\n";
+    }
+
+    {
+            trace_start = trace.now();
+            encode_statistics written;
+            bool ok = write_image(result_path, w, h, &output.data()->r, encoding, &written);
+            trace.complete("encode result", "io", trace_start, trace.now());
+            if(!ok) { std::cout << "Error writing output to file\n"; }
+            else    { std::cout << "Output written to " << result_path << describe_encode(written, w, h) << "\n"; }
+    }
+
+    pool.trim();
+    release();
 	
 	return 0;
 }
\ No newline at end of file
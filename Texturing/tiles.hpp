@@ -0,0 +1,364 @@
+#pragma once
+
+#ifdef __APPLE__ //Mac OSX has a different name for the header file
+#include <OpenCL/opencl.h>
+#else
+#include <CL/opencl.h>
+#endif
+
+#include <array>
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+#include <limits>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+
+#include "trace.hpp"
+
+// Netpbm files streamed by rows, so images of any size pass through a
+// bounded amount of memory. Reads binary PAM with 3 or 4 channels
+// (TUPLTYPE RGB / RGB_ALPHA) and PPM (P6), both 8 bit; writes RGBA8 PAM.
+// Other formats convert with e.g. 'convert input.png input.pam'.
+class pam_reader
+{
+public:
+    explicit pam_reader(std::string const& path) : file_{path, std::ios::binary}
+    {
+        std::string magic;
+        file_ >> magic;
+        int maxval = 0;
+        if(magic == "P6")
+        {
+            channels_ = 3;
+            width_  = header_number();
+            height_ = header_number();
+            maxval  = header_number();
+            file_.get();                            // single whitespace before the raster
+        }
+        else if(magic == "P7")
+        {
+            std::string token;
+            while(file_ >> token && token != "ENDHDR")
+            {
+                if     (token == "WIDTH")  file_ >> width_;
+                else if(token == "HEIGHT") file_ >> height_;
+                else if(token == "DEPTH")  file_ >> channels_;
+                else if(token == "MAXVAL") file_ >> maxval;
+                else std::getline(file_, token);    // TUPLTYPE and comments
+            }
+            file_.get();
+        }
+        if(!file_ || maxval != 255 || (channels_ != 3 && channels_ != 4) || width_ <= 0 || height_ <= 0) width_ = height_ = 0;
+        raster_ = file_.tellg();
+    }
+
+    bool valid() const { return width_ > 0; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    // Rows [y0, y0 + rows) as RGBA8, opaque if the file has no alpha
+    bool read(int y0, int rows, unsigned char* dst)
+    {
+        const size_t row_bytes = size_t(width_) * channels_;
+        file_.seekg(raster_ + std::streamoff(y0) * std::streamoff(row_bytes));
+        if(channels_ == 4) return bool(file_.read(reinterpret_cast<char*>(dst), std::streamsize(row_bytes) * rows));
+
+        std::vector<unsigned char> row(row_bytes);
+        for(int y = 0; y < rows; ++y)
+        {
+            if(!file_.read(reinterpret_cast<char*>(row.data()), std::streamsize(row_bytes))) return false;
+            unsigned char* d = dst + size_t(y) * width_ * 4;
+            for(int x = 0; x < width_; ++x)
+            {
+                d[4 * x + 0] = row[3 * x + 0];
+                d[4 * x + 1] = row[3 * x + 1];
+                d[4 * x + 2] = row[3 * x + 2];
+                d[4 * x + 3] = 255;
+            }
+        }
+        return true;
+    }
+
+private:
+    // Next number of a PPM header, past whitespace and '#' comments
+    int header_number()
+    {
+        file_ >> std::ws;
+        while(file_.peek() == '#')
+        {
+            file_.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            file_ >> std::ws;
+        }
+        int value = 0;
+        file_ >> value;
+        return value;
+    }
+
+    std::ifstream file_;
+    int width_ = 0, height_ = 0, channels_ = 0;
+    std::streamoff raster_ = 0;
+};
+
+class pam_writer
+{
+public:
+    pam_writer(std::string const& path, int width, int height) : file_{path, std::ios::binary}, width_{width}
+    {
+        file_ << "P7\nWIDTH " << width << "\nHEIGHT " << height << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+    }
+
+    bool valid() const { return bool(file_); }
+
+    // The next 'rows' rows, in order
+    bool write(int rows, unsigned char const* src)
+    {
+        return bool(file_.write(reinterpret_cast<char const*>(src), std::streamsize(width_) * 4 * rows));
+    }
+
+private:
+    std::ofstream file_;
+    int width_;
+};
+
+// Runs an RGBA8 buffer kernel 'k(src, dst, w, h)' with clamped edges and a
+// footprint of 'radius' pixels over an image too large for one buffer.
+//
+// The image is cut into strips of rows and each strip into tiles. A tile
+// is uploaded with its halo (up to 'radius' neighbouring pixels, clipped at
+// the image edges, where the kernel's own clamping takes over), filtered,
+// and only its interior is read back, so the stitched result equals a
+// single pass over the whole image. Tiles alternate between two sets of
+// device buffers and uploads, kernels and downloads use three queues, so
+// one tile uploads while the previous computes and downloads. Strips are
+// read and written by callbacks on other threads while the device works
+// on the current one: the host holds at most two input and two output
+// strips, whatever the image height.
+class tile_executor
+{
+public:
+    // Rows [y0, y0 + rows) of the image, w * 4 bytes each, contiguous
+    using reader = std::function<bool(int y0, int rows, unsigned char* dst)>;
+    using writer = std::function<bool(int y0, int rows, unsigned char const* src)>;
+
+    struct statistics
+    {
+        size_t tiles = 0;
+        size_t strips = 0;
+        size_t host_bytes = 0;          // strip buffers
+        size_t device_bytes = 0;        // tile buffers
+        double seconds = 0.0;
+    };
+
+    // 'local' is the work-group edge the kernel requires, 0 if any will do
+    tile_executor(cl_context context, cl_device_id device, cl_kernel kernel, int radius, size_t local, cl_int* status)
+        : context_{context}, kernel_{kernel}, radius_{radius}, local_{local}
+    {
+        clRetainContext(context_);
+        cl_command_queue_properties cqps = CL_QUEUE_PROFILING_ENABLE;
+        std::array<cl_queue_properties, 3> qps = { CL_QUEUE_PROPERTIES, cqps, 0 };
+        for(auto& q : queues_)
+        {
+            q = clCreateCommandQueueWithProperties(context, device, qps.data(), status);
+            if(*status != CL_SUCCESS){ q = nullptr; return; }
+        }
+
+        // Largest square tile whose buffers fit one allocation, at most 2048
+        cl_ulong max_alloc = 0;
+        *status = clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(max_alloc), &max_alloc, nullptr);
+        if(*status != CL_SUCCESS) return;
+        tile_w_ = tile_h_ = 2048;
+        while(tile_w_ > 64 && cl_ulong(tile_w_ + 2 * radius) * (tile_h_ + 2 * radius) * 4 > max_alloc) { tile_w_ /= 2; tile_h_ /= 2; }
+
+        auto& trace = tracer::get();
+        const char* names[3] = { "tile upload", "tile compute", "tile download" };
+        for(int i = 0; i < 3; ++i)
+        {
+            clocks_[i] = device_clock{queues_[i]};
+            trace.name_lane(lane + i, names[i]);
+        }
+    }
+
+    ~tile_executor()
+    {
+        for(auto q : queues_) if(q) clReleaseCommandQueue(q);
+        clReleaseContext(context_);
+    }
+
+    tile_executor(tile_executor const&) = delete;
+    tile_executor& operator=(tile_executor const&) = delete;
+
+    // Tile interior, rounded to the work-group edge
+    void set_tile(size_t w, size_t h)
+    {
+        const size_t step = std::max<size_t>(local_, 1);
+        tile_w_ = std::max(step, w / step * step);
+        tile_h_ = std::max(step, h / step * step);
+    }
+
+    size_t tile_width() const { return tile_w_; }
+    size_t tile_height() const { return tile_h_; }
+
+    cl_int run(int w, int h, reader read, writer write, statistics* stats = nullptr)
+    {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        const int R = radius_;
+        const size_t tw = std::min<size_t>(tile_w_, w), th = std::min<size_t>(tile_h_, h);
+        const size_t region_bytes = (tw + 2 * R) * (th + 2 * R) * 4;
+        const size_t row_bytes = size_t(w) * 4;
+        const int strips = int((h + th - 1) / th);
+
+        cl_int status = CL_SUCCESS;
+        std::array<cl_mem, 2> src = {}, dst = {};
+        auto release = [&]
+        {
+            for(auto q : queues_) clFinish(q);
+            for(auto m : src) if(m) clReleaseMemObject(m);
+            for(auto m : dst) if(m) clReleaseMemObject(m);
+        };
+        for(int s = 0; s < 2; ++s)
+        {
+            src[s] = clCreateBuffer(context_, CL_MEM_READ_ONLY  | CL_MEM_HOST_WRITE_ONLY, region_bytes, nullptr, &status);
+            if(status != CL_SUCCESS){ release(); return status; }
+            dst[s] = clCreateBuffer(context_, CL_MEM_WRITE_ONLY | CL_MEM_HOST_READ_ONLY,  region_bytes, nullptr, &status);
+            if(status != CL_SUCCESS){ release(); return status; }
+        }
+
+        // Input strips carry the halo rows, output strips only their own
+        std::array<std::vector<unsigned char>, 2> in_strip, out_strip;
+        for(auto& s : in_strip)  s.resize((th + 2 * R) * row_bytes);
+        for(auto& s : out_strip) s.resize(th * row_bytes);
+
+        auto strip_rows = [&](int k, int& y0, int& y1, int& ry0, int& ry1)
+        {
+            y0 = int(k * th);
+            y1 = std::min(h, int(y0 + th));
+            ry0 = std::max(0, y0 - R);
+            ry1 = std::min(h, y1 + R);
+        };
+        auto load = [&](int k)
+        {
+            int y0, y1, ry0, ry1;
+            strip_rows(k, y0, y1, ry0, ry1);
+            return std::async(std::launch::async, [&read, &buffer = in_strip[k % 2], ry0, ry1]
+            {
+                trace_span span{"read strip", "io"};
+                return read(ry0, ry1 - ry0, buffer.data());
+            });
+        };
+
+        std::future<bool> loading = load(0), writing;
+        std::array<cl_event, 2> computed = {}, downloaded = {};      // last use of each slot
+        size_t tiles = 0;
+
+        for(int k = 0; k < strips && status == CL_SUCCESS; ++k)
+        {
+            int y0, y1, ry0, ry1;
+            strip_rows(k, y0, y1, ry0, ry1);
+            if(!loading.get()){ status = CL_INVALID_VALUE; break; }
+            // The other input strip was last uploaded from in strip k - 1, which has finished
+            if(k + 1 < strips) loading = load(k + 1);
+
+            unsigned char* in  = in_strip[k % 2].data();
+            unsigned char* out = out_strip[k % 2].data();
+            for(int x0 = 0; x0 < w && status == CL_SUCCESS; x0 += int(tw), ++tiles)
+            {
+                const int x1 = std::min(w, x0 + int(tw));
+                const int rx0 = std::max(0, x0 - R), rx1 = std::min(w, x1 + R);
+                const int rw = rx1 - rx0, rh = ry1 - ry0;
+                const int slot = int(tiles % 2);
+
+                // Upload once the previous kernel on this slot has read its source
+                cl_event up = nullptr, done = nullptr, down = nullptr;
+                {
+                    size_t buffer_origin[3] = { 0, 0, 0 };
+                    size_t host_origin[3]   = { size_t(rx0) * 4, 0, 0 };
+                    size_t region[3]        = { size_t(rw) * 4, size_t(rh), 1 };
+                    status = clEnqueueWriteBufferRect(queues_[0], src[slot], false, buffer_origin, host_origin, region,
+                                                      size_t(rw) * 4, 0, row_bytes, 0, in,
+                                                      computed[slot] ? 1 : 0, computed[slot] ? &computed[slot] : nullptr, &up);
+                }
+                // Compute once the tile is up and the previous download from this slot is done
+                if(status == CL_SUCCESS)
+                {
+                    cl_mem s = src[slot], d = dst[slot];
+                    status = clSetKernelArg(kernel_, 0, sizeof(s), &s);
+                    if(status == CL_SUCCESS) status = clSetKernelArg(kernel_, 1, sizeof(d), &d);
+                    if(status == CL_SUCCESS) status = clSetKernelArg(kernel_, 2, sizeof(rw), &rw);
+                    if(status == CL_SUCCESS) status = clSetKernelArg(kernel_, 3, sizeof(rh), &rh);
+
+                    const size_t step = std::max<size_t>(local_, 1);
+                    size_t global[2] = { (rw + step - 1) / step * step, (rh + step - 1) / step * step };
+                    size_t local[2]  = { local_, local_ };
+                    cl_event waits[2] = { up, downloaded[slot] };
+                    if(status == CL_SUCCESS)
+                        status = clEnqueueNDRangeKernel(queues_[1], kernel_, 2, nullptr, global, local_ ? local : nullptr,
+                                                        downloaded[slot] ? 2 : 1, waits, &done);
+                }
+                // Read back the interior only
+                if(status == CL_SUCCESS)
+                {
+                    size_t buffer_origin[3] = { size_t(x0 - rx0) * 4, size_t(y0 - ry0), 0 };
+                    size_t host_origin[3]   = { size_t(x0) * 4, 0, 0 };
+                    size_t region[3]        = { size_t(x1 - x0) * 4, size_t(y1 - y0), 1 };
+                    status = clEnqueueReadBufferRect(queues_[2], dst[slot], false, buffer_origin, host_origin, region,
+                                                     size_t(rw) * 4, 0, row_bytes, 0, out, 1, &done, &down);
+                }
+                for(auto q : queues_) if(status == CL_SUCCESS) status = clFlush(q);
+
+                trace_device(clocks_[0], up, "tile upload", lane + 0);
+                trace_device(clocks_[1], done, "tile kernel", lane + 1);
+                trace_device(clocks_[2], down, "tile download", lane + 2);
+                if(up) clReleaseEvent(up);
+                if(computed[slot]) clReleaseEvent(computed[slot]);
+                if(downloaded[slot]) clReleaseEvent(downloaded[slot]);
+                computed[slot] = done;
+                downloaded[slot] = down;
+            }
+            if(status != CL_SUCCESS) break;
+
+            // The strip is complete once its downloads are; the writer runs
+            // while the next strip computes, into the other output strip
+            cl_event last[2];
+            cl_uint count = 0;
+            for(auto e : downloaded) if(e) last[count++] = e;
+            status = clWaitForEvents(count, last);
+            if(status != CL_SUCCESS) break;
+            if(writing.valid() && !writing.get()){ status = CL_INVALID_VALUE; break; }
+            writing = std::async(std::launch::async, [&write, out, y0, y1]
+            {
+                trace_span span{"write strip", "io"};
+                return write(y0, y1 - y0, out);
+            });
+        }
+        if(writing.valid() && !writing.get() && status == CL_SUCCESS) status = CL_INVALID_VALUE;
+        if(loading.valid()) loading.wait();
+
+        for(auto e : computed) if(e) clReleaseEvent(e);
+        for(auto e : downloaded) if(e) clReleaseEvent(e);
+        release();
+
+        if(stats)
+        {
+            stats->tiles = tiles;
+            stats->strips = size_t(strips);
+            stats->host_bytes = (in_strip[0].size() + out_strip[0].size()) * 2;
+            stats->device_bytes = region_bytes * 4;
+            stats->seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+        }
+        return status;
+    }
+
+private:
+    static constexpr int lane = 4;      // after the queue of texture.cpp and the batch queues
+
+    cl_context context_;
+    cl_kernel kernel_;
+    int radius_;
+    size_t local_;
+    size_t tile_w_ = 2048, tile_h_ = 2048;
+    std::array<cl_command_queue, 3> queues_ = {};     // upload, compute, download
+    std::array<device_clock, 3> clocks_;
+};
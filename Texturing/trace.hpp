@@ -0,0 +1,323 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __APPLE__ //Mac OSX has a different name for the header file
+#include <OpenCL/opencl.h>
+#else
+#include <CL/opencl.h>
+#endif
+
+// Timeline of host and device activity in the Chrome trace event format,
+// open the file in https://ui.perfetto.dev or chrome://tracing.
+//
+// Recording is switched on by the TRACE_FILE environment variable (the
+// path of the JSON written at exit); otherwise every span is a single
+// branch. When on, a span costs two steady_clock reads and an append to a
+// buffer of the calling thread, so it can stay enabled in real runs.
+//
+//   trace_span span{ "upload", "copy" };          // host, until end of scope
+//   device_clock clock{ queue };                  // once per queue
+//   trace_device(clock, event, "sobel", 0);       // kernel on device lane 0
+//
+// Device spans come from the CL_PROFILING_COMMAND_START/END timestamps of
+// the event (the queue needs CL_QUEUE_PROFILING_ENABLE) and are recorded
+// from a completion callback, so tracing never waits for the device.
+class tracer
+{
+public:
+    static tracer& get()
+    {
+        static tracer instance;
+        return instance;
+    }
+
+    bool enabled() const { return enabled_; }
+
+    // Nanoseconds since the tracer was created, on the steady clock
+    std::int64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin_).count();
+    }
+
+    // Span [start, end) on the calling thread, with an optional numeric argument
+    void complete(char const* name, char const* cat, std::int64_t start, std::int64_t end,
+                  char const* arg_name = nullptr, std::int64_t arg = 0)
+    {
+        record({ name, cat, start, end - start, arg_name, arg, host_pid, 0 });
+    }
+
+    // Span on device lane 'lane' (one lane per queue or kind of work)
+    void device(int lane, char const* name, char const* cat, std::int64_t start, std::int64_t end)
+    {
+        record({ name, cat, start, end - start, nullptr, 0, device_pid, lane });
+    }
+
+    void name_thread(std::string name)
+    {
+        auto& b = local();
+        std::lock_guard<std::mutex> lock{ b.mutex };
+        b.name = std::move(name);
+    }
+
+    void name_lane(int lane, std::string name)
+    {
+        std::lock_guard<std::mutex> lock{ registry_ };
+        for (auto& l : lanes_)
+            if (l.first == lane) { l.second = std::move(name); return; }
+        lanes_.emplace_back(lane, std::move(name));
+    }
+
+    // Device completion callbacks still in flight
+    std::atomic<int>& pending() { return pending_; }
+
+    bool write(std::string const& path)
+    {
+        // Give outstanding completion callbacks a moment to land
+        for (int i = 0; i < 1000 && pending_.load() > 0; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        std::FILE* out = std::fopen(path.c_str(), "w");
+        if (!out) return false;
+
+        std::lock_guard<std::mutex> lock{ registry_ };
+        std::size_t count = 0;
+        std::fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        std::fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"host\"}}", host_pid);
+        std::fprintf(out, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"OpenCL device\"}}", device_pid);
+        for (auto const& lane : lanes_)
+        {
+            std::fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", device_pid, lane.first);
+            quoted(out, lane.second.c_str());
+            std::fprintf(out, "}}");
+        }
+        for (auto const& b : buffers_)
+        {
+            std::lock_guard<std::mutex> buffer_lock{ b->mutex };
+            if (!b->name.empty())
+            {
+                std::fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", host_pid, b->tid);
+                quoted(out, b->name.c_str());
+                std::fprintf(out, "}}");
+            }
+            for (auto const& e : b->events)
+            {
+                std::fprintf(out, ",\n{\"name\":");
+                quoted(out, e.name);
+                std::fprintf(out, ",\"cat\":");
+                quoted(out, e.cat);
+                std::fprintf(out, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                             e.pid, e.pid == host_pid ? b->tid : e.lane, e.start * 1e-3, e.duration * 1e-3);
+                if (e.arg_name)
+                {
+                    std::fprintf(out, ",\"args\":{");
+                    quoted(out, e.arg_name);
+                    std::fprintf(out, ":%lld}", static_cast<long long>(e.arg));
+                }
+                std::fprintf(out, "}");
+                ++count;
+            }
+        }
+        std::fprintf(out, "\n]}\n");
+        std::fclose(out);
+        std::fprintf(stderr, "Trace of %zu spans written to %s\n", count, path.c_str());
+        return true;
+    }
+
+    ~tracer()
+    {
+        if (enabled_) write(path_);
+    }
+
+private:
+    static constexpr int host_pid = 1, device_pid = 2;
+
+    struct event
+    {
+        char const* name;
+        char const* cat;
+        std::int64_t start, duration;
+        char const* arg_name;
+        std::int64_t arg;
+        int pid, lane;
+    };
+
+    // One per thread: appends only contend with write()
+    struct buffer
+    {
+        std::mutex mutex;
+        std::vector<event> events;
+        std::string name;
+        int tid;
+    };
+
+    tracer() : origin_{ std::chrono::steady_clock::now() }
+    {
+        if (char const* path = std::getenv("TRACE_FILE"))
+        {
+            path_ = path;
+            enabled_ = !path_.empty();
+        }
+    }
+
+    buffer& local()
+    {
+        thread_local buffer* mine = nullptr;
+        if (!mine)
+        {
+            std::lock_guard<std::mutex> lock{ registry_ };
+            buffers_.push_back(std::make_unique<buffer>());
+            mine = buffers_.back().get();
+            mine->tid = static_cast<int>(buffers_.size());
+            mine->events.reserve(1024);
+        }
+        return *mine;
+    }
+
+    void record(event const& e)
+    {
+        if (!enabled_) return;
+        auto& b = local();
+        std::lock_guard<std::mutex> lock{ b.mutex };
+        b.events.push_back(e);
+    }
+
+    static void quoted(std::FILE* out, char const* text)
+    {
+        std::fputc('"', out);
+        for (char const* c = text ? text : ""; *c; ++c)
+        {
+            if (*c == '"' || *c == '\\') std::fputc('\\', out);
+            if (static_cast<unsigned char>(*c) >= 0x20) std::fputc(*c, out);
+        }
+        std::fputc('"', out);
+    }
+
+    std::chrono::steady_clock::time_point origin_;
+    bool enabled_ = false;
+    std::string path_;
+    std::mutex registry_;
+    std::vector<std::unique_ptr<buffer>> buffers_;
+    std::vector<std::pair<int, std::string>> lanes_;
+    std::atomic<int> pending_{ 0 };
+};
+
+// Host span from construction to the end of the scope
+class trace_span
+{
+public:
+    explicit trace_span(char const* name, char const* cat = "host")
+        : name_{ name }, cat_{ cat }, start_{ tracer::get().enabled() ? tracer::get().now() : 0 } {}
+
+    ~trace_span()
+    {
+        auto& t = tracer::get();
+        if (t.enabled()) t.complete(name_, cat_, start_, t.now(), arg_name_, arg_);
+    }
+
+    // Shown in the span's details, e.g. arg("bytes", n)
+    void arg(char const* name, std::int64_t value) { arg_name_ = name; arg_ = value; }
+
+    trace_span(trace_span const&) = delete;
+    trace_span& operator=(trace_span const&) = delete;
+
+private:
+    char const* name_;
+    char const* cat_;
+    std::int64_t start_;
+    char const* arg_name_ = nullptr;
+    std::int64_t arg_ = 0;
+};
+
+// Offset between the profiling clock of a device and the tracer clock.
+// A marker is enqueued between two host clock reads; its QUEUED timestamp
+// was taken inside that window, so the midpoint maps one clock to the
+// other within half the (shortest of several) enqueue calls.
+class device_clock
+{
+public:
+    device_clock() = default;
+
+    explicit device_clock(cl_command_queue queue)
+    {
+        auto& t = tracer::get();
+        if (!t.enabled()) return;
+
+        std::int64_t best_window = INT64_MAX;
+        for (int i = 0; i < 5; ++i)
+        {
+            cl_event marker;
+            auto before = t.now();
+            if (clEnqueueMarkerWithWaitList(queue, 0, nullptr, &marker) != CL_SUCCESS) return;
+            auto after = t.now();
+
+            cl_ulong queued = 0;
+            cl_int status = clWaitForEvents(1, &marker);
+            if (status == CL_SUCCESS)
+                status = clGetEventProfilingInfo(marker, CL_PROFILING_COMMAND_QUEUED, sizeof(queued), &queued, nullptr);
+            clReleaseEvent(marker);
+            if (status != CL_SUCCESS || queued == 0) return;   // no profiling on this queue
+
+            if (after - before < best_window)
+            {
+                best_window = after - before;
+                offset_ = (before + after) / 2 - static_cast<std::int64_t>(queued);
+                valid_ = true;
+            }
+        }
+    }
+
+    bool valid() const { return valid_; }
+    std::int64_t to_host(cl_ulong device_ns) const { return static_cast<std::int64_t>(device_ns) + offset_; }
+
+private:
+    std::int64_t offset_ = 0;
+    bool valid_ = false;
+};
+
+struct trace_pending_event
+{
+    device_clock clock;
+    char const* name;
+    char const* cat;
+    int lane;
+};
+
+inline void CL_CALLBACK trace_event_complete(cl_event event, cl_int status, void* user_data)
+{
+    std::unique_ptr<trace_pending_event> p{ static_cast<trace_pending_event*>(user_data) };
+    cl_ulong start = 0, end = 0;
+    if (status == CL_COMPLETE &&
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(start), &start, nullptr) == CL_SUCCESS &&
+        clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(end), &end, nullptr) == CL_SUCCESS)
+        tracer::get().device(p->lane, p->name, p->cat, p->clock.to_host(start), p->clock.to_host(end));
+    clReleaseEvent(event);
+    --tracer::get().pending();
+}
+
+// Records the execution of 'event' on device lane 'lane' once it completes.
+// 'name' and 'cat' must outlive the program run (string literals).
+inline void trace_device(device_clock const& clock, cl_event event, char const* name, int lane = 0, char const* cat = "device")
+{
+    auto& t = tracer::get();
+    if (!t.enabled() || !clock.valid() || event == nullptr) return;
+
+    auto* p = new trace_pending_event{ clock, name, cat, lane };
+    clRetainEvent(event);
+    ++t.pending();
+    if (clSetEventCallback(event, CL_COMPLETE, trace_event_complete, p) != CL_SUCCESS)
+    {
+        clReleaseEvent(event);
+        --t.pending();
+        delete p;
+    }
+}
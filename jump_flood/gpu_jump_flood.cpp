@@ -22,30 +22,45 @@
 
 #include <CL/cl2.hpp>
 
+#include "aligned_allocator.hpp"
+#include "trace.hpp"
+#include "image_io.hpp"
+
 
 struct rawcolor { unsigned char r, g, b, a; };
 struct rawcolor3{ unsigned char r, g, b; };
 struct color    { float         r, g, b, a; };
 struct point    { unsigned int seed; int x,y; };
 
-int main()
+int main(int argc, char* argv[])
 {
     static const std::string input_filename   = "../../Texturing/input.png";
 
+    // gpu_jump_flood [--format png|ppm|pam|pfm|qoi] for the start image
+    std::string start_format = "png";
+    for(int i = 1; i < argc; ++i)
+        if(std::string(argv[i]) == "--format" && i + 1 < argc) start_format = argv[++i];
+    const std::string start_path = "../../jump_flood/results/start." + start_format;
+    if(format_of(start_path) == image_format::unknown){ std::cout << "Unknown output format: " << start_format << "\n"; return -1; }
+
     // dimensions
     const int w  = 64;
     const int h = 64;
     const int n_seed = 8;
     const unsigned int rnd_seed = 201;
 
+    tracer& trace = tracer::get();
+    trace.name_thread("main");
+
     // Initialize seeds:
-    std::vector<point> map(w*h);
+    std::vector<point, huge_page_allocator<point>> map(w*h);
     std::vector<point> seeds(n_seed);
 
     std::vector<color> seed_colors(n_seed);
-    std::vector<color> colormap(w*h);
+    std::vector<color, huge_page_allocator<color>> colormap(w*h);
     std::vector<rawcolor> output_img(w*h);
 
+    auto trace_start = trace.now();
     std::mt19937 mersenne_engine{rnd_seed};  // Generates random integers
     // generate seed colors
     std::uniform_real_distribution<float> dist{0, 1};
@@ -71,8 +86,10 @@ int main()
                                                 seedxyz.y = dist_h(mersenne_engine);
                                                 return seedxyz; };
     generate(seeds.begin(), seeds.end(), gen_seed);
+    trace.complete("generate seeds", "host", trace_start, trace.now());
 
     // fill the map with seeds and colors
+    trace_start = trace.now();
     for (int row_i = 0; row_i < w; row_i++){
         for (int col_i = 0; col_i < h; col_i++){
                 colormap[(row_i*w) + col_i].r = 0.0f;
@@ -96,19 +113,30 @@ int main()
 
     }
 
+    trace.complete("fill map", "host", trace_start, trace.now());
+
     std::cout << "Seed random positions and colors are generated.\n";
     std::cout << " seed  x   y   R     G       B   \n";
     for (int i = 0; i <n_seed; i++){
         std::printf(" %3d  %3d %3d  %5.2f %5.2f %5.2f\n",i+1,seeds[i].x,seeds[i].y,seed_colors[i].r*255.0f,seed_colors[i].g*255.0f,seed_colors[i].b*255.0f);
     }
 
+    trace_start = trace.now();
     std::transform(colormap.cbegin(), colormap.cend(), output_img.begin(),
             [](color c){ return rawcolor{   (unsigned char)(c.r*255.0f),
                                             (unsigned char)(c.g*255.0f),
                                             (unsigned char)(c.b*255.0f),
                                             (unsigned char)(1.0f*255.0f) }; } );
 
-    int res = stbi_write_png("../../jump_flood/results/start.png", w, h, 4, output_img.data(), w*4);
+    trace.complete("color conversion", "host", trace_start, trace.now());
+
+    trace_start = trace.now();
+    encode_statistics written;
+    if(write_image(start_path, w, h, &output_img.data()->r, {}, &written))
+        std::cout << "Start image written to " << start_path << describe_encode(written, w, h) << "\n";
+    else
+        std::cout << "Error writing start image to file\n";
+    trace.complete("encode start image", "io", trace_start, trace.now());
 
     // OpenCL init:
 	cl_int status = CL_SUCCESS;
@@ -187,7 +215,9 @@ int main()
 	auto program = clCreateProgramWithSource(context, 1, &sourcePtr, &sourceSize, &status);
     if(status != CL_SUCCESS){ std::cout << "Cannot create program: " << status << "\n"; return -1; }
 
+    trace_start = trace.now();
 	status = clBuildProgram(program, 1, &device, "", nullptr, nullptr);
+    trace.complete("build program", "opencl", trace_start, trace.now());
 	if (status != CL_SUCCESS)
 	{
         std::cout << "Cannot build program: " << status << "\n";
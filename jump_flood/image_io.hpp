@@ -0,0 +1,497 @@
+#pragma once
+
+#include <zlib.h>
+
+#include <array>
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <future>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+
+// Writers for interleaved RGBA8 images. PNG is compressed with zlib in
+// row bands on several threads: each band is filtered and deflated on its
+// own, primed with the last 32 KiB of the band before it as dictionary,
+// and ended with a sync flush, so the bands concatenate into one valid
+// zlib stream whose Adler-32 is combined from the per-band sums. The
+// result reads like any other PNG and compresses within a fraction of a
+// percent of a single-threaded encoder.
+//
+// PPM, PAM and PFM are uncompressed and QOI is a fast linear pass, cut
+// into independent chunks for large images, for intermediate outputs
+// where encode time matters more than size. QOI also reads back, chunked
+// files in parallel.
+
+enum class image_format { unknown, png, ppm, pam, pfm, qoi };
+
+struct encode_options
+{
+    int level = 6;                  // zlib level for PNG, 0 (stored) .. 9
+    int threads = 0;                // PNG bands, QOI chunks; 0: one per hardware thread
+};
+
+struct encode_statistics
+{
+    double seconds;                 // encoding and writing
+    size_t bytes;                   // file size
+};
+
+inline char const* format_name(image_format f)
+{
+    switch(f)
+    {
+        case image_format::png: return "PNG";
+        case image_format::ppm: return "PPM";
+        case image_format::pam: return "PAM";
+        case image_format::pfm: return "PFM";
+        case image_format::qoi: return "QOI";
+        default:                return "unknown";
+    }
+}
+
+// From the extension of 'path', case-insensitive
+inline image_format format_of(std::string const& path)
+{
+    auto dot = path.find_last_of('.');
+    if(dot == std::string::npos) return image_format::unknown;
+    std::string ext = path.substr(dot + 1);
+    for(auto& c : ext) c = (char)std::tolower((unsigned char)c);
+    if(ext == "png") return image_format::png;
+    if(ext == "ppm") return image_format::ppm;
+    if(ext == "pam") return image_format::pam;
+    if(ext == "pfm") return image_format::pfm;
+    if(ext == "qoi") return image_format::qoi;
+    return image_format::unknown;
+}
+
+namespace image_io_detail
+{
+    using bytes = std::vector<unsigned char>;
+
+    inline void put32(bytes& out, uint32_t v)
+    {
+        unsigned char b[4] = { (unsigned char)(v >> 24), (unsigned char)(v >> 16), (unsigned char)(v >> 8), (unsigned char)v };
+        out.insert(out.end(), b, b + 4);
+    }
+
+    inline void put(bytes& out, std::string const& text) { out.insert(out.end(), text.begin(), text.end()); }
+
+    // body(part, first, last) over [0, n) cut into 'parts' contiguous ranges
+    template<typename F>
+    void parallel_parts(int n, int parts, F body)
+    {
+        parts = std::max(1, std::min(n, parts));
+        std::vector<std::future<void>> futures(parts);
+        for(int k = 0; k < parts; ++k) futures[k] = std::async(std::launch::async, body, k, k * n / parts, (k + 1) * n / parts);
+        for(auto& f : futures) f.get();
+    }
+
+    inline int thread_count(int threads)
+    {
+        return threads > 0 ? threads : std::max(1, (int)std::thread::hardware_concurrency());
+    }
+
+    inline void png_chunk(bytes& out, char const* type, unsigned char const* data, size_t len)
+    {
+        put32(out, (uint32_t)len);
+        out.insert(out.end(), type, type + 4);
+        if(len) out.insert(out.end(), data, data + len);
+        uint32_t crc = (uint32_t)crc32(0, reinterpret_cast<unsigned char const*>(type), 4);
+        if(len) crc = (uint32_t)crc32(crc, data, (uInt)len);
+        put32(out, crc);
+    }
+
+    inline int paeth(int a, int b, int c)
+    {
+        int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+    }
+
+    // One scanline with its filter type byte in front. Level 0 stores rows
+    // unfiltered; otherwise the filter with the smallest sum of absolute
+    // signed residuals wins, the usual libpng heuristic.
+    inline void filter_row(unsigned char const* row, unsigned char const* prev, size_t n, int level, unsigned char* out, unsigned char* scratch)
+    {
+        if(level == 0){ out[0] = 0; std::memcpy(out + 1, row, n); return; }
+
+        unsigned best_sum = ~0u;
+        for(int type = 0; type < 5; ++type)
+        {
+            unsigned sum = 0;
+            for(size_t i = 0; i < n; ++i)
+            {
+                int a = i >= 4 ? row[i - 4] : 0, b = prev ? prev[i] : 0, c = prev && i >= 4 ? prev[i - 4] : 0;
+                int predicted = type == 0 ? 0 : type == 1 ? a : type == 2 ? b : type == 3 ? (a + b) / 2 : paeth(a, b, c);
+                scratch[i] = (unsigned char)(row[i] - predicted);
+                sum += (unsigned)std::abs((int)(signed char)scratch[i]);
+            }
+            if(sum < best_sum){ best_sum = sum; out[0] = (unsigned char)type; std::memcpy(out + 1, scratch, n); }
+        }
+    }
+
+    inline bytes encode_png(int w, int h, unsigned char const* rgba, encode_options const& options)
+    {
+        const size_t pitch = size_t(w) * 4, line = pitch + 1;
+        const int level = std::min(std::max(options.level, 0), 9);
+        bytes filtered(line * h);
+
+        // Bands of at least 256 KiB of scanlines, so short images stay whole
+        const int threads = thread_count(options.threads);
+        const int bands = (int)std::max<size_t>(1, std::min<size_t>(threads, filtered.size() / (256 << 10)));
+
+        parallel_parts(h, threads, [&](int, int y0, int y1)
+        {
+            std::vector<unsigned char> scratch(pitch);
+            for(int y = y0; y < y1; ++y)
+                filter_row(rgba + y * pitch, y ? rgba + (y - 1) * pitch : nullptr, pitch, level, &filtered[y * line], scratch.data());
+        });
+
+        std::vector<bytes> deflated(bands);
+        std::vector<uLong> adlers(bands), lengths(bands);
+        std::atomic<bool> ok{true};
+        parallel_parts(h, bands, [&](int k, int y0, int y1)
+        {
+            unsigned char* in = &filtered[y0 * line];
+            const size_t len = (y1 - y0) * line;
+            adlers[k] = adler32(adler32(0, nullptr, 0), in, (uInt)len);
+            lengths[k] = (uLong)len;
+
+            z_stream z = {};
+            if(deflateInit2(&z, level, Z_DEFLATED, -15, 8, level ? Z_FILTERED : Z_DEFAULT_STRATEGY) != Z_OK){ ok = false; return; }
+            if(k > 0)
+            {
+                const size_t dict = std::min<size_t>(y0 * line, 32768);
+                deflateSetDictionary(&z, in - dict, (uInt)dict);
+            }
+            bytes& out = deflated[k];
+            out.resize(deflateBound(&z, (uLong)len) + 16);
+            z.next_in = in;
+            z.avail_in = (uInt)len;
+            z.next_out = out.data();
+            z.avail_out = (uInt)out.size();
+            int res = deflate(&z, k + 1 == bands ? Z_FINISH : Z_SYNC_FLUSH);
+            if(res != (k + 1 == bands ? Z_STREAM_END : Z_OK) || z.avail_in != 0) ok = false;
+            out.resize(z.total_out);
+            deflateEnd(&z);
+        });
+        if(!ok) return {};
+
+        uLong adler = adlers[0];
+        for(int k = 1; k < bands; ++k) adler = adler32_combine(adler, adlers[k], (z_off_t)lengths[k]);
+
+        bytes png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        bytes header;
+        put32(header, (uint32_t)w);
+        put32(header, (uint32_t)h);
+        header.insert(header.end(), { 8, 6, 0, 0, 0 });             // 8 bit RGBA, deflate, adaptive filters, no interlace
+        png_chunk(png, "IHDR", header.data(), header.size());
+
+        // One IDAT per band: the zlib header opens the first, the Adler-32
+        // closes the last
+        const int flevel = level < 2 ? 0 : level < 6 ? 1 : level == 6 ? 2 : 3;
+        unsigned char zhead[2] = { 0x78, (unsigned char)(flevel << 6) };
+        zhead[1] += (unsigned char)(31 - (zhead[0] * 256 + zhead[1]) % 31);
+        for(int k = 0; k < bands; ++k)
+        {
+            bytes& data = deflated[k];
+            if(k == 0) data.insert(data.begin(), zhead, zhead + 2);
+            if(k + 1 == bands) put32(data, (uint32_t)adler);
+            png_chunk(png, "IDAT", data.data(), data.size());
+        }
+        png_chunk(png, "IEND", nullptr, 0);
+        return png;
+    }
+
+    inline bytes encode_ppm(int w, int h, unsigned char const* rgba)
+    {
+        bytes out;
+        put(out, "P6\n" + std::to_string(w) + " " + std::to_string(h) + "\n255\n");
+        size_t offset = out.size();
+        out.resize(offset + size_t(w) * h * 3);
+        for(size_t i = 0; i < size_t(w) * h; ++i) std::memcpy(&out[offset + 3 * i], rgba + 4 * i, 3);
+        return out;
+    }
+
+    inline bytes encode_pam(int w, int h, unsigned char const* rgba)
+    {
+        bytes out;
+        put(out, "P7\nWIDTH " + std::to_string(w) + "\nHEIGHT " + std::to_string(h) + "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n");
+        out.insert(out.end(), rgba, rgba + size_t(w) * h * 4);
+        return out;
+    }
+
+    // Color in [0, 1], little-endian floats (negative scale), bottom row first
+    inline bytes encode_pfm(int w, int h, unsigned char const* rgba)
+    {
+        bytes out;
+        put(out, "PF\n" + std::to_string(w) + " " + std::to_string(h) + "\n-1.0\n");
+        size_t offset = out.size();
+        out.resize(offset + size_t(w) * h * 3 * sizeof(float));
+        for(int y = 0; y < h; ++y)
+            for(int x = 0; x < w; ++x)
+                for(int c = 0; c < 3; ++c)
+                {
+                    float v = rgba[(size_t(h - 1 - y) * w + x) * 4 + c] * (1.0f / 255.0f);
+                    uint32_t bits;
+                    std::memcpy(&bits, &v, 4);
+                    unsigned char* o = &out[offset + ((size_t(y) * w + x) * 3 + c) * 4];
+                    o[0] = (unsigned char)bits; o[1] = (unsigned char)(bits >> 8); o[2] = (unsigned char)(bits >> 16); o[3] = (unsigned char)(bits >> 24);
+                }
+        return out;
+    }
+
+    inline uint32_t get32(unsigned char const* p) { return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3]; }
+
+    constexpr unsigned char qoi_end[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    constexpr size_t qoi_header = 14;
+    constexpr size_t qoi_chunk_pixels = 64 << 10;   // smallest chunk worth a thread
+
+    inline int qoi_hash(unsigned char const* p) { return (p[0] * 3 + p[1] * 5 + p[2] * 7 + p[3] * 11) % 64; }
+
+    // QOI ops for pixels [0, n), appended to 'out'. Only index slots
+    // written by these ops are referenced, and with 'restart' the first
+    // pixel is spelled out in full, so a chunk of ops decodes the same
+    // after any other chunk as from a fresh decoder state.
+    inline void qoi_ops(unsigned char const* rgba, size_t n, bool restart, bytes& out)
+    {
+        std::array<uint32_t, 64> index = {};
+        uint64_t written = 0;
+        unsigned char prev[4] = { 0, 0, 0, 255 };
+        int run = 0;
+        for(size_t i = 0; i < n; ++i)
+        {
+            unsigned char const* p = rgba + 4 * i;
+            const bool first = restart && i == 0;
+            if(!first && std::memcmp(p, prev, 4) == 0)
+            {
+                if(++run == 62){ out.push_back(0xC0 | 61); run = 0; }
+                continue;
+            }
+            if(run){ out.push_back((unsigned char)(0xC0 | (run - 1))); run = 0; }
+
+            uint32_t v;
+            std::memcpy(&v, p, 4);
+            int slot = qoi_hash(p);
+            if((written >> slot & 1) && index[slot] == v) out.push_back((unsigned char)slot);
+            else
+            {
+                index[slot] = v;
+                written |= uint64_t(1) << slot;
+                if(!first && p[3] == prev[3])
+                {
+                    int dr = (signed char)(p[0] - prev[0]), dg = (signed char)(p[1] - prev[1]), db = (signed char)(p[2] - prev[2]);
+                    int dr_dg = dr - dg, db_dg = db - dg;
+                    if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                        out.push_back((unsigned char)(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                    else if(dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+                    {
+                        out.push_back((unsigned char)(0x80 | (dg + 32)));
+                        out.push_back((unsigned char)((dr_dg + 8) << 4 | (db_dg + 8)));
+                    }
+                    else out.insert(out.end(), { 0xFE, p[0], p[1], p[2] });
+                }
+                else out.insert(out.end(), { 0xFF, p[0], p[1], p[2], p[3] });
+            }
+            std::memcpy(prev, p, 4);
+        }
+        if(run) out.push_back((unsigned char)(0xC0 | (run - 1)));
+    }
+
+    // Pixels [0, n) as RGBA8 from the ops in [p, end); false if they run out
+    inline bool qoi_decode_ops(unsigned char const* p, unsigned char const* end, size_t n, unsigned char* dst)
+    {
+        std::array<uint32_t, 64> index = {};
+        unsigned char px[4] = { 0, 0, 0, 255 };
+        size_t i = 0;
+        while(i < n)
+        {
+            if(p >= end) return false;
+            const unsigned char op = *p++;
+            size_t run = 1;
+            if(op == 0xFE)
+            {
+                if(end - p < 3) return false;
+                std::memcpy(px, p, 3);
+                p += 3;
+            }
+            else if(op == 0xFF)
+            {
+                if(end - p < 4) return false;
+                std::memcpy(px, p, 4);
+                p += 4;
+            }
+            else switch(op >> 6)
+            {
+                case 0: std::memcpy(px, &index[op], 4); break;
+                case 1:
+                    px[0] += ((op >> 4) & 3) - 2;
+                    px[1] += ((op >> 2) & 3) - 2;
+                    px[2] += (op & 3) - 2;
+                    break;
+                case 2:
+                {
+                    if(p >= end) return false;
+                    const int dg = (op & 63) - 32, rb = *p++;
+                    px[0] += dg - 8 + (rb >> 4);
+                    px[1] += dg;
+                    px[2] += dg - 8 + (rb & 15);
+                    break;
+                }
+                default: run = (op & 63) + 1; break;
+            }
+            std::memcpy(&index[qoi_hash(px)], px, 4);
+            for(run = std::min(run, n - i); run; --run, ++i) std::memcpy(dst + 4 * i, px, 4);
+        }
+        return true;
+    }
+
+    // One chunk per thread for large images: the chunks are plain QOI ops,
+    // readable by any decoder in sequence, and a table after the end
+    // marker lets this decoder start at each of them.
+    //
+    //   ops ... end marker, offset of chunk 0 .. count - 1 (uint64 each,
+    //   from the start of the file), count (uint32), "qoic"
+    //
+    // Chunk k covers pixels [k n / count, (k + 1) n / count).
+    inline bytes encode_qoi(int w, int h, unsigned char const* rgba, encode_options const& options)
+    {
+        const size_t n = size_t(w) * h;
+        const int chunks = (int)std::max<size_t>(1, std::min<size_t>(thread_count(options.threads), n / qoi_chunk_pixels));
+
+        bytes out = { 'q', 'o', 'i', 'f' };
+        put32(out, (uint32_t)w);
+        put32(out, (uint32_t)h);
+        out.insert(out.end(), { 4, 0 });                            // RGBA, sRGB
+        if(chunks == 1)
+        {
+            out.reserve(out.size() + n + 8);
+            qoi_ops(rgba, n, false, out);
+            out.insert(out.end(), qoi_end, qoi_end + 8);
+            return out;
+        }
+
+        std::vector<bytes> parts(chunks);
+        parallel_parts(chunks, chunks, [&](int k, int, int)
+        {
+            const size_t first = k * n / chunks, last = (k + 1) * n / chunks;
+            parts[k].reserve(last - first);
+            qoi_ops(rgba + 4 * first, last - first, k > 0, parts[k]);
+        });
+
+        std::vector<uint64_t> offsets;
+        for(auto& part : parts)
+        {
+            offsets.push_back(out.size());
+            out.insert(out.end(), part.begin(), part.end());
+        }
+        out.insert(out.end(), qoi_end, qoi_end + 8);
+        for(uint64_t offset : offsets){ put32(out, uint32_t(offset >> 32)); put32(out, uint32_t(offset)); }
+        put32(out, (uint32_t)chunks);
+        put(out, "qoic");
+        return out;
+    }
+
+    // Chunk offsets from the table of a chunked file, with the end of the
+    // last chunk appended; empty for plain or inconsistent files
+    inline std::vector<uint64_t> qoi_chunks(unsigned char const* data, size_t size)
+    {
+        if(size < qoi_header + 16 || std::memcmp(data + size - 4, "qoic", 4) != 0) return {};
+        const uint64_t count = get32(data + size - 8), table = 8 + 8 * count;
+        if(count == 0 || size < qoi_header + 8 + table) return {};
+        const size_t marker = size - table - 8;
+        if(std::memcmp(data + marker, qoi_end, 8) != 0) return {};
+
+        std::vector<uint64_t> offsets;
+        for(uint64_t k = 0; k < count; ++k)
+        {
+            unsigned char const* e = data + marker + 8 + 8 * k;
+            offsets.push_back(uint64_t(get32(e)) << 32 | get32(e + 4));
+        }
+        offsets.push_back(marker);
+        if(offsets[0] != qoi_header || !std::is_sorted(offsets.begin(), offsets.end())) return {};
+        return offsets;
+    }
+}
+
+// The whole file in memory; empty on failure or for image_format::unknown
+inline std::vector<unsigned char> encode_image(image_format format, int w, int h, unsigned char const* rgba, encode_options const& options = {})
+{
+    using namespace image_io_detail;
+    switch(format)
+    {
+        case image_format::png: return encode_png(w, h, rgba, options);
+        case image_format::ppm: return encode_ppm(w, h, rgba);
+        case image_format::pam: return encode_pam(w, h, rgba);
+        case image_format::pfm: return encode_pfm(w, h, rgba);
+        case image_format::qoi: return encode_qoi(w, h, rgba, options);
+        default:                return {};
+    }
+}
+
+// Format from the extension of 'path'; false if unknown or on I/O errors
+inline bool write_image(std::string const& path, int w, int h, unsigned char const* rgba,
+                        encode_options const& options = {}, encode_statistics* stats = nullptr)
+{
+    if(stats) *stats = {};
+    auto t0 = std::chrono::high_resolution_clock::now();
+    auto data = encode_image(format_of(path), w, h, rgba, options);
+    if(data.empty()) return false;
+
+    std::ofstream file(path, std::ios::binary);
+    bool ok = bool(file.write(reinterpret_cast<char const*>(data.data()), std::streamsize(data.size())));
+    if(stats) *stats = { std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count(), data.size() };
+    return ok;
+}
+
+// RGBA8 pixels of a QOI file in memory, on up to 'threads' threads (0: one
+// per hardware thread) when it carries a chunk table; empty on errors
+inline std::vector<unsigned char> decode_qoi(unsigned char const* data, size_t size, int* w, int* h, int threads = 0)
+{
+    using namespace image_io_detail;
+    if(size < qoi_header + 8 || std::memcmp(data, "qoif", 4) != 0 || (data[12] != 3 && data[12] != 4)) return {};
+    *w = (int)get32(data + 4);
+    *h = (int)get32(data + 8);
+    const size_t n = size_t(get32(data + 4)) * get32(data + 8);
+    if(*w <= 0 || *h <= 0 || n > (size_t(400) << 20)) return {};
+
+    std::vector<unsigned char> rgba(n * 4);
+    auto chunks = qoi_chunks(data, size);
+    if(chunks.empty())
+        return qoi_decode_ops(data + qoi_header, data + size - 8, n, rgba.data()) ? rgba : std::vector<unsigned char>{};
+
+    const int count = (int)chunks.size() - 1;
+    std::atomic<bool> ok{true};
+    parallel_parts(count, thread_count(threads), [&](int, int k0, int k1)
+    {
+        for(int k = k0; k < k1; ++k)
+        {
+            const size_t first = k * n / count, last = (k + 1) * n / count;
+            if(!qoi_decode_ops(data + chunks[k], data + chunks[k + 1], last - first, rgba.data() + 4 * first)) ok = false;
+        }
+    });
+    return ok ? rgba : std::vector<unsigned char>{};
+}
+
+inline std::vector<unsigned char> read_qoi(std::string const& path, int* w, int* h, int threads = 0)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::vector<unsigned char> data{ std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    return decode_qoi(data.data(), data.size(), w, h, threads);
+}
+
+// ", 12.3 ms (4.56 ms/MP), 7.8 MiB" for printing after a file name
+inline std::string describe_encode(encode_statistics const& stats, int w, int h)
+{
+    char text[96];
+    std::snprintf(text, sizeof(text), ", %.1f ms (%.2f ms/MP), %.2f MiB",
+                  stats.seconds * 1e3, stats.seconds * 1e3 / (double(w) * h * 1e-6), stats.bytes / 1048576.0);
+    return text;
+}
@@ -18,6 +18,10 @@
 #include <stdio.h>
 #include <vector>
 
+#include "perf_counter.hpp"
+#include "roofline.hpp"
+#include "trace.hpp"
+
 using namespace std;
 
 /*=================================================================================================
@@ -148,9 +152,18 @@ void ExecuteJumpFlooding( void ) {
 	Point* RBuffer;
 	Point* WBuffer;
 
+	// Count cycles, instructions and LLC misses of the rounds
+	// (wall time only unless built with PERF_COUNTERS)
+	perf_counters counters;
+	counters.start();
+	int rounds = 0;
+
 	// Carry out the rounds of Jump Flooding
 	while( step >= 1 ) {
 
+		trace_span round_span( "jump flood round", "cpu" );
+		round_span.arg( "step", step );
+
 		// Set which buffers we'll be using
 		if( ReadingBufferA == true ) {
 			RBuffer = BufferA;
@@ -231,11 +244,19 @@ void ExecuteJumpFlooding( void ) {
 
 		// Halve the step.
 		step /= 2;
+		++rounds;
 
 		// Swap the buffers for the next round
 		ReadingBufferA = !ReadingBufferA;
 
 	}
+
+	perf_sample perf = counters.stop();
+	// Per round every point is read and written once (the neighbours mostly
+	// hit the cache) and up to 9 distances of 5 flops are compared
+	const double points = (double)BufferWidth * BufferHeight * rounds;
+	printf( "Jump Flooding took %.3f ms%s%s\n", perf.ms, describe( perf ).c_str(),
+	        describe_roofline( "host", points * 2 * sizeof( Point ), points * 9 * 5, perf.ms * 1e-3 ).c_str() );
 }
 
 // Renders the next frame and puts it on the display
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <chrono>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+// One hardware or software event of this process, counted in user space
+// via perf_event_open. Threads started after start() are included, so the
+// std::async workers of the parallel loops are counted too. Where the
+// event is not supported (no PMU in a VM, perf_event_paranoid > 2, not
+// Linux) available() is false and value() stays 0.
+class perf_counter
+{
+public:
+    perf_counter(std::uint32_t type, std::uint64_t config)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fd_ = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+        (void)type; (void)config;
+#endif
+    }
+
+    ~perf_counter()
+    {
+#ifdef __linux__
+        if (fd_ >= 0) ::close(fd_);
+#endif
+    }
+
+    perf_counter(perf_counter&& other) noexcept : fd_{ other.fd_ } { other.fd_ = -1; }
+    perf_counter(perf_counter const&) = delete;
+    perf_counter& operator=(perf_counter const&) = delete;
+
+#ifdef __linux__
+    static perf_counter dtlb_load_misses()
+    {
+        return { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                     (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) };
+    }
+    static perf_counter page_faults() { return { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS }; }
+#endif
+
+    bool available() const { return fd_ >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd_ < 0) return;
+        ::ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ::ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    void stop()
+    {
+#ifdef __linux__
+        if (fd_ >= 0) ::ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+
+    // Scaled up when the kernel had to multiplex the event
+    std::uint64_t value() const
+    {
+#ifdef __linux__
+        std::uint64_t data[3] = { 0, 0, 0 };   // value, time enabled, time running
+        if (fd_ < 0 || ::read(fd_, data, sizeof(data)) != static_cast<ssize_t>(sizeof(data)) || data[2] == 0)
+            return 0;
+        return data[2] == data[1] ? data[0]
+                                  : static_cast<std::uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+#else
+        return 0;
+#endif
+    }
+
+private:
+    int fd_ = -1;
+};
+
+// Cycles, instructions and last level cache misses of a region, printed
+// beside the wall time to tell compute-bound loops (high IPC, little
+// traffic) from bandwidth-bound ones (low IPC, GB/s near the memory
+// bandwidth). Bytes from memory are estimated as one 64 byte line per LLC
+// miss. The counters are only opened when built with PERF_COUNTERS
+// (cmake -DPERF_COUNTERS=ON); otherwise only the wall time is taken and
+// describe() returns an empty string.
+struct perf_sample
+{
+    double ms;
+    std::uint64_t cycles, instructions, llc_misses;
+
+    double ipc() const { return cycles == 0 ? 0.0 : static_cast<double>(instructions) / cycles; }
+    double bytes() const { return 64.0 * llc_misses; }
+};
+
+class perf_counters
+{
+public:
+#if defined(PERF_COUNTERS) && defined(__linux__)
+    perf_counters()
+        : cycles_{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+          instructions_{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+          llc_misses_{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }
+    {}
+
+    static constexpr bool enabled = true;
+    bool available() const { return cycles_.available() || instructions_.available() || llc_misses_.available(); }
+
+    void start()
+    {
+        cycles_.start(); instructions_.start(); llc_misses_.start();
+        start_ = std::chrono::steady_clock::now();
+    }
+
+    perf_sample stop()
+    {
+        auto end = std::chrono::steady_clock::now();
+        cycles_.stop(); instructions_.stop(); llc_misses_.stop();
+        return { std::chrono::duration<double, std::milli>(end - start_).count(),
+                 cycles_.value(), instructions_.value(), llc_misses_.value() };
+    }
+
+private:
+    perf_counter cycles_, instructions_, llc_misses_;
+    std::chrono::steady_clock::time_point start_;
+#else
+    static constexpr bool enabled = false;
+    bool available() const { return false; }
+    void start() { start_ = std::chrono::steady_clock::now(); }
+
+    perf_sample stop()
+    {
+        auto end = std::chrono::steady_clock::now();
+        return { std::chrono::duration<double, std::milli>(end - start_).count(), 0, 0, 0 };
+    }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+#endif
+};
+
+// Counts while in scope, stores the sample on exit
+class perf_scope
+{
+public:
+    perf_scope(perf_counters& counters, perf_sample& out) : counters_{ counters }, out_{ out } { counters_.start(); }
+    ~perf_scope() { out_ = counters_.stop(); }
+
+    perf_scope(perf_scope const&) = delete;
+    perf_scope& operator=(perf_scope const&) = delete;
+
+private:
+    perf_counters& counters_;
+    perf_sample& out_;
+};
+
+// ", 1.2e+09 cycles, 3.4e+09 instr, IPC 2.83, 1.0e+06 LLC misses, ~64 MB from memory (3.2 GB/s)"
+inline std::string describe(perf_sample const& s)
+{
+    if (!perf_counters::enabled) return {};
+    if (s.cycles == 0 && s.instructions == 0 && s.llc_misses == 0) return ", counters not available";
+
+    char text[256];
+    std::snprintf(text, sizeof(text), ", %.3g cycles, %.3g instr, IPC %.2f, %.3g LLC misses, ~%.1f MB from memory (%.2f GB/s)",
+                  static_cast<double>(s.cycles), static_cast<double>(s.instructions), s.ipc(),
+                  static_cast<double>(s.llc_misses), s.bytes() * 1e-6, s.ms > 0.0 ? s.bytes() / (s.ms * 1e6) : 0.0);
+    return text;
+}
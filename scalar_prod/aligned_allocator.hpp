@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <limits>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// Allocators for large host buffers, usable as std::vector<T, A>.
+//
+// aligned_allocator<T, Align>: heap memory aligned to 'Align' bytes, 64 for
+// full cache lines (no split SIMD loads), 4096 for whole pages (eligible
+// for zero-copy CL_MEM_USE_HOST_PTR on most drivers).
+//
+// huge_page_allocator<T, Kind>: requests of at least 2 MiB are mapped
+// directly, 2 MiB aligned and rounded, so one TLB entry covers 512 times
+// more of the vector. 'transparent' asks the kernel for transparent huge
+// pages (madvise), 'explicit_first' tries the hugetlbfs pool first and
+// falls back to transparent ones when it is empty. Smaller requests, and
+// systems without these interfaces, get cache-line aligned heap memory.
+
+template<typename T, std::size_t Align = 64>
+class aligned_allocator
+{
+    static_assert(Align >= alignof(T) && (Align & (Align - 1)) == 0, "Alignment must be a power of two");
+
+public:
+    using value_type = T;
+
+    template<typename U>
+    struct rebind { using other = aligned_allocator<U, Align>; };
+
+    aligned_allocator() noexcept = default;
+    template<typename U>
+    aligned_allocator(aligned_allocator<U, Align> const&) noexcept {}
+
+    T* allocate(std::size_t n)
+    {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) throw std::bad_array_new_length{};
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t{ Align }));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept
+    {
+        ::operator delete(p, std::align_val_t{ Align });
+    }
+};
+
+template<typename T, typename U, std::size_t Align>
+bool operator==(aligned_allocator<T, Align> const&, aligned_allocator<U, Align> const&) noexcept { return true; }
+template<typename T, typename U, std::size_t Align>
+bool operator!=(aligned_allocator<T, Align> const&, aligned_allocator<U, Align> const&) noexcept { return false; }
+
+enum class huge_pages { transparent, explicit_first };
+
+template<typename T, huge_pages Kind = huge_pages::transparent>
+class huge_page_allocator
+{
+public:
+    using value_type = T;
+
+    static constexpr std::size_t huge_page = std::size_t{ 2 } << 20;
+
+    template<typename U>
+    struct rebind { using other = huge_page_allocator<U, Kind>; };
+
+    huge_page_allocator() noexcept = default;
+    template<typename U>
+    huge_page_allocator(huge_page_allocator<U, Kind> const&) noexcept {}
+
+    T* allocate(std::size_t n)
+    {
+        if (n > (std::numeric_limits<std::size_t>::max() - huge_page) / sizeof(T)) throw std::bad_array_new_length{};
+        const auto bytes = n * sizeof(T);
+        if (!mapped(bytes)) return small_.allocate(n);
+
+#ifdef __linux__
+        const auto length = rounded(bytes);
+        void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        if (Kind == huge_pages::explicit_first)
+            p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) return static_cast<T*>(p);
+#endif
+        // Over-map by one huge page, then cut the unaligned head and tail
+        p = ::mmap(nullptr, length + huge_page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc{};
+
+        const auto raw = reinterpret_cast<std::uintptr_t>(p);
+        const auto aligned = (raw + huge_page - 1) & ~(huge_page - 1);
+        if (aligned != raw) ::munmap(p, aligned - raw);
+        ::munmap(reinterpret_cast<void*>(aligned + length), raw + huge_page - aligned);
+
+#ifdef MADV_HUGEPAGE
+        ::madvise(reinterpret_cast<void*>(aligned), length, MADV_HUGEPAGE);
+#endif
+        return reinterpret_cast<T*>(aligned);
+#else
+        return small_.allocate(n);
+#endif
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        const auto bytes = n * sizeof(T);
+#ifdef __linux__
+        if (mapped(bytes)) { ::munmap(p, rounded(bytes)); return; }
+#endif
+        small_.deallocate(p, n);
+    }
+
+private:
+    static bool mapped(std::size_t bytes) { return bytes >= huge_page; }
+    static std::size_t rounded(std::size_t bytes) { return (bytes + huge_page - 1) & ~(huge_page - 1); }
+
+    aligned_allocator<T, 64> small_;
+};
+
+template<typename T, typename U, huge_pages Kind>
+bool operator==(huge_page_allocator<T, Kind> const&, huge_page_allocator<U, Kind> const&) noexcept { return true; }
+template<typename T, typename U, huge_pages Kind>
+bool operator!=(huge_page_allocator<T, Kind> const&, huge_page_allocator<U, Kind> const&) noexcept { return false; }
@@ -0,0 +1,132 @@
+// Level-1 BLAS kernels. Every '_partial' kernel reduces a tile of
+// 2 * local_size elements into back[group_id] in the same pass that
+// touches the vectors, so the partials can be finished by 'reduce'.
+// Requires 'op' (declared in scalar_prod.cl) and a power of two local size.
+
+void group_reduce(local float* shared,
+                  global float* back,
+                  float v0,
+                  float v1)
+{
+    const size_t lid = get_local_id(0),
+                 lsi = get_local_size(0);
+
+    shared[lid] = v0;
+    shared[lid + lsi] = v1;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (size_t i = lsi; i != 0; i /= 2)
+    {
+        if (lid < i)
+            shared[lid] = op(shared[lid], shared[lid + i]);
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+    if (lid == 0) back[get_group_id(0)] = shared[0];
+}
+
+// Index of the two elements owned by the work-item
+#define FIRST  (get_group_id(0) * get_local_size(0) * 2 + get_local_id(0))
+#define SECOND (FIRST + get_local_size(0))
+
+// y = alpha * x + y
+kernel void axpy(float alpha,
+                 global const float* x,
+                 global float* y,
+                 unsigned int length)
+{
+    const size_t gid = get_global_id(0);
+    if (gid < length) y[gid] = alpha * x[gid] + y[gid];
+}
+
+// partial sums of x * y
+kernel void dot_partial(global const float* x,
+                        global const float* y,
+                        global float* back,
+                        local float* shared,
+                        unsigned int length,
+                        float zero_elem)
+{
+    const size_t i0 = FIRST, i1 = SECOND;
+    group_reduce(shared, back,
+                 i0 < length ? x[i0] * y[i0] : zero_elem,
+                 i1 < length ? x[i1] * y[i1] : zero_elem);
+}
+
+// partial sums of x * x, the host takes the square root
+kernel void nrm2_partial(global const float* x,
+                         global float* back,
+                         local float* shared,
+                         unsigned int length,
+                         float zero_elem)
+{
+    const size_t i0 = FIRST, i1 = SECOND;
+    group_reduce(shared, back,
+                 i0 < length ? x[i0] * x[i0] : zero_elem,
+                 i1 < length ? x[i1] * x[i1] : zero_elem);
+}
+
+// partial sums of |x|
+kernel void asum_partial(global const float* x,
+                         global float* back,
+                         local float* shared,
+                         unsigned int length,
+                         float zero_elem)
+{
+    const size_t i0 = FIRST, i1 = SECOND;
+    group_reduce(shared, back,
+                 i0 < length ? fabs(x[i0]) : zero_elem,
+                 i1 < length ? fabs(x[i1]) : zero_elem);
+}
+
+// y = alpha * x + y, then partial sums of y * z from registers
+kernel void axpy_dot_partial(float alpha,
+                             global const float* x,
+                             global float* y,
+                             global const float* z,
+                             global float* back,
+                             local float* shared,
+                             unsigned int length,
+                             float zero_elem)
+{
+    const size_t i0 = FIRST, i1 = SECOND;
+    float v0 = zero_elem, v1 = zero_elem;
+    if (i0 < length) { const float y0 = alpha * x[i0] + y[i0]; y[i0] = y0; v0 = y0 * z[i0]; }
+    if (i1 < length) { const float y1 = alpha * x[i1] + y[i1]; y[i1] = y1; v1 = y1 * z[i1]; }
+    group_reduce(shared, back, v0, v1);
+}
+
+// y = alpha * x + y, then partial sums of y * y (residual update + norm)
+kernel void axpy_nrm2_partial(float alpha,
+                              global const float* x,
+                              global float* y,
+                              global float* back,
+                              local float* shared,
+                              unsigned int length,
+                              float zero_elem)
+{
+    const size_t i0 = FIRST, i1 = SECOND;
+    float v0 = zero_elem, v1 = zero_elem;
+    if (i0 < length) { const float y0 = alpha * x[i0] + y[i0]; y[i0] = y0; v0 = y0 * y0; }
+    if (i1 < length) { const float y1 = alpha * x[i1] + y[i1]; y[i1] = y1; v1 = y1 * y1; }
+    group_reduce(shared, back, v0, v1);
+}
+
+// Dot products of many vectors packed back to back, every one starting on
+// a tile boundary. tile_end[group_id] is the end of the vector owning the
+// tile, so elements past it are treated as padding.
+kernel void batched_dot_partial(global const float* x,
+                                global const float* y,
+                                global const unsigned int* tile_end,
+                                global float* back,
+                                local float* shared,
+                                float zero_elem)
+{
+    const size_t i0 = FIRST, i1 = SECOND;
+    const unsigned int end = tile_end[get_group_id(0)];
+    group_reduce(shared, back,
+                 i0 < end ? x[i0] * y[i0] : zero_elem,
+                 i1 < end ? x[i1] * y[i1] : zero_elem);
+}
+
+#undef FIRST
+#undef SECOND
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <CL/cl2.hpp>
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <cstddef>
+#include <algorithm>
+
+// Recycles device buffers between kernel launches and calls. Requests are
+// rounded up to a size class (four steps per power of two, at most 25%
+// slack) and a released buffer waits in the free list of its class and
+// memory flags until someone asks for that class again. Buffers are thus
+// larger than requested: kernels must take the length as an argument.
+class buffer_pool
+{
+public:
+    struct statistics
+    {
+        std::size_t acquires;
+        std::size_t hits;               // served from a free list
+        std::size_t bytes_in_use;       // by live handles, in size classes
+        std::size_t peak_in_use;
+        std::size_t bytes_reserved;     // allocated on the device, free or not
+        std::size_t peak_reserved;
+
+        double hit_rate() const { return acquires == 0 ? 0.0 : static_cast<double>(hits) / acquires; }
+    };
+
+    // Returns its buffer to the pool when destroyed
+    class handle
+    {
+    public:
+        handle() = default;
+        handle(handle&& other) noexcept { swap(other); }
+        handle& operator=(handle&& other) noexcept { handle{ std::move(other) }.swap(*this); return *this; }
+        ~handle() { if (pool_) pool_->release(flags_, bytes_, std::move(buffer_)); }
+
+        cl::Buffer& operator*() { return buffer_; }
+        cl::Buffer const& operator*() const { return buffer_; }
+        cl::Buffer* operator->() { return &buffer_; }
+        std::size_t capacity() const { return bytes_; }
+
+        void swap(handle& other) noexcept
+        {
+            std::swap(pool_, other.pool_);
+            std::swap(flags_, other.flags_);
+            std::swap(bytes_, other.bytes_);
+            std::swap(buffer_, other.buffer_);
+        }
+
+    private:
+        friend class buffer_pool;
+        handle(buffer_pool* pool, cl_mem_flags flags, std::size_t bytes, cl::Buffer buffer)
+            : pool_{ pool }, flags_{ flags }, bytes_{ bytes }, buffer_{ std::move(buffer) } {}
+
+        buffer_pool* pool_ = nullptr;
+        cl_mem_flags flags_ = 0;
+        std::size_t bytes_ = 0;
+        cl::Buffer buffer_;
+    };
+
+    explicit buffer_pool(cl::Context context) : context_{ std::move(context) } {}
+
+    buffer_pool(buffer_pool const&) = delete;
+    buffer_pool& operator=(buffer_pool const&) = delete;
+
+    // Handles must not outlive the pool
+    ~buffer_pool() = default;
+
+    // Size class of a request: 4 KiB granularity below 16 KiB, then
+    // 2^k, 1.25 * 2^k, 1.5 * 2^k, 1.75 * 2^k
+    static std::size_t size_class(std::size_t bytes)
+    {
+        const std::size_t page = 4096;
+        if (bytes <= 4 * page) return std::max<std::size_t>((bytes + page - 1) / page, 1) * page;
+
+        std::size_t pow = 4 * page;
+        while (pow * 2 < bytes) pow *= 2;
+        const std::size_t step = pow / 4;
+        return (bytes + step - 1) / step * step;
+    }
+
+    handle acquire(std::size_t bytes, cl_mem_flags flags = CL_MEM_READ_WRITE)
+    {
+        const auto cls = size_class(bytes);
+        cl::Buffer buffer;
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            ++stats_.acquires;
+            auto it = free_.find({ flags, cls });
+            if (it != free_.end() && !it->second.empty())
+            {
+                ++stats_.hits;
+                buffer = std::move(it->second.back());
+                it->second.pop_back();
+                use(cls);
+                return handle{ this, flags, cls, std::move(buffer) };
+            }
+        }
+
+        // Miss: allocate outside the lock, the driver may take a while
+        buffer = cl::Buffer{ context_, flags, cls };
+
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        stats_.bytes_reserved += cls;
+        stats_.peak_reserved = std::max(stats_.peak_reserved, stats_.bytes_reserved);
+        use(cls);
+        return handle{ this, flags, cls, std::move(buffer) };
+    }
+
+    // Frees every buffer not held by a handle
+    void trim()
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        for (auto& bucket : free_)
+        {
+            stats_.bytes_reserved -= bucket.first.second * bucket.second.size();
+            bucket.second.clear();
+        }
+    }
+
+    statistics stats() const
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        return stats_;
+    }
+
+private:
+    void use(std::size_t cls)
+    {
+        stats_.bytes_in_use += cls;
+        stats_.peak_in_use = std::max(stats_.peak_in_use, stats_.bytes_in_use);
+    }
+
+    void release(cl_mem_flags flags, std::size_t cls, cl::Buffer buffer)
+    {
+        std::lock_guard<std::mutex> lock{ mutex_ };
+        stats_.bytes_in_use -= cls;
+        free_[{ flags, cls }].push_back(std::move(buffer));
+    }
+
+    cl::Context context_;
+    mutable std::mutex mutex_;
+    std::map<std::pair<cl_mem_flags, std::size_t>, std::vector<cl::Buffer>> free_;
+    statistics stats_{ 0, 0, 0, 0, 0, 0 };
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include <future>
+#include <thread>
+#include <numeric>
+#include <cmath>
+
+// Split [0, size) evenly among the hardware threads and sum up what
+// 'body(start, end)' returns for every chunk
+template<typename F>
+double cpu_parallel_sum(int size, F body)
+{
+    int n = std::thread::hardware_concurrency();
+    std::vector<std::future<double>> futures(n);
+
+    for ( int k=0; k<n; ++k )
+    {
+        int start = k     * size / n;
+        int end   = (k+1) * size / n;
+        futures[k] = std::async(std::launch::async, body, start, end);
+    }
+
+    return std::accumulate(
+                futures.begin(),futures.end(),0.0,
+                [](double acc, std::future<double>& f){return acc+ f.get();}
+                );
+}
+
+// y = alpha * x + y
+template<typename T>
+void cpu_axpy_parallel(T alpha, std::vector<T> const& X, std::vector<T>& Y)
+{
+    cpu_parallel_sum(static_cast<int>(X.size()), [&](int start, int end)
+    {
+        for ( int i = start; i < end; ++i) Y[i] = alpha * X[i] + Y[i];
+        return 0.0;
+    });
+}
+
+template<typename T>
+double cpu_dot_parallel(std::vector<T> const& X, std::vector<T> const& Y)
+{
+    return cpu_parallel_sum(static_cast<int>(X.size()), [&](int start, int end)
+    {
+        double sum = 0.0;
+        for ( int i = start; i < end; ++i) sum += X[i] * Y[i];
+        return sum;
+    });
+}
+
+template<typename T>
+double cpu_nrm2_parallel(std::vector<T> const& X)
+{
+    return std::sqrt(cpu_dot_parallel(X, X));
+}
+
+template<typename T>
+double cpu_asum_parallel(std::vector<T> const& X)
+{
+    return cpu_parallel_sum(static_cast<int>(X.size()), [&](int start, int end)
+    {
+        double sum = 0.0;
+        for ( int i = start; i < end; ++i) sum += std::abs(X[i]);
+        return sum;
+    });
+}
+
+// y = alpha * x + y; returns dot(y, z) computed from the same pass
+template<typename T>
+double cpu_axpy_dot_parallel(T alpha, std::vector<T> const& X, std::vector<T>& Y, std::vector<T> const& Z)
+{
+    return cpu_parallel_sum(static_cast<int>(X.size()), [&](int start, int end)
+    {
+        double sum = 0.0;
+        for ( int i = start; i < end; ++i)
+        {
+            T y = alpha * X[i] + Y[i];
+            Y[i] = y;
+            sum += y * Z[i];
+        }
+        return sum;
+    });
+}
+
+// y = alpha * x + y; returns ||y|| computed from the same pass
+template<typename T>
+double cpu_axpy_nrm2_parallel(T alpha, std::vector<T> const& X, std::vector<T>& Y)
+{
+    return std::sqrt(cpu_parallel_sum(static_cast<int>(X.size()), [&](int start, int end)
+    {
+        double sum = 0.0;
+        for ( int i = start; i < end; ++i)
+        {
+            T y = alpha * X[i] + Y[i];
+            Y[i] = y;
+            sum += y * y;
+        }
+        return sum;
+    }));
+}
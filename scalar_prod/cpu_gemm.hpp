@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vector>
+#include <future>
+#include <thread>
+#include <algorithm>
+
+// Row-major matrices stored in std::vector.
+// A is M x K, B is K x N, C is M x N; for gemv A is rows x cols.
+
+template<typename T>
+void cpu_gemm_naive(std::vector<T> const& A, std::vector<T> const& B, std::vector<T>& C, int M, int N, int K)
+{
+    for(int i=0; i<M; ++i)
+        for(int j=0; j<N; ++j)
+        {
+            double c = 0.0;
+            for(int k=0; k<K; ++k)
+                c += A[i*K + k] * B[k*N + j];
+            C[i*N + j] = static_cast<T>(c);
+        }
+}
+
+// Cache-blocked, threaded gemm. Every thread owns a band of rows of C.
+// Inside a band the k and j ranges are blocked so that a KC x NC panel of
+// B stays in cache while it is reused for every row of the band; the
+// innermost loop runs along a row of B and C and is vectorized.
+template<typename T>
+void cpu_gemm_parallel(std::vector<T> const& A, std::vector<T> const& B, std::vector<T>& C, int M, int N, int K)
+{
+    static const int KC = 256;  // rows of the B panel
+    static const int NC = 512;  // columns of the B panel
+
+    int n = std::thread::hardware_concurrency();
+    std::vector<std::future<void>> futures(n);
+
+    auto band = [&](int start, int end)
+    {
+        std::fill(C.begin() + start * N, C.begin() + end * N, T{});
+        for (int k0 = 0; k0 < K; k0 += KC)
+        {
+            int k1 = std::min(k0 + KC, K);
+            for (int j0 = 0; j0 < N; j0 += NC)
+            {
+                int j1 = std::min(j0 + NC, N);
+                for (int i = start; i < end; ++i)
+                {
+                    T* c = C.data() + i * N;
+                    for (int k = k0; k < k1; ++k)
+                    {
+                        const T a = A[i*K + k];
+                        const T* b = B.data() + k * N;
+                        for (int j = j0; j < j1; ++j)
+                            c[j] += a * b[j];
+                    }
+                }
+            }
+        }
+    };
+
+    for ( int k=0; k<n; ++k )
+        futures[k] = std::async(std::launch::async, band, k * M / n, (k+1) * M / n);
+    for (auto& f : futures) f.get();
+}
+
+template<typename T>
+void cpu_gemv_naive(std::vector<T> const& A, std::vector<T> const& x, std::vector<T>& y, int rows, int cols)
+{
+    for(int i=0; i<rows; ++i)
+    {
+        double c = 0.0;
+        for(int j=0; j<cols; ++j)
+            c += A[i*cols + j] * x[j];
+        y[i] = static_cast<T>(c);
+    }
+}
+
+// Threaded gemv over bands of rows; the dot product of every row
+// accumulates into independent lanes so it is vectorized
+template<typename T>
+void cpu_gemv_parallel(std::vector<T> const& A, std::vector<T> const& x, std::vector<T>& y, int rows, int cols)
+{
+    static const int lanes = 8;
+
+    int n = std::thread::hardware_concurrency();
+    std::vector<std::future<void>> futures(n);
+
+    auto band = [&](int start, int end)
+    {
+        int body = cols - cols % lanes;
+        for (int i = start; i < end; ++i)
+        {
+            const T* a = A.data() + static_cast<std::size_t>(i) * cols;
+            T acc[lanes] = {};
+            for (int j = 0; j < body; j += lanes)
+                for (int l = 0; l < lanes; ++l)
+                    acc[l] += a[j + l] * x[j + l];
+
+            T c = T{};
+            for (int l = 0; l < lanes; ++l) c += acc[l];
+            for (int j = body; j < cols; ++j) c += a[j] * x[j];
+            y[i] = c;
+        }
+    };
+
+    for ( int k=0; k<n; ++k )
+        futures[k] = std::async(std::launch::async, band, k * rows / n, (k+1) * rows / n);
+    for (auto& f : futures) f.get();
+}
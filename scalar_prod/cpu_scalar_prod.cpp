@@ -2,10 +2,12 @@
 #include <random>
 #include <numeric>
 #include <future>
+#include <algorithm>
 #include <iostream>
 
 #include "tmark.hpp"
 #include "cpu_scalar_prod.hpp"
+#include "perf_counter.hpp"
 
 int main(){
 
@@ -21,9 +23,15 @@ int main(){
     generate(A.begin(), A.end(), gen);
     generate(B.begin(), B.end(), gen);
 
+    // Hardware counters (no-op unless built with PERF_COUNTERS)
+    perf_counters counters;
+    perf_sample perf_naive, perf_parallel;
+
     //naive implementation
     auto t0 = tmark();
+    counters.start();
     auto prod = cpu_scalar_prod_naive(A, B, N);
+    perf_naive = counters.stop();
     auto t1 = tmark();
 
     //cpu parallel implementation
@@ -41,6 +49,7 @@ int main(){
     };
 
     auto t0_parallel = tmark();
+    counters.start();
     for ( int k=0; k<n; ++k ) 
     {
         int size = static_cast<int>(A.size());
@@ -53,13 +62,14 @@ int main(){
                         futures.begin(),futures.end(),0.0,
                         [](double acc, std::future<double>& f){return acc+ f.get();}
                         );
+    perf_parallel = counters.stop();
     auto t1_parallel = tmark();
 
     std::cout << "Results of naive:    " << prod          << std::endl; 
     std::cout << "Results of parallel: " << prod_parallel << std::endl; 
     std::cout << "Results of std:      " << std::inner_product(std::begin(A), std::end(A), std::begin(B), 0.0) << std::endl;
-    std::cout << "CPU time of naive    " << delta_time(t0,t1) << " ms\n";
-    std::cout << "CPU time of parallel " << delta_time(t0_parallel,t1_parallel) << " ms" << "; number of threads: " << n << std::endl;
+    std::cout << "CPU time of naive    " << delta_time(t0,t1) << " ms" << describe(perf_naive) << "\n";
+    std::cout << "CPU time of parallel " << delta_time(t0_parallel,t1_parallel) << " ms" << "; number of threads: " << n << describe(perf_parallel) << std::endl;
 
     return 0;
 }
\ No newline at end of file
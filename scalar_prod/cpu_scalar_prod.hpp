@@ -1,8 +1,8 @@
 #include <vector>
 #include <future>
 
-template<typename T>
-auto cpu_scalar_prod_naive(std::vector<T> const& A, std::vector<T> const& B, int N) 
+template<typename T, typename Alloc>
+auto cpu_scalar_prod_naive(std::vector<T, Alloc> const& A, std::vector<T, Alloc> const& B, int N) 
 {  
     auto c = 0.0;
 
@@ -14,14 +14,14 @@ auto cpu_scalar_prod_naive(std::vector<T> const& A, std::vector<T> const& B, int
     return c;
 }
 
-template<typename T>
-auto cpu_scalar_prod_parallel(std::vector<T> const& A, std::vector<T> const& B, int N) 
+template<typename T, typename Alloc>
+auto cpu_scalar_prod_parallel(std::vector<T, Alloc> const& A, std::vector<T, Alloc> const& B, int N) 
 {
     // cpu parallel implementation
     int n = std::thread::hardware_concurrency();
     std::vector<std::future<double>> futures(n);
     
-    auto cpu_scalar_prod_elementary = [](std::vector<T> const& A, std::vector<T> const& B, int start, int end) 
+    auto cpu_scalar_prod_elementary = [](std::vector<T, Alloc> const& A, std::vector<T, Alloc> const& B, int start, int end) 
     {
         double sum = 0.0;
         for ( int i = start; i < end; ++i)
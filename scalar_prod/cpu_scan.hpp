@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <future>
+#include <thread>
+#include <algorithm>
+
+// Reduce [first, last) with 'op'. Independent lanes let the compiler keep
+// the loop in SIMD registers; 'op' must be associative and commutative.
+template<typename T, typename Op>
+T cpu_reduce_lanes(T const* first, T const* last, Op op, T zero)
+{
+    static const int lanes = 8;
+    T acc[lanes];
+    std::fill(acc, acc + lanes, zero);
+
+    auto n = last - first;
+    auto body = n - n % lanes;
+    for (decltype(n) i = 0; i < body; i += lanes)
+        for (int l = 0; l < lanes; ++l)
+            acc[l] = op(acc[l], first[i + l]);
+
+    T res = zero;
+    for (int l = 0; l < lanes; ++l) res = op(res, acc[l]);
+    for (auto i = body; i < n; ++i) res = op(res, first[i]);
+    return res;
+}
+
+// Scan [first, last) into 'out' starting from 'init'
+template<typename T, typename Op>
+void cpu_scan_serial(T const* first, T const* last, T* out, Op op, T init, bool inclusive)
+{
+    T acc = init;
+    if (inclusive)
+        for (; first != last; ++first, ++out) { acc = op(acc, *first); *out = acc; }
+    else
+        for (; first != last; ++first, ++out) { *out = acc; acc = op(acc, *first); }
+}
+
+template<typename T, typename Op>
+void cpu_scan_naive(std::vector<T> const& A, std::vector<T>& B, Op op, T zero, bool inclusive)
+{
+    cpu_scan_serial(A.data(), A.data() + A.size(), B.data(), op, zero, inclusive);
+}
+
+// Reduce-then-scan: every thread reduces its chunk, the chunk totals are
+// scanned serially, then every thread scans its chunk seeded by its prefix.
+template<typename T, typename Op>
+void cpu_scan_parallel(std::vector<T> const& A, std::vector<T>& B, Op op, T zero, bool inclusive)
+{
+    int n = std::thread::hardware_concurrency();
+    int size = static_cast<int>(A.size());
+    std::vector<std::future<T>> sums(n);
+    std::vector<std::future<void>> scans(n);
+
+    auto chunk = [&](int k){ return std::make_pair(k * size / n, (k+1) * size / n); };
+
+    for ( int k=0; k<n; ++k )
+    {
+        auto [start, end] = chunk(k);
+        sums[k] = std::async(std::launch::async, cpu_reduce_lanes<T, Op>, A.data() + start, A.data() + end, op, zero);
+    }
+
+    std::vector<T> offsets(n);
+    T acc = zero;
+    for ( int k=0; k<n; ++k )
+    {
+        offsets[k] = acc;
+        acc = op(acc, sums[k].get());
+    }
+
+    for ( int k=0; k<n; ++k )
+    {
+        auto [start, end] = chunk(k);
+        scans[k] = std::async(std::launch::async, cpu_scan_serial<T, Op>, A.data() + start, A.data() + end, B.data() + start, op, offsets[k], inclusive);
+    }
+    for (auto& f : scans) f.get();
+}
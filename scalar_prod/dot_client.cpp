@@ -0,0 +1,211 @@
+#include <vector>       // std::vector
+#include <deque>        // std::deque
+#include <exception>    // std::runtime_error, std::exception
+#include <iostream>     // std::cout
+#include <fstream>      // std::ofstream
+#include <random>       // std::default_random_engine, std::uniform_real_distribution
+#include <algorithm>    // std::sort
+#include <cstdlib>      // EXIT_FAILURE
+#include <cmath>        // std::abs
+#include <thread>       // std::thread
+#include <mutex>        // std::mutex
+#include <chrono>       // std::chrono
+#include <string>       // std::string
+#include <future>       // std::async
+#include <filesystem>   // std::filesystem::absolute
+#include <cstdio>       // std::remove
+
+//Own
+#include "tmark.hpp"
+#include "dot_protocol.hpp"
+
+// Benchmark client of dot_server. Every client thread opens its own
+// connection and keeps 'depth' requests in flight, either sending the
+// vectors inline or naming ranges of two files the daemon maps.
+//
+//  usage: dot_client [socket path]
+
+struct client_result
+{
+    std::vector<double> latencies_us;
+    double seconds;
+    double bytes;
+    double max_err;
+    std::size_t failures;
+};
+
+client_result run_clients(std::string const& path, bool mapped, std::string const (&files)[2],
+                          int clients, int per_client, int depth,
+                          std::size_t min_len, std::size_t max_len, std::vector<float> const& pool)
+{
+    std::mutex mutex;
+    client_result res{ {}, 0.0, 0.0, 0.0, 0 };
+
+    auto client = [&](int id)
+    {
+        using clock = std::chrono::steady_clock;
+        struct in_flight { clock::time_point start; std::size_t offset, length; };
+
+        const std::size_t half = pool.size() / 2;
+        std::mt19937 rng( static_cast<unsigned>(id) );
+        std::uniform_int_distribution<std::size_t> len_dist{ min_len, max_len };
+        std::uniform_int_distribution<std::size_t> off_dist{ 0, half - max_len };
+
+        std::vector<double> latencies;
+        double bytes = 0.0, max_err = 0.0;
+        std::size_t failures = 0;
+        std::deque<in_flight> window;
+
+        int fd = dot_protocol::connect_to(path);
+
+        auto retire = [&]
+        {
+            dot_protocol::response_header r;
+            if (!dot_protocol::read_all(fd, &r, sizeof(r)))
+                throw std::runtime_error{ "Daemon closed the connection" };
+            std::string message(r.message_bytes, '\0');
+            dot_protocol::read_all(fd, &message[0], message.size());
+
+            auto& f = window.front();
+            latencies.push_back(std::chrono::duration<double, std::micro>(clock::now() - f.start).count());
+
+            if (r.status != 0)
+            {
+                if (failures++ == 0) std::cerr << "Request failed: " << message << std::endl;
+            }
+            else
+            {
+                // Error relative to the sum of magnitudes, robust to near-zero results
+                double ref = 0.0, mag = 0.0;
+                auto a = pool.data() + f.offset, b = a + half;
+                for (std::size_t i = 0; i < f.length; ++i) { ref += a[i] * b[i]; mag += std::abs(a[i] * b[i]); }
+                if (mag > 0.0) max_err = std::max(max_err, std::abs(r.result - ref) / mag);
+            }
+            window.pop_front();
+        };
+
+        try
+        {
+            for (int r = 0; r < per_client; ++r)
+            {
+                if (static_cast<int>(window.size()) == depth) retire();
+
+                auto length = len_dist(rng), offset = off_dist(rng);
+                dot_protocol::request_header h{};
+                h.offset = mapped ? offset : 0;
+                h.length = length;
+
+                window.push_back({ clock::now(), offset, length });
+                if (mapped)
+                {
+                    h.kind = dot_protocol::mapped_files;
+                    h.path_bytes[0] = static_cast<std::uint32_t>(files[0].size());
+                    h.path_bytes[1] = static_cast<std::uint32_t>(files[1].size());
+                    dot_protocol::write_all(fd, &h, sizeof(h));
+                    dot_protocol::write_all(fd, files[0].data(), files[0].size());
+                    dot_protocol::write_all(fd, files[1].data(), files[1].size());
+                }
+                else
+                {
+                    h.kind = dot_protocol::inline_vectors;
+                    dot_protocol::write_all(fd, &h, sizeof(h));
+                    dot_protocol::write_all(fd, pool.data() + offset, length * sizeof(float));
+                    dot_protocol::write_all(fd, pool.data() + half + offset, length * sizeof(float));
+                }
+                bytes += 2.0 * length * sizeof(float);
+            }
+            while (!window.empty()) retire();
+        }
+        catch (...)
+        {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+
+        std::lock_guard<std::mutex> lock{ mutex };
+        res.latencies_us.insert(res.latencies_us.end(), latencies.begin(), latencies.end());
+        res.bytes += bytes;
+        res.max_err = std::max(res.max_err, max_err);
+        res.failures += failures;
+    };
+
+    // Errors of a client thread are rethrown here
+    std::vector<std::future<void>> futures;
+    auto start = tmark();
+    for (int c = 0; c < clients; ++c) futures.push_back(std::async(std::launch::async, client, c));
+    for (auto& f : futures) f.wait();
+    auto end = tmark();
+    for (auto& f : futures) f.get();
+
+    res.seconds = std::chrono::duration<double>(end - start).count();
+    std::sort(res.latencies_us.begin(), res.latencies_us.end());
+    return res;
+}
+
+void report(char const* name, client_result const& res)
+{
+    auto pct = [&](double p){ return res.latencies_us[static_cast<std::size_t>(p * (res.latencies_us.size() - 1))]; };
+
+    std::cout << name << std::endl;
+    std::cout << "  Throughput:           " << res.latencies_us.size() / res.seconds << " req/s, "
+              << res.bytes / res.seconds * 1e-9 << " GB/s" << std::endl;
+    std::cout << "  Latency p50/p95/p99:  " << pct(0.50) << " / " << pct(0.95) << " / " << pct(0.99) << " us" << std::endl;
+    std::cout << "  Latency max:          " << res.latencies_us.back() << " us" << std::endl;
+    std::cout << "  Failed requests:      " << res.failures << std::endl;
+    std::cout << "  Largest error:        " << res.max_err << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string path = argc > 1 ? argv[1] : dot_protocol::default_socket;
+
+    try
+    {
+        // User defined input
+        const int clients = 8, per_client = 1000, depth = 4;
+        const std::size_t min_len = 1 << 10, max_len = 1 << 16;
+
+        // Requests are cut from one random pool: first half x, second half y
+        std::vector<float> pool(2 * (1 << 22));
+        std::mt19937 mersenne_engine{42};  // Generates random integers
+        std::uniform_real_distribution<float> dist{-0.1f, 0.1f};
+        auto gen = [&dist, &mersenne_engine](){ return dist(mersenne_engine); };
+        generate(pool.begin(), pool.end(), gen);
+
+        // The same vectors as files for the mapped requests, absolute paths
+        // since the daemon resolves them from its own working directory
+        auto base = std::filesystem::absolute(path).string();
+        const std::string files[2] = { base + ".x.bin", base + ".y.bin" };
+        for (int v = 0; v < 2; ++v)
+        {
+            std::ofstream out{ files[v], std::ios::binary };
+            out.write(reinterpret_cast<char const*>(pool.data() + v * pool.size() / 2), pool.size() / 2 * sizeof(float));
+            if (!out) throw std::runtime_error{ "Cannot write " + files[v] };
+        }
+
+        std::cout << clients << " clients x " << per_client << " requests, " << depth << " in flight each, "
+                  << min_len << " - " << max_len << " elements, daemon at " << path << std::endl;
+
+        auto res_inline = run_clients(path, false, files, clients, per_client, depth, min_len, max_len, pool);
+        auto res_mapped = run_clients(path, true, files, clients, per_client, depth, min_len, max_len, pool);
+
+        for (auto const& f : files) std::remove(f.c_str());
+
+        std::cout.precision(4);
+        if( res_inline.failures + res_mapped.failures == 0 && std::max(res_inline.max_err, res_mapped.max_err) < 1e-5 )
+            std::cout << "Validation success.\n";
+        else
+            std::cout << "Mismatch in CPU and GPU result.\n";
+
+        report("Vectors sent over the socket:", res_inline);
+        report("Ranges of memory-mapped files:", res_mapped);
+    }
+    catch (std::exception& error) // If STL/CRT error occurs
+    {
+        std::cerr << error.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,332 @@
+#pragma once
+
+#include <CL/cl2.hpp>
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <future>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <string>
+#include <stdexcept>
+#include <utility>
+
+#include "gpu_reduce.hpp"
+#include "trace.hpp"
+
+// Long-lived dot product service. The program, kernel and per-slot device
+// buffers are created once. Requests from any thread are queued, then a
+// dispatcher thread coalesces the queued requests into one batched launch
+// (vectors packed back to back, one tile-aligned segment each). Every slot
+// owns a command queue, so the upload of one batch can overlap the compute
+// and download of the previous one; a completion thread sums the partials
+// of every segment on the host and fulfils the futures.
+class dot_engine
+{
+public:
+    struct options
+    {
+        std::size_t queues = 2;                     // batches in flight, one queue each
+        std::size_t max_batch = 256;                // requests coalesced into one launch
+        std::size_t batch_size = 1 << 22;           // elements a slot holds before growing
+        std::chrono::microseconds linger{ 100 };    // wait for more requests to fill a batch
+    };
+
+    struct statistics
+    {
+        std::size_t requests;
+        std::size_t batches;
+    };
+
+    // 'source' must contain scalar_prod.cl, blas1.cl and the definition of 'op'
+    dot_engine(cl::Context context, cl::Device device, std::string const& source, options opt)
+        : opt_{ opt },
+          context_{ context },
+          device_{ device },
+          program_{ build(context, device, source) },
+          batched_{ program_, "batched_dot_partial" },
+          geo_{ make_reduce_geometry({ batched_.getKernel() }, device) },
+          slots_(opt.queues)
+    {
+        for (std::size_t s = 0; s < slots_.size(); ++s)
+        {
+            // Profiling only when tracing, for the device lanes of the timeline
+            slots_[s].queue = cl::CommandQueue{ context_, device_, static_cast<cl_command_queue_properties>(tracer::get().enabled() ? CL_QUEUE_PROFILING_ENABLE : 0) };
+            slots_[s].clock = device_clock{ slots_[s].queue() };
+            tracer::get().name_lane(static_cast<int>(s), "dot engine queue " + std::to_string(s));
+            reserve(slots_[s], opt_.batch_size);
+            free_.push_back(s);
+        }
+        dispatcher_ = std::thread{ [this]{ dispatch(); } };
+        completer_  = std::thread{ [this]{ complete(); } };
+    }
+
+    dot_engine(cl::Context context, cl::Device device, std::string const& source)
+        : dot_engine(context, device, source, options{})
+    {}
+
+    dot_engine(dot_engine const&) = delete;
+    dot_engine& operator=(dot_engine const&) = delete;
+
+    // Finishes every request submitted so far
+    ~dot_engine()
+    {
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            stopping_ = true;
+        }
+        pending_cv_.notify_all();
+        dispatcher_.join();
+        completer_.join();
+    }
+
+    std::future<double> submit(std::vector<cl_float> a, std::vector<cl_float> b)
+    {
+        if (a.size() != b.size())
+            throw std::invalid_argument{ "dot_engine: vectors differ in length" };
+
+        auto owner = std::make_shared<std::pair<std::vector<cl_float>, std::vector<cl_float>>>(std::move(a), std::move(b));
+        return submit(owner, owner->first.data(), owner->second.data(), owner->first.size());
+    }
+
+    // Zero-copy variant: 'a' and 'b' are read in place (e.g. from a mapped
+    // file) and 'owner' keeps them alive until the upload has finished
+    std::future<double> submit(std::shared_ptr<void const> owner, cl_float const* a, cl_float const* b, std::size_t length)
+    {
+        auto req = std::make_unique<request>();
+        req->owner = std::move(owner);
+        req->a = a;
+        req->b = b;
+        req->length = length;
+        auto res = req->result.get_future();
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            pending_.push_back(std::move(req));
+        }
+        pending_cv_.notify_one();
+        return res;
+    }
+
+    statistics stats() const { return { requests_.load(), batches_.load() }; }
+
+private:
+    struct request
+    {
+        std::shared_ptr<void const> owner;
+        cl_float const* a;
+        cl_float const* b;
+        std::size_t length;
+        std::promise<double> result;
+    };
+
+    struct slot
+    {
+        cl::CommandQueue queue;
+        cl::Buffer x, y, ends, partials;
+        std::size_t capacity = 0;                   // elements
+        std::vector<cl_uint> tile_end;
+        std::vector<cl_float> partial;
+        std::vector<std::size_t> first_tile;        // per request, plus the end
+        std::vector<std::unique_ptr<request>> batch;
+        cl::Event done;
+        device_clock clock;
+    };
+
+    static cl::Program build(cl::Context const& context, cl::Device const& device, std::string const& source)
+    {
+        cl::Program program{ context, source };
+        program.build({ device });
+        return program;
+    }
+
+    std::size_t tiles(request const& r) const { return geo_.new_size(r.length); }
+
+    void reserve(slot& s, std::size_t elements)
+    {
+        if (elements <= s.capacity) return;
+        auto count = geo_.new_size(elements);
+        s.x        = cl::Buffer{ context_, CL_MEM_READ_ONLY,  count * geo_.factor * sizeof(cl_float) };
+        s.y        = cl::Buffer{ context_, CL_MEM_READ_ONLY,  count * geo_.factor * sizeof(cl_float) };
+        s.ends     = cl::Buffer{ context_, CL_MEM_READ_ONLY,  count * sizeof(cl_uint) };
+        s.partials = cl::Buffer{ context_, CL_MEM_WRITE_ONLY, count * sizeof(cl_float) };
+        s.capacity = count * geo_.factor;
+    }
+
+    // Move queued requests into 'batch' while they fit. Returns true once
+    // the batch cannot take the next request.
+    bool take(std::vector<std::unique_ptr<request>>& batch, std::size_t& used)
+    {
+        auto capacity = geo_.new_size(opt_.batch_size);
+        while (!pending_.empty())
+        {
+            if (batch.size() >= opt_.max_batch) return true;
+            auto need = tiles(*pending_.front());
+            if (!batch.empty() && used + need > capacity) return true;
+            used += need;
+            batch.push_back(std::move(pending_.front()));
+            pending_.pop_front();
+        }
+        return batch.size() >= opt_.max_batch || used >= capacity;
+    }
+
+    void dispatch()
+    {
+        tracer::get().name_thread("dot dispatcher");
+        for (;;)
+        {
+            std::vector<std::unique_ptr<request>> batch;
+            {
+                std::unique_lock<std::mutex> lock{ mutex_ };
+                pending_cv_.wait(lock, [this]{ return stopping_ || !pending_.empty(); });
+                if (pending_.empty()) break;
+
+                // Linger briefly so concurrent small requests share a launch
+                std::size_t used = 0;
+                bool full = take(batch, used);
+                auto deadline = std::chrono::steady_clock::now() + opt_.linger;
+                while (!full && !stopping_ &&
+                       pending_cv_.wait_until(lock, deadline, [this]{ return stopping_ || !pending_.empty(); }))
+                    full = take(batch, used);
+            }
+
+            std::size_t s;
+            {
+                std::unique_lock<std::mutex> lock{ mutex_ };
+                free_cv_.wait(lock, [this]{ return !free_.empty(); });
+                s = free_.front();
+                free_.pop_front();
+            }
+
+            auto& sl = slots_[s];
+            sl.batch = std::move(batch);
+            try
+            {
+                trace_span span{ "launch batch", "dot engine" };
+                span.arg("requests", static_cast<std::int64_t>(sl.batch.size()));
+                launch(sl, static_cast<int>(s));
+                std::lock_guard<std::mutex> lock{ mutex_ };
+                inflight_.push_back(s);
+            }
+            catch (...)
+            {
+                for (auto& r : sl.batch) r->result.set_exception(std::current_exception());
+                // Uploads may still read the request vectors
+                try { sl.queue.finish(); } catch (...) {}
+                sl.batch.clear();
+                std::lock_guard<std::mutex> lock{ mutex_ };
+                free_.push_back(s);
+            }
+            inflight_cv_.notify_one();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock{ mutex_ };
+            dispatched_ = true;
+        }
+        inflight_cv_.notify_one();
+    }
+
+    // Non-blocking upload of every request straight from its vectors,
+    // one launch over all tiles, non-blocking download of the partials
+    void launch(slot& sl, int lane)
+    {
+        sl.first_tile.clear();
+        std::size_t total = 0;
+        for (auto const& r : sl.batch)
+        {
+            sl.first_tile.push_back(total);
+            total += tiles(*r);
+        }
+        sl.first_tile.push_back(total);
+        reserve(sl, total * geo_.factor);
+
+        sl.tile_end.resize(total);
+        sl.partial.resize(total);
+        for (std::size_t k = 0; k < sl.batch.size(); ++k)
+        {
+            auto offset = sl.first_tile[k] * geo_.factor, length = sl.batch[k]->length;
+            for (auto t = sl.first_tile[k]; t < sl.first_tile[k + 1]; ++t)
+                sl.tile_end[t] = static_cast<cl_uint>(offset + length);
+
+            if (length == 0) continue;
+            sl.queue.enqueueWriteBuffer(sl.x, CL_FALSE, offset * sizeof(cl_float), length * sizeof(cl_float), sl.batch[k]->a);
+            sl.queue.enqueueWriteBuffer(sl.y, CL_FALSE, offset * sizeof(cl_float), length * sizeof(cl_float), sl.batch[k]->b);
+        }
+
+        if (total == 0)
+            sl.queue.enqueueMarkerWithWaitList(nullptr, &sl.done);
+        else
+        {
+            sl.queue.enqueueWriteBuffer(sl.ends, CL_FALSE, 0, total * sizeof(cl_uint), sl.tile_end.data());
+            auto kernel = batched_(cl::EnqueueArgs{ sl.queue, total * geo_.wgs, geo_.wgs },
+                                   sl.x, sl.y, sl.ends, sl.partials, cl::Local(geo_.factor * sizeof(cl_float)), 0.0f);
+            sl.queue.enqueueReadBuffer(sl.partials, CL_FALSE, 0, total * sizeof(cl_float), sl.partial.data(), nullptr, &sl.done);
+            trace_device(sl.clock, kernel(), "batched_dot_partial", lane);
+            trace_device(sl.clock, sl.done(), "read partials", lane, "copy");
+        }
+        sl.queue.flush();
+    }
+
+    void complete()
+    {
+        tracer::get().name_thread("dot completer");
+        for (;;)
+        {
+            std::size_t s;
+            {
+                std::unique_lock<std::mutex> lock{ mutex_ };
+                inflight_cv_.wait(lock, [this]{ return dispatched_ || !inflight_.empty(); });
+                if (inflight_.empty()) break;
+                s = inflight_.front();
+                inflight_.pop_front();
+            }
+
+            auto& sl = slots_[s];
+            requests_ += sl.batch.size();
+            ++batches_;
+            try
+            {
+                sl.done.wait();
+                trace_span span{ "sum partials", "dot engine" };
+                for (std::size_t k = 0; k < sl.batch.size(); ++k)
+                {
+                    double sum = 0.0;
+                    for (auto t = sl.first_tile[k]; t < sl.first_tile[k + 1]; ++t) sum += sl.partial[t];
+                    sl.batch[k]->result.set_value(sum);
+                }
+            }
+            catch (...)
+            {
+                for (auto& r : sl.batch) r->result.set_exception(std::current_exception());
+            }
+            sl.batch.clear();
+
+            {
+                std::lock_guard<std::mutex> lock{ mutex_ };
+                free_.push_back(s);
+            }
+            free_cv_.notify_one();
+        }
+    }
+
+    options opt_;
+    cl::Context context_;
+    cl::Device device_;
+    cl::Program program_;
+    cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, cl::LocalSpaceArg, cl_float> batched_;
+    reduce_geometry geo_;
+    std::vector<slot> slots_;
+
+    std::mutex mutex_;
+    std::condition_variable pending_cv_, free_cv_, inflight_cv_;
+    std::deque<std::unique_ptr<request>> pending_;
+    std::deque<std::size_t> free_, inflight_;
+    bool stopping_ = false, dispatched_ = false;
+
+    std::atomic<std::size_t> requests_{ 0 }, batches_{ 0 };
+    std::thread dispatcher_, completer_;
+};
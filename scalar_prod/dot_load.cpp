@@ -0,0 +1,188 @@
+#include <CL/cl2.hpp>
+
+#include <vector>       // std::vector
+#include <deque>        // std::deque
+#include <exception>    // std::runtime_error, std::exception
+#include <iostream>     // std::cout
+#include <random>       // std::default_random_engine, std::uniform_real_distribution
+#include <algorithm>    // std::sort
+#include <cstdlib>      // EXIT_FAILURE
+#include <cmath>        // std::abs
+#include <thread>       // std::thread
+#include <mutex>        // std::mutex
+#include <chrono>       // std::chrono
+
+//Own
+#include "tmark.hpp"
+#include "gpu_reduce.hpp"
+#include "dot_engine.hpp"
+
+// Closed-loop load generator: every client keeps 'depth' requests of random
+// length in flight and records the latency from submit to result.
+struct load_result
+{
+    std::vector<double> latencies_us;
+    double seconds;
+    double bytes;
+    double max_err;
+    dot_engine::statistics stats;
+};
+
+load_result run_load(cl::Context const& context, cl::Device const& device, std::string const& source,
+                     dot_engine::options opt, int clients, int per_client, int depth,
+                     std::size_t min_len, std::size_t max_len, std::vector<cl_float> const& pool)
+{
+    dot_engine engine{ context, device, source, opt };
+
+    std::mutex mutex;
+    load_result res{ {}, 0.0, 0.0, 0.0, {} };
+
+    auto client = [&](int id)
+    {
+        using clock = std::chrono::steady_clock;
+        struct in_flight { std::future<double> result; clock::time_point start; std::size_t offset, length; };
+
+        std::mt19937 rng( static_cast<unsigned>(id) );
+        std::uniform_int_distribution<std::size_t> len_dist{ min_len, max_len };
+        std::uniform_int_distribution<std::size_t> off_dist{ 0, pool.size() / 2 - max_len };
+
+        std::vector<double> latencies;
+        double bytes = 0.0, max_err = 0.0;
+        std::deque<in_flight> window;
+
+        auto retire = [&]
+        {
+            auto& f = window.front();
+            double re = f.result.get();
+            latencies.push_back(std::chrono::duration<double, std::micro>(clock::now() - f.start).count());
+
+            // Error relative to the sum of magnitudes, robust to near-zero results
+            double ref = 0.0, mag = 0.0;
+            auto a = pool.data() + f.offset, b = a + pool.size() / 2;
+            for (std::size_t i = 0; i < f.length; ++i) { ref += a[i] * b[i]; mag += std::abs(a[i] * b[i]); }
+            if (mag > 0.0) max_err = std::max(max_err, std::abs(re - ref) / mag);
+            window.pop_front();
+        };
+
+        for (int r = 0; r < per_client; ++r)
+        {
+            if (static_cast<int>(window.size()) == depth) retire();
+
+            auto length = len_dist(rng), offset = off_dist(rng);
+            auto a = pool.begin() + offset, b = a + pool.size() / 2;
+            std::vector<cl_float> x(a, a + length), y(b, b + length);
+            bytes += 2.0 * length * sizeof(cl_float);
+
+            window.push_back({ engine.submit(std::move(x), std::move(y)), clock::now(), offset, length });
+        }
+        while (!window.empty()) retire();
+
+        std::lock_guard<std::mutex> lock{ mutex };
+        res.latencies_us.insert(res.latencies_us.end(), latencies.begin(), latencies.end());
+        res.bytes += bytes;
+        res.max_err = std::max(res.max_err, max_err);
+    };
+
+    auto start = tmark();
+    std::vector<std::thread> threads;
+    for (int c = 0; c < clients; ++c) threads.emplace_back(client, c);
+    for (auto& t : threads) t.join();
+    auto end = tmark();
+
+    res.seconds = std::chrono::duration<double>(end - start).count();
+    res.stats = engine.stats();
+    std::sort(res.latencies_us.begin(), res.latencies_us.end());
+    return res;
+}
+
+void report(char const* name, load_result const& res)
+{
+    auto pct = [&](double p){ return res.latencies_us[static_cast<std::size_t>(p * (res.latencies_us.size() - 1))]; };
+
+    std::cout << name << std::endl;
+    std::cout << "  Requests / batches:   " << res.stats.requests << " / " << res.stats.batches
+              << " (" << static_cast<double>(res.stats.requests) / res.stats.batches << " per launch)" << std::endl;
+    std::cout << "  Throughput:           " << res.latencies_us.size() / res.seconds << " req/s, "
+              << res.bytes / res.seconds * 1e-9 << " GB/s" << std::endl;
+    std::cout << "  Latency p50/p95/p99:  " << pct(0.50) << " / " << pct(0.95) << " / " << pct(0.99) << " us" << std::endl;
+    std::cout << "  Latency max:          " << res.latencies_us.back() << " us" << std::endl;
+    std::cout << "  Largest error:        " << res.max_err << std::endl;
+}
+
+int main()
+{
+    try
+    {
+        // User defined input
+        const int clients = 8, per_client = 2000, depth = 4;
+        const std::size_t min_len = 1 << 10, max_len = 1 << 16;
+
+        // Requests are cut from one random pool: first half x, second half y
+        std::vector<cl_float> pool(2 * (1 << 22));
+        std::mt19937 mersenne_engine{42};  // Generates random integers
+        std::uniform_real_distribution<float> dist{-0.1f, 0.1f};
+        auto gen = [&dist, &mersenne_engine](){ return dist(mersenne_engine); };
+        generate(pool.begin(), pool.end(), gen);
+
+        // Open-CL part
+        cl::Device device = cl::Device::getDefault();
+        cl::Context context{ device };
+        cl::Platform platform{device.getInfo<CL_DEVICE_PLATFORM>()};
+
+        std::cout << "Platform: " << platform.getInfo<CL_PLATFORM_VENDOR>() << std::endl;
+        std::cout << "Device: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+
+        auto kernel_op = "float op(float a, float b) { return a + b; }";
+        auto source = load_source("./../../scalar_prod/scalar_prod.cl")
+                         .append(load_source("./../../scalar_prod/blas1.cl"))
+                         .append(kernel_op);
+
+        std::cout << clients << " clients x " << per_client << " requests, " << depth << " in flight each, "
+                  << min_len << " - " << max_len << " elements" << std::endl;
+
+        dot_engine::options one_by_one;
+        one_by_one.queues = 1;
+        one_by_one.max_batch = 1;
+        one_by_one.linger = std::chrono::microseconds{ 0 };
+        auto res_single = run_load(context, device, source, one_by_one, clients, per_client, depth, min_len, max_len, pool);
+
+        auto res_batched = run_load(context, device, source, dot_engine::options{}, clients, per_client, depth, min_len, max_len, pool);
+
+        std::cout.precision(4);
+        if( std::max(res_single.max_err, res_batched.max_err) < 1e-5 )
+            std::cout << "Validation success.\n";
+        else
+            std::cout << "Mismatch in CPU and GPU result.\n";
+
+        report("One request per launch, single queue:", res_single);
+        report("Coalesced batches, pipelined queues:", res_batched);
+    }
+    catch (cl::BuildError& error) // If kernel failed to build
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+
+        for (const auto& log : error.getBuildLog())
+        {
+            std::cerr <<
+                "\tBuild log for device: " <<
+                log.first.getInfo<CL_DEVICE_NAME>() <<
+                std::endl << std::endl <<
+                log.second <<
+                std::endl << std::endl;
+        }
+
+        std::exit(error.err());
+    }
+    catch (cl::Error& error) // If any OpenCL error occurs
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+        std::exit(error.err());
+    }
+    catch (std::exception& error) // If STL/CRT error occurs
+    {
+        std::cerr << error.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
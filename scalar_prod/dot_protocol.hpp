@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Wire format of the dot product daemon, native byte order (same host only).
+// A connection carries any number of requests; responses come back in the
+// order the requests were sent, so a client may pipeline them.
+//
+//  inline request:  request_header, length floats of a, length floats of b
+//  mapped request:  request_header, path_bytes[0] bytes of the path of a,
+//                   path_bytes[1] bytes of the path of b
+//  response:        response_header, message_bytes bytes of error message
+namespace dot_protocol
+{
+    static const char default_socket[] = "/tmp/dot_engine.sock";
+
+    enum kind : std::uint32_t { inline_vectors = 0, mapped_files = 1 };
+
+    struct request_header
+    {
+        std::uint32_t kind;
+        std::uint32_t path_bytes[2];
+        std::uint32_t reserved;
+        std::uint64_t offset;   // mapped: first element used
+        std::uint64_t length;   // elements; mapped: 0 means up to the end of the file
+    };
+
+    struct response_header
+    {
+        std::int32_t status;    // 0 on success
+        std::uint32_t message_bytes;
+        double result;
+    };
+
+    // Blocking transfer of exactly 'bytes'. read_all returns false on a clean
+    // end of stream before the first byte.
+    inline bool read_all(int fd, void* data, std::size_t bytes)
+    {
+        auto p = static_cast<char*>(data);
+        for (std::size_t done = 0; done < bytes;)
+        {
+            auto n = ::read(fd, p + done, bytes - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) throw std::system_error{ errno, std::generic_category(), "read" };
+            if (n == 0)
+            {
+                if (done == 0) return false;
+                throw std::runtime_error{ "Connection closed mid-message" };
+            }
+            done += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    inline void write_all(int fd, void const* data, std::size_t bytes)
+    {
+        auto p = static_cast<char const*>(data);
+        for (std::size_t done = 0; done < bytes;)
+        {
+            auto n = ::send(fd, p + done, bytes - done, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) throw std::system_error{ errno, std::generic_category(), "send" };
+            done += static_cast<std::size_t>(n);
+        }
+    }
+
+    inline sockaddr_un address(std::string const& path)
+    {
+        sockaddr_un addr{};
+        if (path.size() >= sizeof(addr.sun_path))
+            throw std::runtime_error{ "Socket path too long: " + path };
+        addr.sun_family = AF_UNIX;
+        path.copy(addr.sun_path, path.size());
+        return addr;
+    }
+
+    inline int connect_to(std::string const& path)
+    {
+        auto addr = address(path);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) throw std::system_error{ errno, std::generic_category(), "socket" };
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+        {
+            auto err = errno;
+            ::close(fd);
+            throw std::system_error{ err, std::generic_category(), "connect " + path };
+        }
+        return fd;
+    }
+
+    // Read-only mapping of a whole file
+    class mapped_file
+    {
+    public:
+        explicit mapped_file(std::string const& path)
+        {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) throw std::system_error{ errno, std::generic_category(), "open " + path };
+
+            struct stat st;
+            if (::fstat(fd, &st) < 0)
+            {
+                auto err = errno;
+                ::close(fd);
+                throw std::system_error{ err, std::generic_category(), "fstat " + path };
+            }
+            size_ = static_cast<std::size_t>(st.st_size);
+            if (size_ != 0)
+            {
+                data_ = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+                if (data_ == MAP_FAILED)
+                {
+                    auto err = errno;
+                    ::close(fd);
+                    throw std::system_error{ err, std::generic_category(), "mmap " + path };
+                }
+                // The engine streams it front to back once
+                ::madvise(data_, size_, MADV_SEQUENTIAL);
+            }
+            ::close(fd);
+        }
+
+        ~mapped_file() { if (size_ != 0) ::munmap(data_, size_); }
+
+        mapped_file(mapped_file const&) = delete;
+        mapped_file& operator=(mapped_file const&) = delete;
+
+        void const* data() const { return data_; }
+        std::size_t size() const { return size_; }
+
+    private:
+        void* data_ = nullptr;
+        std::size_t size_ = 0;
+    };
+}
@@ -0,0 +1,284 @@
+#include <CL/cl2.hpp>
+
+#include <vector>       // std::vector
+#include <deque>        // std::deque
+#include <list>         // std::list
+#include <exception>    // std::runtime_error, std::exception
+#include <iostream>     // std::cout
+#include <cstdlib>      // EXIT_FAILURE
+#include <thread>       // std::thread
+#include <mutex>        // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <atomic>       // std::atomic
+#include <csignal>      // std::signal
+#include <algorithm>    // std::min
+#include <tuple>        // std::forward_as_tuple
+#include <system_error> // std::system_error
+
+//Own
+#include "gpu_reduce.hpp"
+#include "dot_engine.hpp"
+#include "dot_protocol.hpp"
+
+// Daemon mode of the dot product: the context, program and device buffers
+// are set up once and every client request goes through one dot_engine, so
+// concurrent requests from all connections are batched together.
+//
+//  usage: dot_server [socket path]
+
+namespace
+{
+    std::atomic<int> listen_fd{ -1 };
+
+    extern "C" void on_signal(int)
+    {
+        // Wakes the accept loop; shutdown() is async-signal-safe
+        int fd = listen_fd.load();
+        if (fd >= 0) ::shutdown(fd, SHUT_RDWR);
+    }
+
+    // Upper bound of a single request, keeps offsets of a batch in 32 bits
+    const std::uint64_t max_length = std::uint64_t{ 1 } << 28;
+
+    std::future<double> failed(std::string const& message)
+    {
+        std::promise<double> p;
+        p.set_exception(std::make_exception_ptr(std::runtime_error{ message }));
+        return p.get_future();
+    }
+
+    // One client. The reader submits every request to the engine as soon as
+    // it arrives, the writer sends the results back in request order.
+    class connection
+    {
+    public:
+        connection(int fd, dot_engine& engine)
+            : fd_{ fd }, engine_{ engine },
+              reader_{ [this]{ read_loop(); } },
+              writer_{ [this]{ write_loop(); } }
+        {}
+
+        ~connection()
+        {
+            ::shutdown(fd_, SHUT_RDWR);
+            reader_.join();
+            writer_.join();
+            ::close(fd_);
+        }
+
+        bool finished() const { return finished_; }
+
+    private:
+        std::future<double> receive(dot_protocol::request_header const& h)
+        {
+            if (h.kind == dot_protocol::inline_vectors)
+            {
+                if (h.length > max_length) throw std::runtime_error{ "Request too long" };
+                auto n = static_cast<std::size_t>(h.length);
+                std::vector<cl_float> a(n), b(n);
+                dot_protocol::read_all(fd_, a.data(), n * sizeof(cl_float));
+                dot_protocol::read_all(fd_, b.data(), n * sizeof(cl_float));
+                return engine_.submit(std::move(a), std::move(b));
+            }
+            if (h.kind == dot_protocol::mapped_files)
+            {
+                std::string path[2];
+                for (int v = 0; v < 2; ++v)
+                {
+                    if (h.path_bytes[v] > 4096) throw std::runtime_error{ "Path too long" };
+                    path[v].resize(h.path_bytes[v]);
+                    dot_protocol::read_all(fd_, &path[v][0], path[v].size());
+                }
+
+                // A bad file fails this request only, the stream stays in sync
+                try
+                {
+                    using dot_protocol::mapped_file;
+                    auto files = std::make_shared<std::pair<mapped_file, mapped_file>>(
+                        std::piecewise_construct, std::forward_as_tuple(path[0]), std::forward_as_tuple(path[1]));
+
+                    auto elements = std::min(files->first.size(), files->second.size()) / sizeof(cl_float);
+                    if (h.offset > elements) return failed("Offset past the end of the files");
+                    auto length = h.length != 0 ? h.length : elements - h.offset;
+                    if (h.offset + length > elements) return failed("Range past the end of the files");
+                    if (length > max_length) return failed("Request too long");
+
+                    auto a = static_cast<cl_float const*>(files->first.data()) + h.offset;
+                    auto b = static_cast<cl_float const*>(files->second.data()) + h.offset;
+                    return engine_.submit(files, a, b, static_cast<std::size_t>(length));
+                }
+                catch (std::system_error& error)
+                {
+                    return failed(error.what());
+                }
+            }
+            throw std::runtime_error{ "Unknown request kind" };
+        }
+
+        void read_loop()
+        {
+            try
+            {
+                dot_protocol::request_header h;
+                while (dot_protocol::read_all(fd_, &h, sizeof(h)))
+                    push(receive(h));
+            }
+            catch (std::exception& error)
+            {
+                // Protocol errors end the connection after a last response
+                push(failed(error.what()));
+            }
+            {
+                std::lock_guard<std::mutex> lock{ mutex_ };
+                closed_ = true;
+            }
+            cv_.notify_one();
+        }
+
+        void write_loop()
+        {
+            try
+            {
+                for (;;)
+                {
+                    std::future<double> result;
+                    {
+                        std::unique_lock<std::mutex> lock{ mutex_ };
+                        cv_.wait(lock, [this]{ return closed_ || !replies_.empty(); });
+                        if (replies_.empty()) break;
+                        result = std::move(replies_.front());
+                        replies_.pop_front();
+                    }
+
+                    dot_protocol::response_header r{ 0, 0, 0.0 };
+                    std::string message;
+                    try { r.result = result.get(); }
+                    catch (std::exception& error)
+                    {
+                        message = error.what();
+                        r.status = -1;
+                        r.message_bytes = static_cast<std::uint32_t>(message.size());
+                    }
+                    dot_protocol::write_all(fd_, &r, sizeof(r));
+                    dot_protocol::write_all(fd_, message.data(), message.size());
+                }
+            }
+            catch (std::exception&)
+            {
+                // Client went away; make the reader stop as well
+                ::shutdown(fd_, SHUT_RDWR);
+                std::unique_lock<std::mutex> lock{ mutex_ };
+                cv_.wait(lock, [this]{ return closed_; });
+                for (auto& f : replies_) f.wait();
+                replies_.clear();
+            }
+            finished_ = true;
+        }
+
+        void push(std::future<double> f)
+        {
+            {
+                std::lock_guard<std::mutex> lock{ mutex_ };
+                replies_.push_back(std::move(f));
+            }
+            cv_.notify_one();
+        }
+
+        int fd_;
+        dot_engine& engine_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<std::future<double>> replies_;
+        bool closed_ = false;
+        std::atomic<bool> finished_{ false };
+        std::thread reader_, writer_;
+    };
+}
+
+int main(int argc, char** argv)
+{
+    std::string path = argc > 1 ? argv[1] : dot_protocol::default_socket;
+
+    try
+    {
+        // Open-CL part
+        cl::Device device = cl::Device::getDefault();
+        cl::Context context{ device };
+        cl::Platform platform{device.getInfo<CL_DEVICE_PLATFORM>()};
+
+        std::cout << "Platform: " << platform.getInfo<CL_PLATFORM_VENDOR>() << std::endl;
+        std::cout << "Device: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+
+        auto kernel_op = "float op(float a, float b) { return a + b; }";
+        auto source = load_source("./../../scalar_prod/scalar_prod.cl")
+                         .append(load_source("./../../scalar_prod/blas1.cl"))
+                         .append(kernel_op);
+
+        dot_engine engine{ context, device, source };
+
+        // Listening socket; a stale file from a killed daemon is replaced
+        auto addr = dot_protocol::address(path);
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) throw std::system_error{ errno, std::generic_category(), "socket" };
+        ::unlink(path.c_str());
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(fd, 64) < 0)
+        {
+            auto err = errno;
+            ::close(fd);
+            throw std::system_error{ err, std::generic_category(), "bind " + path };
+        }
+        listen_fd = fd;
+        std::signal(SIGINT, on_signal);
+        std::signal(SIGTERM, on_signal);
+
+        std::cout << "Listening on " << path << std::endl;
+
+        std::list<connection> connections;
+        for (;;)
+        {
+            int client = ::accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                break;  // shut down by a signal
+            }
+            connections.remove_if([](connection const& c){ return c.finished(); });
+            connections.emplace_back(client, engine);
+        }
+
+        std::cout << "Shutting down, " << engine.stats().requests << " requests in "
+                  << engine.stats().batches << " batches" << std::endl;
+        connections.clear();
+        listen_fd = -1;
+        ::close(fd);
+        ::unlink(path.c_str());
+    }
+    catch (cl::BuildError& error) // If kernel failed to build
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+
+        for (const auto& log : error.getBuildLog())
+        {
+            std::cerr <<
+                "\tBuild log for device: " <<
+                log.first.getInfo<CL_DEVICE_NAME>() <<
+                std::endl << std::endl <<
+                log.second <<
+                std::endl << std::endl;
+        }
+
+        std::exit(error.err());
+    }
+    catch (cl::Error& error) // If any OpenCL error occurs
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+        std::exit(error.err());
+    }
+    catch (std::exception& error) // If STL/CRT error occurs
+    {
+        std::cerr << error.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,109 @@
+// Matrix-vector and matrix-matrix products on row-major matrices.
+// Tile sizes can be overridden with build options (-D TS=16 ...).
+
+#ifndef GEMV_ROWS
+#define GEMV_ROWS 4     // rows of A handled by one work-group
+#endif
+
+#ifndef TS
+#define TS 32           // edge of the square C tile of one work-group
+#endif
+
+#ifndef WPT
+#define WPT 4           // C elements computed by one work-item
+#endif
+
+#define RTS (TS / WPT)  // work-items along the rows of the tile
+
+// y = A * x, A is rows x cols.
+// Work-items stride along the columns so reads of A are coalesced; every
+// x element is loaded once into a register and reused for GEMV_ROWS rows.
+// Partial sums are then tree-reduced in local memory. Local size must be a
+// power of two and 'shared' must hold GEMV_ROWS * local_size floats.
+kernel void gemv(global const float* A,
+                 global const float* x,
+                 global float* y,
+                 local float* shared,
+                 unsigned int rows,
+                 unsigned int cols)
+{
+    const size_t lid = get_local_id(0),
+                 lsi = get_local_size(0),
+                 row0 = get_group_id(0) * GEMV_ROWS;
+
+    float acc[GEMV_ROWS];
+    for (int r = 0; r < GEMV_ROWS; ++r) acc[r] = 0.0f;
+
+    for (size_t c = lid; c < cols; c += lsi)
+    {
+        const float xc = x[c];
+        for (int r = 0; r < GEMV_ROWS; ++r)
+            if (row0 + r < rows)
+                acc[r] += A[(row0 + r) * cols + c] * xc;
+    }
+
+    for (int r = 0; r < GEMV_ROWS; ++r) shared[r * lsi + lid] = acc[r];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (size_t i = lsi / 2; i != 0; i /= 2)
+    {
+        if (lid < i)
+            for (int r = 0; r < GEMV_ROWS; ++r)
+                shared[r * lsi + lid] += shared[r * lsi + lid + i];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (lid < GEMV_ROWS && row0 + lid < rows) y[row0 + lid] = shared[lid * lsi];
+}
+
+// C = A * B, A is M x K, B is K x N.
+// Local size is (TS, RTS): work-item (tx, ty) owns column tx and rows
+// ty, ty + RTS, ... of the C tile. A and B tiles are staged in local
+// memory, every B value is kept in a register for WPT multiply-adds.
+kernel void gemm(global const float* A,
+                 global const float* B,
+                 global float* C,
+                 unsigned int M,
+                 unsigned int N,
+                 unsigned int K)
+{
+    const size_t tx = get_local_id(0),
+                 ty = get_local_id(1),
+                 row_base = get_group_id(1) * TS,
+                 col = get_group_id(0) * TS + tx;
+
+    local float As[TS][TS];
+    local float Bs[TS][TS];
+
+    float acc[WPT];
+    for (int w = 0; w < WPT; ++w) acc[w] = 0.0f;
+
+    const size_t tiles = (K + TS - 1) / TS;
+    for (size_t t = 0; t < tiles; ++t)
+    {
+        for (int w = 0; w < WPT; ++w)
+        {
+            const size_t r = ty + w * RTS,
+                         a_row = row_base + r,
+                         a_col = t * TS + tx,
+                         b_row = t * TS + r;
+            As[r][tx] = a_row < M && a_col < K ? A[a_row * K + a_col] : 0.0f;
+            Bs[r][tx] = b_row < K && col < N   ? B[b_row * N + col]   : 0.0f;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < TS; ++k)
+        {
+            const float b = Bs[k][tx];
+            for (int w = 0; w < WPT; ++w)
+                acc[w] += As[ty + w * RTS][k] * b;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (int w = 0; w < WPT; ++w)
+    {
+        const size_t row = row_base + ty + w * RTS;
+        if (row < M && col < N) C[row * N + col] = acc[w];
+    }
+}
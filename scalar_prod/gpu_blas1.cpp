@@ -0,0 +1,201 @@
+#include <CL/cl2.hpp>
+
+#include <vector>       // std::vector
+#include <exception>    // std::runtime_error, std::exception
+#include <iostream>     // std::cout
+#include <random>       // std::default_random_engine, std::uniform_real_distribution
+#include <algorithm>    // std::transform
+#include <cstdlib>      // EXIT_FAILURE
+#include <cmath>        // std::sqrt, std::abs
+
+//Own
+#include "tmark.hpp"
+#include "gpu_reduce.hpp"
+#include "cpu_blas1.hpp"
+
+int main()
+{
+    try
+    {
+        // User defined input
+        const std::size_t N = 20'000'000;
+        const cl_float alpha = 0.5f;
+        std::vector<cl_float> x_vec(N), y_vec(N), z_vec(N);
+
+        // Fill vectors with random values between -0.1 and 0.1
+        std::mt19937 mersenne_engine{42};  // Generates random integers
+        std::uniform_real_distribution<float> dist{-0.1f, 0.1f};
+        auto gen = [&dist, &mersenne_engine](){ return dist(mersenne_engine); };
+        generate(x_vec.begin(), x_vec.end(), gen);
+        generate(y_vec.begin(), y_vec.end(), gen);
+        generate(z_vec.begin(), z_vec.end(), gen);
+
+        // Open-CL part
+        cl::CommandQueue queue = cl::CommandQueue::getDefault();
+
+        cl::Device device = queue.getInfo<CL_QUEUE_DEVICE>();
+        cl::Context context = queue.getInfo<CL_QUEUE_CONTEXT>();
+        cl::Platform platform{device.getInfo<CL_DEVICE_PLATFORM>()};
+
+        std::cout << "Default queue on platform: " << platform.getInfo<CL_PLATFORM_VENDOR>() << std::endl;
+        std::cout << "Default queue on device: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+
+        auto kernel_op = "float op(float a, float b) { return a + b; }";
+        cl_float zero_elem = 0.0;
+
+        // Create program: the fused kernels finish with 'reduce' and share 'op'
+        cl::Program program{ load_source("./../../scalar_prod/scalar_prod.cl")
+                                .append(load_source("./../../scalar_prod/blas1.cl"))
+                                .append(kernel_op) };
+        program.build({ device });
+
+        // Create kernels
+        auto scalar_prod = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer>(program, "scalar_prod");
+        auto reduce = reduce_functor(program, "reduce");
+        auto axpy = cl::KernelFunctor<cl_float, cl::Buffer, cl::Buffer, cl_uint>(program, "axpy");
+        auto nrm2_partial = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::LocalSpaceArg, cl_uint, cl_float>(program, "nrm2_partial");
+        auto asum_partial = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::LocalSpaceArg, cl_uint, cl_float>(program, "asum_partial");
+        auto axpy_dot_partial = cl::KernelFunctor<cl_float, cl::Buffer, cl::Buffer, cl::Buffer, cl::Buffer, cl::LocalSpaceArg, cl_uint, cl_float>(program, "axpy_dot_partial");
+        auto axpy_nrm2_partial = cl::KernelFunctor<cl_float, cl::Buffer, cl::Buffer, cl::Buffer, cl::LocalSpaceArg, cl_uint, cl_float>(program, "axpy_nrm2_partial");
+
+        // All reduce-like kernels share one geometry
+        auto geo = make_reduce_geometry({ reduce.getKernel(),
+                                          nrm2_partial.getKernel(),
+                                          asum_partial.getKernel(),
+                                          axpy_dot_partial.getKernel(),
+                                          axpy_nrm2_partial.getKernel() }, device);
+        auto local = cl::Local(geo.factor * sizeof(cl_float));
+        auto len = static_cast<cl_uint>(N);
+
+        // Create buffers
+        cl::Buffer x_buf{ context, std::begin(x_vec), std::end(x_vec), true },
+                   y_buf{ context, std::begin(y_vec), std::end(y_vec), false },
+                   z_buf{ context, std::begin(z_vec), std::end(z_vec), true },
+                   c_buf{ context, CL_MEM_READ_WRITE, N * sizeof(cl_float) },
+                   part_buf{ context, CL_MEM_READ_WRITE, geo.new_size(N) * sizeof(cl_float) },
+                   red_buf{ context, CL_MEM_READ_WRITE, geo.new_size(N) * sizeof(cl_float) };
+
+        // Explicit (blocking) dispatch of data before launch
+        cl::copy(queue, std::begin(x_vec), std::end(x_vec), x_buf);
+        cl::copy(queue, std::begin(y_vec), std::end(y_vec), y_buf);
+        cl::copy(queue, std::begin(z_vec), std::end(z_vec), z_buf);
+
+        auto fetch = [&](cl::Buffer const& buf)
+        {
+            cl_float re;
+            cl::copy(queue, buf, &re, &re + 1);
+            return re;
+        };
+        auto wait = [](std::vector<cl::Event>& passes){ for (auto& pass : passes) pass.wait(); };
+
+        // Unfused: axpy, then scalar_prod and reduce on the updated y
+        auto start_unfused = tmark();
+        std::vector<cl::Event> passes;
+        passes.push_back(axpy(cl::EnqueueArgs{ queue, cl::NDRange{ N } }, alpha, x_buf, y_buf, len));
+        passes.push_back(scalar_prod(cl::EnqueueArgs{ queue, passes, cl::NDRange{ N } }, y_buf, z_buf, c_buf));
+        auto res_buf = reduce_passes(queue, reduce, geo, c_buf, red_buf, N, zero_elem, passes);
+        wait(passes);
+        auto end_unfused = tmark();
+        cl_float re_unfused = fetch(res_buf);
+
+        // Fused: one pass over x, y, z, then reduce the partials
+        cl::copy(queue, std::begin(y_vec), std::end(y_vec), y_buf);
+        auto start_fused = tmark();
+        passes.clear();
+        passes.push_back(axpy_dot_partial(cl::EnqueueArgs{ queue, geo.global(N), geo.wgs },
+                                          alpha, x_buf, y_buf, z_buf, part_buf, local, len, zero_elem));
+        res_buf = reduce_passes(queue, reduce, geo, part_buf, red_buf, geo.new_size(N), zero_elem, passes);
+        wait(passes);
+        auto end_fused = tmark();
+        cl_float re_fused = fetch(res_buf);
+
+        // Norms of x
+        passes.clear();
+        passes.push_back(nrm2_partial(cl::EnqueueArgs{ queue, geo.global(N), geo.wgs }, x_buf, part_buf, local, len, zero_elem));
+        cl_float re_nrm2 = std::sqrt(fetch(reduce_passes(queue, reduce, geo, part_buf, red_buf, geo.new_size(N), zero_elem, passes)));
+
+        passes.clear();
+        passes.push_back(asum_partial(cl::EnqueueArgs{ queue, geo.global(N), geo.wgs }, x_buf, part_buf, local, len, zero_elem));
+        cl_float re_asum = fetch(reduce_passes(queue, reduce, geo, part_buf, red_buf, geo.new_size(N), zero_elem, passes));
+
+        // Residual update with norm, on top of the fused update above
+        passes.clear();
+        passes.push_back(axpy_nrm2_partial(cl::EnqueueArgs{ queue, geo.global(N), geo.wgs },
+                                           -alpha, x_buf, y_buf, part_buf, local, len, zero_elem));
+        cl_float re_axpy_nrm2 = std::sqrt(fetch(reduce_passes(queue, reduce, geo, part_buf, red_buf, geo.new_size(N), zero_elem, passes)));
+        cl::finish();
+        //--------------------------------------------------------------------------------------------
+
+        //unfused host implementation
+        auto y_tmp = y_vec;
+        auto start_cpu_unfused = tmark();
+        cpu_axpy_parallel(alpha, x_vec, y_tmp);
+        auto re_cpu_unfused = cpu_dot_parallel(y_tmp, z_vec);
+        auto end_cpu_unfused = tmark();
+
+        //fused host implementation, also the reference
+        auto y_ref = y_vec;
+        auto start_cpu_fused = tmark();
+        auto re_ref = cpu_axpy_dot_parallel(alpha, x_vec, y_ref, z_vec);
+        auto end_cpu_fused = tmark();
+
+        auto ref_nrm2 = cpu_nrm2_parallel(x_vec);
+        auto ref_asum = cpu_asum_parallel(x_vec);
+        auto ref_axpy_nrm2 = cpu_axpy_nrm2_parallel(-alpha, x_vec, y_ref);
+
+        //Results
+        std::cout.precision(10);
+
+        auto rel = [](double ref, double re){ return std::abs((ref - re) / ref); };
+        auto re_err = std::max({ rel(re_ref, re_fused), rel(re_ref, re_unfused), rel(re_cpu_unfused, re_ref),
+                                 rel(ref_nrm2, re_nrm2), rel(ref_asum, re_asum), rel(ref_axpy_nrm2, re_axpy_nrm2) });
+
+        if( re_err < 2e-4 )
+            std::cout << "Validation success.\n";
+        else
+            std::cout << "Mismatch in CPU and GPU result.\n";
+
+        std::cout << "axpy + dot:  " << re_ref        << " (GPU fused " << re_fused << ", unfused " << re_unfused << ")" << std::endl;
+        std::cout << "nrm2:        " << ref_nrm2      << " (GPU " << re_nrm2 << ")" << std::endl;
+        std::cout << "asum:        " << ref_asum      << " (GPU " << re_asum << ")" << std::endl;
+        std::cout << "axpy + nrm2: " << ref_axpy_nrm2 << " (GPU " << re_axpy_nrm2 << ")" << std::endl;
+        std::cout << "Largest relative error between CPU & GPU is: " << re_err << std::endl;
+
+        // axpy: x, y in, y out; scalar_prod: y, z in, c out; reduce: c in
+        // fused: x, y, z in, y out
+        auto unfused_bytes = 7.0 * N * sizeof(cl_float), fused_bytes = 4.0 * N * sizeof(cl_float);
+        std::cout << "Memory traffic unfused / fused:     " << unfused_bytes / 1e6 << " / " << fused_bytes / 1e6 << " MB" << std::endl;
+        std::cout << "Unfused device execution took:      " << delta_time(start_unfused,end_unfused)         << " ms" << std::endl;
+        std::cout << "Fused device execution took:        " << delta_time(start_fused,end_fused)             << " ms" << std::endl;
+        std::cout << "Unfused parallel host execution:    " << delta_time(start_cpu_unfused,end_cpu_unfused) << " ms" << std::endl;
+        std::cout << "Fused parallel host execution:      " << delta_time(start_cpu_fused,end_cpu_fused)     << " ms" << std::endl;
+    }
+    catch (cl::BuildError& error) // If kernel failed to build
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+
+        for (const auto& log : error.getBuildLog())
+        {
+            std::cerr <<
+                "\tBuild log for device: " <<
+                log.first.getInfo<CL_DEVICE_NAME>() <<
+                std::endl << std::endl <<
+                log.second <<
+                std::endl << std::endl;
+        }
+
+        std::exit(error.err());
+    }
+    catch (cl::Error& error) // If any OpenCL error occurs
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+        std::exit(error.err());
+    }
+    catch (std::exception& error) // If STL/CRT error occurs
+    {
+        std::cerr << error.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,184 @@
+#include <CL/cl2.hpp>
+
+#include <vector>       // std::vector
+#include <exception>    // std::runtime_error, std::exception
+#include <iostream>     // std::cout
+#include <random>       // std::default_random_engine, std::uniform_real_distribution
+#include <algorithm>    // std::transform
+#include <cstdlib>      // EXIT_FAILURE
+#include <numeric>      // std::inner_product
+#include <functional>   // std::plus, std::multiplies
+#include <cmath>        // std::abs
+
+//Own
+#include "tmark.hpp"
+#include "gpu_reduce.hpp"
+#include "vec_expr.hpp"
+#include "gpu_expr.hpp"
+
+int main()
+{
+    try
+    {
+        // User defined input
+        const std::size_t N = 20'000'000;
+        std::vector<cl_float> a_vec(N), b_vec(N), c_vec(N), d_vec(N);
+
+        // Fill vectors with random values between -0.1 and 0.1
+        std::mt19937 mersenne_engine{42};  // Generates random integers
+        std::uniform_real_distribution<float> dist{-0.1f, 0.1f};
+        auto gen = [&dist, &mersenne_engine](){ return dist(mersenne_engine); };
+        generate(a_vec.begin(), a_vec.end(), gen);
+        generate(b_vec.begin(), b_vec.end(), gen);
+        generate(c_vec.begin(), c_vec.end(), gen);
+        generate(d_vec.begin(), d_vec.end(), gen);
+
+        auto a = expr::term(a_vec), b = expr::term(b_vec), c = expr::term(c_vec), d = expr::term(d_vec);
+
+        //Host with temporaries
+        auto start_tmp = tmark();
+        std::vector<cl_float> t1(N), t2(N);
+        std::transform(std::begin(a_vec), std::end(a_vec), std::begin(b_vec), std::begin(t1), std::plus<cl_float>{});
+        std::transform(std::begin(c_vec), std::end(c_vec), std::begin(d_vec), std::begin(t2), std::multiplies<cl_float>{});
+        auto re_tmp = std::inner_product(std::begin(t1), std::end(t1), std::begin(t2), 0.0);
+        auto end_tmp = tmark();
+
+        //Fused host loop, also the reference
+        auto start_ref = tmark();
+        auto re_ref = expr::dot(a + b, c * d);
+        auto end_ref = tmark();
+
+        // Open-CL part
+        cl::CommandQueue queue = cl::CommandQueue::getDefault();
+
+        cl::Device device = queue.getInfo<CL_QUEUE_DEVICE>();
+        cl::Context context = queue.getInfo<CL_QUEUE_CONTEXT>();
+        cl::Platform platform{device.getInfo<CL_DEVICE_PLATFORM>()};
+
+        std::cout << "Default queue on platform: " << platform.getInfo<CL_PLATFORM_VENDOR>() << std::endl;
+        std::cout << "Default queue on device: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+
+        auto kernel_op = "float op(float a, float b) { return a + b; }";
+        cl_float zero_elem = 0.0;
+        auto base_source = load_source("./../../scalar_prod/scalar_prod.cl")
+                              .append(load_source("./../../scalar_prod/blas1.cl"));
+
+        //Device with temporaries: separate kernels of the base program
+        cl::Program program{ std::string{ base_source }.append(kernel_op) };
+        program.build({ device });
+
+        auto scalar_prod = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer>(program, "scalar_prod");
+        auto reduce = reduce_functor(program, "reduce");
+        auto axpy = cl::KernelFunctor<cl_float, cl::Buffer, cl::Buffer, cl_uint>(program, "axpy");
+        auto dot_partial = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl::LocalSpaceArg, cl_uint, cl_float>(program, "dot_partial");
+        auto geo = make_reduce_geometry({ reduce.getKernel(), dot_partial.getKernel() }, device);
+        auto len = static_cast<cl_uint>(N);
+
+        cl::Buffer a_buf{ context, std::begin(a_vec), std::end(a_vec), true },
+                   b_buf{ context, std::begin(b_vec), std::end(b_vec), true },
+                   c_buf{ context, std::begin(c_vec), std::end(c_vec), true },
+                   d_buf{ context, std::begin(d_vec), std::end(d_vec), true },
+                   t1_buf{ context, CL_MEM_READ_WRITE, N * sizeof(cl_float) },
+                   t2_buf{ context, CL_MEM_READ_WRITE, N * sizeof(cl_float) },
+                   part_buf{ context, CL_MEM_READ_WRITE, geo.new_size(N) * sizeof(cl_float) },
+                   red_buf{ context, CL_MEM_READ_WRITE, geo.new_size(N) * sizeof(cl_float) };
+
+        // Explicit (blocking) dispatch of data before launch
+        cl::copy(queue, std::begin(a_vec), std::end(a_vec), a_buf);
+        cl::copy(queue, std::begin(b_vec), std::end(b_vec), b_buf);
+        cl::copy(queue, std::begin(c_vec), std::end(c_vec), c_buf);
+        cl::copy(queue, std::begin(d_vec), std::end(d_vec), d_buf);
+
+        auto start_gpu_tmp = tmark();
+        std::vector<cl::Event> passes(1);
+        queue.enqueueCopyBuffer(b_buf, t1_buf, 0, 0, N * sizeof(cl_float), nullptr, &passes.front());
+        passes.push_back(axpy(cl::EnqueueArgs{ queue, passes, cl::NDRange{ N } }, 1.0f, a_buf, t1_buf, len));
+        passes.push_back(scalar_prod(cl::EnqueueArgs{ queue, passes, cl::NDRange{ N } }, c_buf, d_buf, t2_buf));
+        passes.push_back(dot_partial(cl::EnqueueArgs{ queue, passes, geo.global(N), geo.wgs },
+                                     t1_buf, t2_buf, part_buf, cl::Local(geo.factor * sizeof(cl_float)), len, zero_elem));
+        auto res_buf = reduce_passes(queue, reduce, geo, part_buf, red_buf, geo.new_size(N), zero_elem, passes);
+        for (auto& pass : passes) pass.wait();
+        auto end_gpu_tmp = tmark();
+
+        cl_float re_gpu_tmp;
+        cl::copy(queue, res_buf, &re_gpu_tmp, &re_gpu_tmp + 1);
+
+        //Device fused: generated kernel, first call builds it
+        expr::gpu_engine engine{ queue, base_source, kernel_op };
+        engine.upload(a_vec);
+        engine.upload(b_vec);
+        engine.upload(c_vec);
+        engine.upload(d_vec);
+
+        auto start_gpu_build = tmark();
+        auto re_gpu = engine.dot(a + b, c * d);
+        auto end_gpu_build = tmark();
+
+        auto start_gpu = tmark();
+        re_gpu = engine.dot(a + b, c * d);
+        auto end_gpu = tmark();
+
+        // Same shape on swapped vectors hits the cache
+        auto re_gpu_swap = engine.dot(c + d, a * b);
+        auto re_ref_swap = expr::dot(c + d, a * b);
+
+        // Materialization with a scalar: no new program for a new value
+        std::vector<cl_float> e_vec, e_ref;
+        engine.assign(e_vec, 0.5f * (a - b));
+        engine.assign(e_vec, 2.0f * (a - b));
+        expr::eval(e_ref, 2.0f * (a - b));
+        double re_assign_err = 0.0;
+        for (std::size_t i = 0; i < N; ++i)
+            re_assign_err = std::max(re_assign_err, static_cast<double>(std::abs(e_vec[i] - e_ref[i])));
+        cl::finish();
+        //--------------------------------------------------------------------------------------------
+
+        //Results
+        std::cout.precision(10);
+
+        auto rel = [](double ref, double re){ return std::abs((ref - re) / ref); };
+        auto re_err = std::max({ rel(re_ref, re_gpu), rel(re_ref, re_gpu_tmp), rel(re_ref, re_tmp), rel(re_ref_swap, re_gpu_swap) });
+
+        if( re_err < 2e-4 && re_assign_err < 1e-6 )
+            std::cout << "Validation success.\n";
+        else
+            std::cout << "Mismatch in CPU and GPU result.\n";
+
+        std::cout << "Result of dot(a + b, c * d): " << re_ref << std::endl;
+        std::cout << "Largest relative error between CPU & GPU is: " << re_err << std::endl;
+        std::cout << "Generated programs in cache: " << engine.cached_programs() << std::endl;
+        std::cout << "Device with temporaries took:        " << delta_time(start_gpu_tmp,end_gpu_tmp)     << " ms" << std::endl;
+        std::cout << "Device fused, first call took:       " << delta_time(start_gpu_build,end_gpu_build) << " ms" << std::endl;
+        std::cout << "Device fused, cached program took:   " << delta_time(start_gpu,end_gpu)             << " ms" << std::endl;
+        std::cout << "Host with temporaries took:          " << delta_time(start_tmp,end_tmp)             << " ms" << std::endl;
+        std::cout << "Host fused parallel loop took:       " << delta_time(start_ref,end_ref)             << " ms" << std::endl;
+    }
+    catch (cl::BuildError& error) // If kernel failed to build
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+
+        for (const auto& log : error.getBuildLog())
+        {
+            std::cerr <<
+                "\tBuild log for device: " <<
+                log.first.getInfo<CL_DEVICE_NAME>() <<
+                std::endl << std::endl <<
+                log.second <<
+                std::endl << std::endl;
+        }
+
+        std::exit(error.err());
+    }
+    catch (cl::Error& error) // If any OpenCL error occurs
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+        std::exit(error.err());
+    }
+    catch (std::exception& error) // If STL/CRT error occurs
+    {
+        std::cerr << error.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <CL/cl2.hpp>
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+#include "gpu_reduce.hpp"
+#include "vec_expr.hpp"
+
+namespace expr
+{
+    // Turns expressions into single fused kernels. Every distinct expression
+    // shape gets its own program: the base sources, then the generated
+    // kernel, then 'kernel_op' appended the same way as for 'reduce'.
+    // Programs are cached by their generated source, so re-evaluating the
+    // same shape on other vectors or scalars only sets kernel arguments.
+    class gpu_engine
+    {
+    public:
+        gpu_engine(cl::CommandQueue queue, std::string base_source, std::string kernel_op)
+            : queue_{ queue },
+              context_{ queue.getInfo<CL_QUEUE_CONTEXT>() },
+              device_{ queue.getInfo<CL_QUEUE_DEVICE>() },
+              base_source_{ std::move(base_source) },
+              kernel_op_{ std::move(kernel_op) },
+              base_{ context_, base_source_ + kernel_op_ }
+        {
+            base_.build({ device_ });
+            reduce_ = reduce_functor(base_, "reduce");
+        }
+
+        // Keep a device copy of 'v'. Expressions read this copy, so call it
+        // again after 'v' changes on the host. Vectors never uploaded are
+        // uploaded on first use.
+        void upload(std::vector<cl_float> const& v)
+        {
+            auto it = buffers_.find(&v);
+            if (it == buffers_.end() || it->second.getInfo<CL_MEM_SIZE>() != v.size() * sizeof(cl_float))
+                buffers_[&v] = cl::Buffer{ context_, CL_MEM_READ_WRITE, v.size() * sizeof(cl_float) };
+            cl::copy(queue_, std::begin(v), std::end(v), buffers_[&v]);
+        }
+
+        // dot(lhs, rhs) in one elementwise pass plus the reduce passes
+        template<typename L, typename R>
+        cl_float dot(vec_expr<L> const& lhs, vec_expr<R> const& rhs)
+        {
+            codegen cg;
+            auto l = lhs.self().emit(cg);
+            auto r = rhs.self().emit(cg);
+            auto length = std::max(lhs.self().size(), rhs.self().size());
+
+            auto& entry = kernel_for(
+                "#define LHS(i) " + l + "\n"
+                "#define RHS(i) " + r + "\n"
+                "kernel void fused_dot(" + cg.params() + "global float* back, local float* shared, unsigned int length, float zero_elem)\n"
+                "{\n"
+                "    const size_t i0 = get_group_id(0) * get_local_size(0) * 2 + get_local_id(0),\n"
+                "                 i1 = i0 + get_local_size(0);\n"
+                "    group_reduce(shared, back,\n"
+                "                 i0 < length ? LHS(i0) * RHS(i0) : zero_elem,\n"
+                "                 i1 < length ? LHS(i1) * RHS(i1) : zero_elem);\n"
+                "}\n",
+                "fused_dot");
+
+            auto const& geo = entry.geo;
+            reserve(geo.new_size(length));
+
+            cl_uint arg = set_leaves(entry.kernel, cg);
+            entry.kernel.setArg(arg++, part_);
+            entry.kernel.setArg(arg++, cl::Local(geo.factor * sizeof(cl_float)));
+            entry.kernel.setArg(arg++, static_cast<cl_uint>(length));
+            entry.kernel.setArg(arg++, cl_float{ 0 });
+
+            std::vector<cl::Event> passes(1);
+            queue_.enqueueNDRangeKernel(entry.kernel, cl::NullRange, geo.global(length), geo.wgs, nullptr, &passes.front());
+            auto res_buf = reduce_passes(queue_, reduce_, geo, part_, red_, geo.new_size(length), 0.0f, passes);
+
+            cl_float re;
+            cl::copy(queue_, res_buf, &re, &re + 1);
+            return re;
+        }
+
+        // out = e in one elementwise pass; the device copy of 'out' is
+        // updated as well, so 'out' can be used by later expressions
+        template<typename E>
+        void assign(std::vector<cl_float>& out, vec_expr<E> const& e)
+        {
+            codegen cg;
+            auto x = e.self().emit(cg);
+            auto length = e.self().size();
+            out.resize(length);
+
+            auto& entry = kernel_for(
+                "#define EXPR(i) " + x + "\n"
+                "kernel void fused_assign(" + cg.params() + "global float* out, unsigned int length)\n"
+                "{\n"
+                "    const size_t gid = get_global_id(0);\n"
+                "    if (gid < length) out[gid] = EXPR(gid);\n"
+                "}\n",
+                "fused_assign");
+
+            auto& out_buf = buffer_for(out);
+            cl_uint arg = set_leaves(entry.kernel, cg);
+            entry.kernel.setArg(arg++, out_buf);
+            entry.kernel.setArg(arg++, static_cast<cl_uint>(length));
+
+            queue_.enqueueNDRangeKernel(entry.kernel, cl::NullRange, cl::NDRange{ length });
+            cl::copy(queue_, out_buf, std::begin(out), std::end(out));
+        }
+
+        std::size_t cached_programs() const { return cache_.size(); }
+
+    private:
+        struct entry
+        {
+            cl::Program program;
+            cl::Kernel kernel;
+            reduce_geometry geo;
+        };
+
+        entry& kernel_for(std::string const& source, char const* name)
+        {
+            auto it = cache_.find(source);
+            if (it != cache_.end()) return it->second;
+
+            cl::Program program{ context_, base_source_ + source + kernel_op_ };
+            program.build({ device_ });
+            cl::Kernel kernel{ program, name };
+            auto geo = make_reduce_geometry({ reduce_.getKernel(), kernel }, device_);
+
+            return cache_.emplace(source, entry{ program, kernel, geo }).first->second;
+        }
+
+        // The device copy of 'v', uploaded again when missing or when 'v'
+        // no longer has the size it was uploaded with
+        cl::Buffer& buffer_for(std::vector<cl_float> const& v)
+        {
+            auto it = buffers_.find(&v);
+            if (it != buffers_.end() && it->second.getInfo<CL_MEM_SIZE>() == v.size() * sizeof(cl_float)) return it->second;
+            upload(v);
+            return buffers_[&v];
+        }
+
+        cl_uint set_leaves(cl::Kernel& kernel, codegen const& cg)
+        {
+            cl_uint arg = 0;
+            for (auto leaf : cg.leaves)
+                kernel.setArg(arg++, buffer_for(*leaf));
+            for (auto s : cg.scalars)
+                kernel.setArg(arg++, cl_float{ s });
+            return arg;
+        }
+
+        // Partial sums and reduce scratch, grown on demand
+        void reserve(std::size_t partials)
+        {
+            if (partials <= capacity_) return;
+            part_ = cl::Buffer{ context_, CL_MEM_READ_WRITE, partials * sizeof(cl_float) };
+            red_  = cl::Buffer{ context_, CL_MEM_READ_WRITE, partials * sizeof(cl_float) };
+            capacity_ = partials;
+        }
+
+        cl::CommandQueue queue_;
+        cl::Context context_;
+        cl::Device device_;
+        std::string base_source_, kernel_op_;
+        cl::Program base_;
+        reduce_functor reduce_{ cl::Kernel{} };
+
+        std::unordered_map<std::string, entry> cache_;
+        std::unordered_map<void const*, cl::Buffer> buffers_;
+        cl::Buffer part_, red_;
+        std::size_t capacity_ = 0;
+    };
+}
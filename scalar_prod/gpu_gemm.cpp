@@ -0,0 +1,205 @@
+#include <CL/cl2.hpp>
+
+#include <vector>       // std::vector
+#include <exception>    // std::runtime_error, std::exception
+#include <iostream>     // std::cout
+#include <random>       // std::default_random_engine, std::uniform_real_distribution
+#include <algorithm>    // std::max
+#include <cstdlib>      // EXIT_FAILURE
+#include <cmath>        // std::abs
+#include <string>       // std::string
+
+//Own
+#include "tmark.hpp"
+#include "gpu_reduce.hpp"
+#include "cpu_gemm.hpp"
+
+// Largest deviation from the reference, relative to the largest reference value
+template<typename T>
+double max_rel_err(std::vector<T> const& ref, std::vector<T> const& res)
+{
+    double err = 0.0, norm = 0.0;
+    for (std::size_t i = 0; i < ref.size(); ++i)
+    {
+        err  = std::max(err, static_cast<double>(std::abs(ref[i] - res[i])));
+        norm = std::max(norm, static_cast<double>(std::abs(ref[i])));
+    }
+    return err / norm;
+}
+
+int main()
+{
+    try
+    {
+        // User defined input
+        const std::size_t M = 1024, N = 1024, K = 1024;   // gemm
+        const std::size_t R = 8192, S = 8192;             // gemv
+        const int reps = 10;                              // device repetitions
+
+        std::vector<cl_float> a_mat(M * K), b_mat(K * N), c_mat(M * N), c_ref(M * N), c_cpu(M * N);
+        std::vector<cl_float> g_mat(R * S), x_vec(S), y_vec(R), y_ref(R), y_cpu(R);
+
+        // Fill with random values between -0.1 and 0.1
+        std::mt19937 mersenne_engine{42};  // Generates random integers
+        std::uniform_real_distribution<float> dist{-0.1f, 0.1f};
+        auto gen = [&dist, &mersenne_engine](){ return dist(mersenne_engine); };
+        generate(a_mat.begin(), a_mat.end(), gen);
+        generate(b_mat.begin(), b_mat.end(), gen);
+        generate(g_mat.begin(), g_mat.end(), gen);
+        generate(x_vec.begin(), x_vec.end(), gen);
+
+        // Open-CL part
+        cl::CommandQueue queue = cl::CommandQueue::getDefault();
+
+        cl::Device device = queue.getInfo<CL_QUEUE_DEVICE>();
+        cl::Context context = queue.getInfo<CL_QUEUE_CONTEXT>();
+        cl::Platform platform{device.getInfo<CL_DEVICE_PLATFORM>()};
+
+        std::cout << "Default queue on platform: " << platform.getInfo<CL_PLATFORM_VENDOR>() << std::endl;
+        std::cout << "Default queue on device: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+
+        // Tile sizes: 32 x 32 C tiles need 256 work-items, fall back to 16 x 16
+        // when the compiled gemm kernel cannot run that many in a group
+        const std::size_t wpt = 4;
+        const std::size_t gemv_rows = 4;
+        auto build = [&](std::size_t ts)
+        {
+            auto options = "-D TS=" + std::to_string(ts) + " -D WPT=" + std::to_string(wpt) + " -D GEMV_ROWS=" + std::to_string(gemv_rows);
+            cl::Program program{ load_source("./../../scalar_prod/gemm.cl") };
+            program.build({ device }, options.c_str());
+            return program;
+        };
+
+        // Create program
+        std::size_t ts = 32;
+        cl::Program program = build(ts);
+        if (cl::Kernel{ program, "gemm" }.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device) < ts * ts / wpt)
+            program = build(ts = 16);
+
+        // Create kernels
+        auto gemv = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl::LocalSpaceArg, cl_uint, cl_uint>(program, "gemv");
+        auto gemm = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl_uint, cl_uint, cl_uint>(program, "gemm");
+
+        // gemv: power of two work-group, one group per GEMV_ROWS rows
+        std::size_t wgs = 1;
+        while (wgs * 2 <= gemv.getKernel().getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device) &&
+               wgs * 2 * gemv_rows * sizeof(cl_float) <= device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>())
+            wgs *= 2;
+        const std::size_t gemv_global = (R + gemv_rows - 1) / gemv_rows * wgs;
+
+        // gemm: (TS, TS / WPT) work-groups covering C
+        const cl::NDRange gemm_local{ ts, ts / wpt };
+        const cl::NDRange gemm_global{ (N + ts - 1) / ts * ts, (M + ts - 1) / ts * (ts / wpt) };
+
+        // Create buffers
+        cl::Buffer a_buf{ context, std::begin(a_mat), std::end(a_mat), true },
+                   b_buf{ context, std::begin(b_mat), std::end(b_mat), true },
+                   c_buf{ context, CL_MEM_WRITE_ONLY, M * N * sizeof(cl_float) },
+                   g_buf{ context, std::begin(g_mat), std::end(g_mat), true },
+                   x_buf{ context, std::begin(x_vec), std::end(x_vec), true },
+                   y_buf{ context, CL_MEM_WRITE_ONLY, R * sizeof(cl_float) };
+
+        // Explicit (blocking) dispatch of data before launch
+        cl::copy(queue, std::begin(a_mat), std::end(a_mat), a_buf);
+        cl::copy(queue, std::begin(b_mat), std::end(b_mat), b_buf);
+        cl::copy(queue, std::begin(g_mat), std::end(g_mat), g_buf);
+        cl::copy(queue, std::begin(x_vec), std::end(x_vec), x_buf);
+
+        // Millisecond ticks are too coarse for single launches
+        auto seconds = [](auto t0, auto t1){ return std::chrono::duration<double>(t1 - t0).count(); };
+
+        // Launch kernels
+        auto start_gemv = tmark();
+        for (int r = 0; r < reps; ++r)
+            gemv(cl::EnqueueArgs{ queue, gemv_global, wgs },
+                 g_buf, x_buf, y_buf, cl::Local(gemv_rows * wgs * sizeof(cl_float)),
+                 static_cast<cl_uint>(R), static_cast<cl_uint>(S)).wait();
+        auto end_gemv = tmark();
+
+        auto start_gemm = tmark();
+        for (int r = 0; r < reps; ++r)
+            gemm(cl::EnqueueArgs{ queue, gemm_global, gemm_local },
+                 a_buf, b_buf, c_buf,
+                 static_cast<cl_uint>(M), static_cast<cl_uint>(N), static_cast<cl_uint>(K)).wait();
+        auto end_gemm = tmark();
+
+        // (Blocking) fetch of results
+        cl::copy(queue, y_buf, std::begin(y_vec), std::end(y_vec));
+        cl::copy(queue, c_buf, std::begin(c_mat), std::end(c_mat));
+        cl::finish();
+        //--------------------------------------------------------------------------------------------
+
+        //naive implementation, also the reference
+        auto start_naiv_gemv = tmark();
+        cpu_gemv_naive(g_mat, x_vec, y_ref, R, S);
+        auto end_naiv_gemv = tmark();
+
+        auto start_naiv_gemm = tmark();
+        cpu_gemm_naive(a_mat, b_mat, c_ref, M, N, K);
+        auto end_naiv_gemm = tmark();
+
+        //blocked parallel implementation
+        auto start_par_gemv = tmark();
+        cpu_gemv_parallel(g_mat, x_vec, y_cpu, R, S);
+        auto end_par_gemv = tmark();
+
+        auto start_par_gemm = tmark();
+        cpu_gemm_parallel(a_mat, b_mat, c_cpu, M, N, K);
+        auto end_par_gemm = tmark();
+
+        //Results
+        std::cout.precision(4);
+
+        auto re_err = std::max({ max_rel_err(y_ref, y_vec), max_rel_err(c_ref, c_mat),
+                                 max_rel_err(y_ref, y_cpu), max_rel_err(c_ref, c_cpu) });
+
+        if( re_err < 2e-4 )
+            std::cout << "Validation success.\n";
+        else
+            std::cout << "Mismatch in CPU and GPU result.\n";
+
+        std::cout << "Largest relative error against the naive loops: " << re_err << std::endl;
+
+        const double gemv_flop = 2.0 * R * S, gemm_flop = 2.0 * M * N * K;
+        auto report = [&](char const* name, double flop, double sec)
+        {
+            std::cout << name << sec * 1e3 << " ms, " << flop / sec * 1e-9 << " GFLOP/s" << std::endl;
+        };
+        std::cout << "gemv " << R << " x " << S << ", gemm " << M << " x " << N << " x " << K
+                  << ", tile " << ts << " x " << ts << ", " << wpt << " per work-item" << std::endl;
+        report("Device gemv:             ", gemv_flop, seconds(start_gemv, end_gemv) / reps);
+        report("Parallel host gemv:      ", gemv_flop, seconds(start_par_gemv, end_par_gemv));
+        report("Naive host gemv:         ", gemv_flop, seconds(start_naiv_gemv, end_naiv_gemv));
+        report("Device gemm:             ", gemm_flop, seconds(start_gemm, end_gemm) / reps);
+        report("Parallel host gemm:      ", gemm_flop, seconds(start_par_gemm, end_par_gemm));
+        report("Naive host gemm:         ", gemm_flop, seconds(start_naiv_gemm, end_naiv_gemm));
+    }
+    catch (cl::BuildError& error) // If kernel failed to build
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+
+        for (const auto& log : error.getBuildLog())
+        {
+            std::cerr <<
+                "\tBuild log for device: " <<
+                log.first.getInfo<CL_DEVICE_NAME>() <<
+                std::endl << std::endl <<
+                log.second <<
+                std::endl << std::endl;
+        }
+
+        std::exit(error.err());
+    }
+    catch (cl::Error& error) // If any OpenCL error occurs
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+        std::exit(error.err());
+    }
+    catch (std::exception& error) // If STL/CRT error occurs
+    {
+        std::cerr << error.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
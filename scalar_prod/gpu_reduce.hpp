@@ -0,0 +1,87 @@
+#pragma once
+
+#include <CL/cl2.hpp>
+
+#include <vector>       // std::vector
+#include <string>       // std::string
+#include <fstream>      // std::ifstream
+#include <stdexcept>    // std::runtime_error
+#include <algorithm>    // std::min, std::swap
+
+// Read a whole kernel source file
+inline std::string load_source(std::string const& path)
+{
+    std::ifstream source_file{ path };
+    if (!source_file.is_open())
+        throw std::runtime_error{ std::string{ "Cannot open kernel source: " } + path };
+
+    return std::string{ std::istreambuf_iterator<char>{ source_file },
+                        std::istreambuf_iterator<char>{} };
+}
+
+// Launch geometry of the tree reduction kernels: one work-group
+// consumes 'factor' elements and produces one output
+struct reduce_geometry
+{
+    std::size_t wgs;
+    std::size_t factor;
+
+    std::size_t new_size(const std::size_t actual) const
+    {
+        return actual / factor + (actual % factor == 0 ? 0 : 1);
+    }
+    // NOTE: because one work-group produces one output
+    //       new_size == number_of_work_groups
+    std::size_t global(const std::size_t actual) const { return new_size(actual) * wgs; }
+};
+
+// Largest power of two work-group size every kernel in 'kernels' can run
+// with, while two floats per work-item still fit in local memory
+inline reduce_geometry make_reduce_geometry(std::vector<cl::Kernel> const& kernels, cl::Device const& device)
+{
+    auto wgs = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+    for (auto const& kernel : kernels)
+        wgs = std::min(wgs, kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+
+    while (wgs != 0 && device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>() < wgs * 2 * sizeof(cl_float))
+        wgs -= kernels.front().getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device);
+
+    if (wgs == 0) throw std::runtime_error{"Not enough local memory to serve a single sub-group."};
+
+    std::size_t pow2 = 1;
+    while (pow2 * 2 <= wgs) pow2 *= 2;
+
+    return reduce_geometry{ pow2, pow2 * 2 };
+}
+
+using reduce_functor = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::LocalSpaceArg, cl_uint, cl_float>;
+
+// Reduce the first 'length' elements of 'front' with repeated 'reduce' passes,
+// ping-ponging with 'back'. Returns the buffer holding the result at index 0.
+inline cl::Buffer reduce_passes(cl::CommandQueue& queue,
+                                reduce_functor& reduce,
+                                reduce_geometry const& geo,
+                                cl::Buffer front,
+                                cl::Buffer back,
+                                std::size_t length,
+                                cl_float zero_elem,
+                                std::vector<cl::Event>& passes)
+{
+    cl_uint curr = static_cast<cl_uint>(length);
+    while ( curr > 1 )
+    {
+        passes.push_back(
+            reduce(
+                cl::EnqueueArgs{ queue, passes, geo.global(curr), geo.wgs },
+                front,
+                back,
+                cl::Local(geo.factor * sizeof(cl_float)),
+                curr,
+                zero_elem
+            )
+        );
+        curr = static_cast<cl_uint>(geo.new_size(curr));
+        std::swap(front, back);
+    }
+    return front;
+}
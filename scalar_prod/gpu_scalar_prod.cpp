@@ -8,28 +8,45 @@
 #include <algorithm>    // std::transform
 #include <cstdlib>      // EXIT_FAILURE
 #include <numeric>      // std::accumulate
+#include <chrono>       // std::chrono::duration
 
 //Own
 #include "tmark.hpp"
 #include "cpu_scalar_prod.hpp"
+#include "buffer_pool.hpp"
+#include "aligned_allocator.hpp"
+#include "perf_counter.hpp"
+#include "roofline.hpp"
+#include "trace.hpp"
 
 int main()
 {
     try
     {
+        tracer::get().name_thread("main");
+
         // User defined input
         const std::size_t N = 20'000'000;
-        std::vector<cl_float> a_vec(N), b_vec(N), c_vec(N, 0.0);
+        // 2 MiB aligned and backed by huge pages: fewer TLB misses on the
+        // host loops and page aligned for the driver
+        std::vector<cl_float, huge_page_allocator<cl_float>> a_vec(N), b_vec(N), c_vec(N, 0.0);
 
         // Fill vectors with random values between -0.1 and 0.1
-        std::mt19937 mersenne_engine{42};  // Generates random integers
-        std::uniform_real_distribution<float> dist{-0.1f, 0.1f};
-        auto gen = [&dist, &mersenne_engine](){ return dist(mersenne_engine); };
-        generate(a_vec.begin(), a_vec.end(), gen);
-        generate(b_vec.begin(), b_vec.end(), gen);
+        {
+            trace_span span{ "random fill" };
+            std::mt19937 mersenne_engine{42};  // Generates random integers
+            std::uniform_real_distribution<float> dist{-0.1f, 0.1f};
+            auto gen = [&dist, &mersenne_engine](){ return dist(mersenne_engine); };
+            generate(a_vec.begin(), a_vec.end(), gen);
+            generate(b_vec.begin(), b_vec.end(), gen);
+        }
         
         // Open-CL part 
-        cl::CommandQueue queue = cl::CommandQueue::getDefault();
+        // Profiling queue on the default device, so the trace can place the
+        // kernel passes on the host timeline
+        cl::CommandQueue queue{ cl::Context::getDefault(), cl::Device::getDefault(), CL_QUEUE_PROFILING_ENABLE };
+        device_clock clock{ queue() };
+        tracer::get().name_lane(0, "default queue");
 
         cl::Device device = queue.getInfo<CL_QUEUE_DEVICE>();
         cl::Context context = queue.getInfo<CL_QUEUE_CONTEXT>();
@@ -50,7 +67,10 @@ int main()
         // Create program 
         cl::Program program{ std::string{ std::istreambuf_iterator<char>{ source_file },
                                           std::istreambuf_iterator<char>{} }.append(kernel_op) };
-        program.build({ device });
+        {
+            trace_span span{ "build program", "opencl" };
+            program.build({ device });
+        }
 
         // Create kernels
         // First: multiplication by element
@@ -80,71 +100,123 @@ int main()
         //       new_size == number_of_work_groups
         auto global = [=](const std::size_t actual){ return new_size(actual) * wgs; };
         
-        // Create buffers
-        cl::Buffer a_buf{ context, std::begin(a_vec), std::end(a_vec), true },
-                   b_buf{ context, std::begin(b_vec), std::end(b_vec), true },
-                   c_buf{ context, std::begin(c_vec), std::end(c_vec), false },
-                   red_buf{ context, CL_MEM_READ_WRITE, new_size(N) * sizeof(cl_float) };
-
-        // Explicit (blocking) dispatch of data before launch
-        cl::copy(queue, std::begin(a_vec), std::end(a_vec), a_buf);
-        cl::copy(queue, std::begin(b_vec), std::end(b_vec), b_buf);
-        cl::copy(queue, std::begin(c_vec), std::end(c_vec), c_buf);
-
-        // Launch kernels
-        auto start_gpu = tmark();
-        cl::Event scalar_prod_kernel{ scalar_prod(cl::EnqueueArgs{ queue, cl::NDRange{ N } }, a_buf, b_buf, c_buf) };
-        scalar_prod_kernel.wait();
-        //cl::copy(queue, c_buf, std::begin(c_vec), std::end(c_vec));
-        //auto re_gpu0 = std::accumulate(c_vec.begin(), c_vec.end(), decltype(c_vec)::value_type(0));
-
-        std::vector<cl::Event> passes;
-        cl_uint curr = static_cast<cl_uint>(N);
-        while ( curr > 1 )
+        // Device buffers come from a pool: the first run allocates them, the
+        // later runs get back the buffers released at the end of the previous one
+        buffer_pool pool{ context };
+        const int runs = 5;
+        double alloc_first = 0.0, alloc_later = 0.0;
+        cl_float re_gpu;
+        decltype(tmark()) start_gpu, end_gpu;
+
+        for (int run = 0; run < runs; ++run)
         {
-            passes.push_back(
-                reduce(
-                    cl::EnqueueArgs{
-                        queue,          //CommandQueue
-                        passes,         //events
-                        global(curr),   //NDRange global
-                        wgs             //NDRange local
-                    },
-                    c_buf,
-                    red_buf,
-                    cl::Local(factor * sizeof(cl_float)),
-                    curr,
-                    zero_elem
-                ) 
-            );
-            curr = static_cast<cl_uint>(new_size(curr));
-            if (curr > 1) std::swap(c_buf, red_buf);
-        }
-        for (auto& pass : passes) pass.wait();
-        auto end_gpu = tmark();
+            // Acquire buffers
+            auto start_alloc = tmark();
+            auto a_buf = pool.acquire(N * sizeof(cl_float), CL_MEM_READ_ONLY),
+                 b_buf = pool.acquire(N * sizeof(cl_float), CL_MEM_READ_ONLY),
+                 c_buf = pool.acquire(N * sizeof(cl_float), CL_MEM_READ_WRITE),
+                 red_buf = pool.acquire(new_size(N) * sizeof(cl_float), CL_MEM_READ_WRITE);
+            auto end_alloc = tmark();
+            (run == 0 ? alloc_first : alloc_later) += std::chrono::duration<double, std::milli>(end_alloc - start_alloc).count();
 
-        // (Blocking) fetch of results
-        cl_float re_gpu;
-        cl::copy(queue, red_buf, &re_gpu, &re_gpu + 1);
+            // Explicit (blocking) dispatch of data before launch
+            {
+                trace_span span{ "upload a, b, c", "copy" };
+                span.arg("bytes", static_cast<std::int64_t>(3 * N * sizeof(cl_float)));
+                cl::copy(queue, std::begin(a_vec), std::end(a_vec), *a_buf);
+                cl::copy(queue, std::begin(b_vec), std::end(b_vec), *b_buf);
+                cl::copy(queue, std::begin(c_vec), std::end(c_vec), *c_buf);
+            }
+
+            // Launch kernels
+            start_gpu = tmark();
+            auto trace_start = tracer::get().now();
+            cl::Event scalar_prod_kernel{ scalar_prod(cl::EnqueueArgs{ queue, cl::NDRange{ N } }, *a_buf, *b_buf, *c_buf) };
+            trace_device(clock, scalar_prod_kernel(), "scalar_prod");
+            scalar_prod_kernel.wait();
+            //cl::copy(queue, c_buf, std::begin(c_vec), std::end(c_vec));
+            //auto re_gpu0 = std::accumulate(c_vec.begin(), c_vec.end(), decltype(c_vec)::value_type(0));
+
+            std::vector<cl::Event> passes;
+            cl_uint curr = static_cast<cl_uint>(N);
+            while ( curr > 1 )
+            {
+                passes.push_back(
+                    reduce(
+                        cl::EnqueueArgs{
+                            queue,          //CommandQueue
+                            passes,         //events
+                            global(curr),   //NDRange global
+                            wgs             //NDRange local
+                        },
+                        *c_buf,
+                        *red_buf,
+                        cl::Local(factor * sizeof(cl_float)),
+                        curr,
+                        zero_elem
+                    ) 
+                );
+                trace_device(clock, passes.back()(), "reduce");
+                curr = static_cast<cl_uint>(new_size(curr));
+                if (curr > 1) std::swap(c_buf, red_buf);
+            }
+            for (auto& pass : passes) pass.wait();
+            end_gpu = tmark();
+            tracer::get().complete("kernels", "opencl", trace_start, tracer::get().now());
+
+            // (Blocking) fetch of results
+            cl::copy(queue, *red_buf, &re_gpu, &re_gpu + 1);
+        }
         cl::finish();
+        auto pool_stats = pool.stats();
         //--------------------------------------------------------------------------------------------
 
+        // Hardware counters of the host paths (no-op unless built with PERF_COUNTERS)
+        perf_counters counters;
+        perf_sample perf_naiv, perf_par, perf_ref;
+
         //naive implementation
         auto start_naiv = tmark();
-        auto re_cpu = cpu_scalar_prod_naive(a_vec, b_vec, N);
+        double re_cpu;
+        {
+            perf_scope scope{ counters, perf_naiv };
+            trace_span span{ "naive host", "cpu" };
+            re_cpu = cpu_scalar_prod_naive(a_vec, b_vec, N);
+        }
         auto end_naiv = tmark();
 
         //parallel implementation
         auto start_par = tmark();
-        auto re_cpu_par = cpu_scalar_prod_parallel(a_vec, b_vec, N);
+        double re_cpu_par;
+        {
+            perf_scope scope{ counters, perf_par };
+            trace_span span{ "parallel host", "cpu" };
+            re_cpu_par = cpu_scalar_prod_parallel(a_vec, b_vec, N);
+        }
         auto end_par = tmark();
 
         
         //Reference
         auto start_ref = tmark();
-        auto re_ref = std::inner_product(std::begin(a_vec), std::end(a_vec), std::begin(b_vec), 0.0);
+        double re_ref;
+        {
+            perf_scope scope{ counters, perf_ref };
+            trace_span span{ "reference host", "cpu" };
+            re_ref = std::inner_product(std::begin(a_vec), std::end(a_vec), std::begin(b_vec), 0.0);
+        }
         auto end_ref = tmark();
 
+        // Position on the roofline: the product streams a, b and c, every
+        // reduce pass reads its input and writes one value per work-group
+        double gpu_bytes = 3.0 * N * sizeof(cl_float);
+        for (std::size_t curr = N; curr > 1; curr = new_size(curr))
+            gpu_bytes += static_cast<double>(curr + new_size(curr)) * sizeof(cl_float);
+        const double flops = 2.0 * N, host_bytes = 2.0 * N * sizeof(cl_float);
+        auto roof_gpu  = describe_roofline(device.getInfo<CL_DEVICE_NAME>(), gpu_bytes, flops, std::chrono::duration<double>(end_gpu - start_gpu).count()),
+             roof_ref  = describe_roofline("host", host_bytes, flops, std::chrono::duration<double>(end_ref - start_ref).count()),
+             roof_naiv = describe_roofline("host", host_bytes, flops, std::chrono::duration<double>(end_naiv - start_naiv).count()),
+             roof_par  = describe_roofline("host", host_bytes, flops, std::chrono::duration<double>(end_par - start_par).count());
+
         //Results
         std::cout.precision(10);
 
@@ -155,10 +227,10 @@ int main()
             std::cout << "Validation success.\n";
             std::cout << "Result: " << re_ref << std::endl;
             std::cout << "Relative error between CPU & GPU is: " << re_err << std::endl;
-            std::cout << "Device execution took:        " << delta_time(start_gpu,end_gpu)   << " ms" << std::endl;
-            std::cout << "Ref. host execution took:     " << delta_time(start_ref,end_ref) << " ms" << std::endl;
-            std::cout << "Naive host execution took:    " << delta_time(start_naiv,end_naiv) << " ms" << std::endl;
-            std::cout << "Paralell host execution took: " << delta_time(start_par,end_par)   << " ms" << std::endl;
+            std::cout << "Device execution took:        " << delta_time(start_gpu,end_gpu)   << " ms" << roof_gpu << std::endl;
+            std::cout << "Ref. host execution took:     " << delta_time(start_ref,end_ref) << " ms" << describe(perf_ref) << roof_ref << std::endl;
+            std::cout << "Naive host execution took:    " << delta_time(start_naiv,end_naiv) << " ms" << describe(perf_naiv) << roof_naiv << std::endl;
+            std::cout << "Paralell host execution took: " << delta_time(start_par,end_par)   << " ms" << describe(perf_par) << roof_par << std::endl;
         }
         else
         {
@@ -168,11 +240,16 @@ int main()
             std::cout << "Result of naive:     " << re_cpu << std::endl;
             std::cout << "Result of parallel:  " << re_cpu_par << std::endl;
             std::cout << "Relative error between CPU & GPU is: " << re_err << std::endl;
-            std::cout << "Device execution took:        " << delta_time(start_gpu,end_gpu)   << " ms" << std::endl;
-            std::cout << "Ref. host execution took:     " << delta_time(start_ref,end_ref) << " ms" << std::endl;
-            std::cout << "Naive host execution took:    " << delta_time(start_naiv,end_naiv) << " ms" << std::endl;
-            std::cout << "Parallel host execution took: " << delta_time(start_par,end_par)   << " ms" << std::endl;
+            std::cout << "Device execution took:        " << delta_time(start_gpu,end_gpu)   << " ms" << roof_gpu << std::endl;
+            std::cout << "Ref. host execution took:     " << delta_time(start_ref,end_ref) << " ms" << describe(perf_ref) << roof_ref << std::endl;
+            std::cout << "Naive host execution took:    " << delta_time(start_naiv,end_naiv) << " ms" << describe(perf_naiv) << roof_naiv << std::endl;
+            std::cout << "Parallel host execution took: " << delta_time(start_par,end_par)   << " ms" << describe(perf_par) << roof_par << std::endl;
         }
+
+        std::cout << "Buffer acquisition, first run:  " << alloc_first << " ms" << std::endl;
+        std::cout << "Buffer acquisition, later runs: " << alloc_later / (runs - 1) << " ms" << std::endl;
+        std::cout << "Buffer pool hit rate: " << 100.0 * pool_stats.hit_rate() << " % of " << pool_stats.acquires << " acquires, peak "
+                  << pool_stats.peak_in_use / 1048576.0 << " MiB in use, " << pool_stats.peak_reserved / 1048576.0 << " MiB reserved" << std::endl;
     }
     catch (cl::BuildError& error) // If kernel failed to build
     {
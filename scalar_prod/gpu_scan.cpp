@@ -0,0 +1,250 @@
+#include <CL/cl2.hpp>
+
+#include <vector>       // std::vector
+#include <exception>    // std::runtime_error, std::exception
+#include <iostream>     // std::cout
+#include <fstream>      // std::ifstream
+#include <random>       // std::default_random_engine, std::uniform_real_distribution
+#include <algorithm>    // std::transform
+#include <cstdlib>      // EXIT_FAILURE
+#include <numeric>      // std::exclusive_scan
+#include <cmath>        // std::abs
+#include <execution>    // std::execution::par
+
+//Own
+#include "tmark.hpp"
+#include "cpu_scan.hpp"
+
+// Largest deviation from the reference, relative to the largest reference value
+template<typename T>
+double max_rel_err(std::vector<double> const& ref, std::vector<T> const& res)
+{
+    double err = 0.0, norm = 0.0;
+    for (std::size_t i = 0; i < ref.size(); ++i)
+    {
+        err  = std::max(err, std::abs(ref[i] - res[i]));
+        norm = std::max(norm, std::abs(ref[i]));
+    }
+    return err / norm;
+}
+
+int main()
+{
+    try
+    {
+        // User defined input
+        const std::size_t N = 20'000'000;
+        std::vector<cl_float> a_vec(N), excl_vec(N), incl_vec(N);
+
+        // Fill vector with random values between -0.1 and 0.1
+        std::mt19937 mersenne_engine{42};  // Generates random integers
+        std::uniform_real_distribution<float> dist{-0.1f, 0.1f};
+        auto gen = [&dist, &mersenne_engine](){ return dist(mersenne_engine); };
+        generate(a_vec.begin(), a_vec.end(), gen);
+
+        // Open-CL part
+        cl::CommandQueue queue = cl::CommandQueue::getDefault();
+
+        cl::Device device = queue.getInfo<CL_QUEUE_DEVICE>();
+        cl::Context context = queue.getInfo<CL_QUEUE_CONTEXT>();
+        cl::Platform platform{device.getInfo<CL_DEVICE_PLATFORM>()};
+
+        std::cout << "Default queue on platform: " << platform.getInfo<CL_PLATFORM_VENDOR>() << std::endl;
+        std::cout << "Default queue on device: " << device.getInfo<CL_DEVICE_NAME>() << std::endl;
+
+        auto kernel_op = "float op(float a, float b) { return a + b; }";
+        auto host_op = [](float a, float b){ return a + b; };
+        cl_float zero_elem = 0.0;
+
+        // Load program source
+        std::ifstream source_file{ "./../../scalar_prod/scalar_prod.cl" };
+        if (!source_file.is_open())
+            throw std::runtime_error{ std::string{ "Cannot open kernel source: " } + "./../../scalar_prod.cl" };
+
+        // Create program
+        cl::Program program{ std::string{ std::istreambuf_iterator<char>{ source_file },
+                                          std::istreambuf_iterator<char>{} }.append(kernel_op) };
+        program.build({ device });
+
+        // Create kernels
+        // First: scan tiles and collect tile totals
+        auto scan_block = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl::LocalSpaceArg, cl_uint, cl_float, cl_uint>(program, "scan_block");
+        // Second: prefix tiles with the scanned totals
+        auto scan_add = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl_uint>(program, "scan_add");
+
+        // Max size of work group
+        auto wgs = std::min(scan_block.getKernel().getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device),
+                            scan_add.getKernel().getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+
+        // Decrease size of work group as size of local memory
+        while (device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>() < wgs * 2 * sizeof(cl_float))
+            wgs -= scan_block.getKernel().getWorkGroupInfo<CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE>(device);
+
+        if (wgs == 0) throw std::runtime_error{"Not enough local memory to serve a single sub-group."};
+
+        // The tree sweeps need a power of two
+        std::size_t pow2 = 1;
+        while (pow2 * 2 <= wgs) pow2 *= 2;
+        wgs = pow2;
+
+        auto factor = wgs * 2;
+        // One work-group scans 'factor' elements and produces one tile total
+        auto new_size = [factor](const std::size_t actual)
+        {
+            return actual / factor + (actual % factor == 0 ? 0 : 1);
+        };
+        auto global = [=](const std::size_t actual){ return new_size(actual) * wgs; };
+
+        // Level 'l' scans lengths[l] elements, its tile totals make up level 'l+1'
+        std::vector<std::size_t> lengths{ N };
+        do lengths.push_back(new_size(lengths.back())); while (lengths.back() > 1);
+
+        // Create buffers
+        cl::Buffer a_buf{ context, std::begin(a_vec), std::end(a_vec), true },
+                   c_buf{ context, CL_MEM_READ_WRITE, N * sizeof(cl_float) };
+        std::vector<cl::Buffer> sums, offsets;
+        for (std::size_t l = 1; l < lengths.size(); ++l)
+        {
+            sums.emplace_back(context, CL_MEM_READ_WRITE, lengths[l] * sizeof(cl_float));
+            offsets.emplace_back(context, CL_MEM_READ_WRITE, lengths[l] * sizeof(cl_float));
+        }
+
+        // Explicit (blocking) dispatch of data before launch
+        cl::copy(queue, std::begin(a_vec), std::end(a_vec), a_buf);
+
+        auto gpu_scan = [&](bool inclusive)
+        {
+            std::vector<cl::Event> passes;
+            const auto levels = lengths.size() - 1;
+
+            // Down the levels: scan tiles, collect totals
+            for (std::size_t l = 0; l < levels; ++l)
+            {
+                auto curr = static_cast<cl_uint>(lengths[l]);
+                passes.push_back(
+                    scan_block(
+                        cl::EnqueueArgs{ queue, passes, global(curr), wgs },
+                        l == 0 ? a_buf : sums[l - 1],
+                        l == 0 ? c_buf : offsets[l - 1],
+                        sums[l],
+                        cl::Local(factor * sizeof(cl_float)),
+                        curr,
+                        zero_elem,
+                        l == 0 && inclusive
+                    )
+                );
+            }
+            // Up the levels: prefix tiles with the scanned totals
+            for (std::size_t l = levels - 1; l-- > 0;)
+            {
+                auto curr = static_cast<cl_uint>(lengths[l]);
+                passes.push_back(
+                    scan_add(
+                        cl::EnqueueArgs{ queue, passes, global(curr), wgs },
+                        l == 0 ? c_buf : offsets[l - 1],
+                        offsets[l],
+                        curr
+                    )
+                );
+            }
+            for (auto& pass : passes) pass.wait();
+        };
+
+        // Launch kernels
+        auto start_gpu = tmark();
+        gpu_scan(false);
+        auto end_gpu = tmark();
+        cl::copy(queue, c_buf, std::begin(excl_vec), std::end(excl_vec));
+
+        auto start_gpu_incl = tmark();
+        gpu_scan(true);
+        auto end_gpu_incl = tmark();
+        cl::copy(queue, c_buf, std::begin(incl_vec), std::end(incl_vec));
+        cl::finish();
+        //--------------------------------------------------------------------------------------------
+
+        std::vector<cl_float> cpu_vec(N), std_vec(N);
+
+        //naive implementation
+        auto start_naiv = tmark();
+        cpu_scan_naive(a_vec, cpu_vec, host_op, zero_elem, false);
+        auto end_naiv = tmark();
+
+        //parallel implementation
+        auto start_par = tmark();
+        cpu_scan_parallel(a_vec, cpu_vec, host_op, zero_elem, false);
+        auto end_par = tmark();
+
+        //Standard library with execution policies
+        auto start_std = tmark();
+        std::exclusive_scan(std::begin(a_vec), std::end(a_vec), std::begin(std_vec), zero_elem, host_op);
+        auto end_std = tmark();
+
+        auto start_std_par = tmark();
+        std::exclusive_scan(std::execution::par, std::begin(a_vec), std::end(a_vec), std::begin(std_vec), zero_elem, host_op);
+        auto end_std_par = tmark();
+
+        auto start_std_unseq = tmark();
+        std::exclusive_scan(std::execution::par_unseq, std::begin(a_vec), std::end(a_vec), std::begin(std_vec), zero_elem, host_op);
+        auto end_std_unseq = tmark();
+
+        //Reference in double precision
+        std::vector<double> ref_excl(N), ref_incl(N);
+        std::exclusive_scan(std::begin(a_vec), std::end(a_vec), std::begin(ref_excl), 0.0);
+        std::inclusive_scan(std::begin(a_vec), std::end(a_vec), std::begin(ref_incl), std::plus<double>{}, 0.0);
+
+        //Results
+        std::cout.precision(10);
+
+        auto re_err      = max_rel_err(ref_excl, excl_vec);
+        auto re_err_incl = max_rel_err(ref_incl, incl_vec);
+        auto re_err_cpu  = max_rel_err(ref_excl, cpu_vec);
+        auto re_err_std  = max_rel_err(ref_excl, std_vec);
+
+        if( re_err < 2e-4 && re_err_incl < 2e-4 && re_err_cpu < 2e-4 && re_err_std < 2e-4 )
+            std::cout << "Validation success.\n";
+        else
+            std::cout << "Mismatch in CPU and GPU result.\n";
+
+        std::cout << "Total: " << ref_incl.back() << std::endl;
+        std::cout << "Relative error of GPU exclusive scan: " << re_err << std::endl;
+        std::cout << "Relative error of GPU inclusive scan: " << re_err_incl << std::endl;
+        std::cout << "Relative error of CPU parallel scan:  " << re_err_cpu << std::endl;
+        std::cout << "Relative error of std::exclusive_scan: " << re_err_std << std::endl;
+        std::cout << "Device exclusive scan took:        " << delta_time(start_gpu,end_gpu)           << " ms" << std::endl;
+        std::cout << "Device inclusive scan took:        " << delta_time(start_gpu_incl,end_gpu_incl) << " ms" << std::endl;
+        std::cout << "Naive host execution took:         " << delta_time(start_naiv,end_naiv)         << " ms" << std::endl;
+        std::cout << "Parallel host execution took:      " << delta_time(start_par,end_par)           << " ms" << std::endl;
+        std::cout << "std::exclusive_scan took:          " << delta_time(start_std,end_std)           << " ms" << std::endl;
+        std::cout << "std::exclusive_scan(par) took:     " << delta_time(start_std_par,end_std_par)   << " ms" << std::endl;
+        std::cout << "std::exclusive_scan(par_unseq):    " << delta_time(start_std_unseq,end_std_unseq) << " ms" << std::endl;
+    }
+    catch (cl::BuildError& error) // If kernel failed to build
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+
+        for (const auto& log : error.getBuildLog())
+        {
+            std::cerr <<
+                "\tBuild log for device: " <<
+                log.first.getInfo<CL_DEVICE_NAME>() <<
+                std::endl << std::endl <<
+                log.second <<
+                std::endl << std::endl;
+        }
+
+        std::exit(error.err());
+    }
+    catch (cl::Error& error) // If any OpenCL error occurs
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+        std::exit(error.err());
+    }
+    catch (std::exception& error) // If STL/CRT error occurs
+    {
+        std::cerr << error.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include <vector>       // std::vector
+#include <exception>    // std::exception
+#include <iostream>     // std::cout
+#include <iomanip>      // std::setw
+#include <fstream>      // std::ifstream
+#include <sstream>      // std::istringstream
+#include <random>       // std::default_random_engine, std::uniform_real_distribution
+#include <algorithm>    // std::generate
+#include <cstdlib>      // EXIT_FAILURE
+#include <cstdint>      // std::uintptr_t
+#include <string>       // std::string
+#include <numeric>      // std::accumulate
+#include <chrono>       // std::chrono::duration
+
+//Own
+#include "tmark.hpp"
+#include "cpu_scalar_prod.hpp"
+#include "aligned_allocator.hpp"
+#include "perf_counter.hpp"
+
+// Compares host allocators on the 20M element dot product: first touch
+// (page faults), how much of the vectors the kernel backed with huge
+// pages, data TLB misses and throughput of the naive and parallel loops.
+
+// KiB of huge pages (transparent or hugetlbfs) in the mapping holding p
+std::size_t huge_backed_kib(void const* p)
+{
+    std::ifstream smaps{ "/proc/self/smaps" };
+    const auto addr = reinterpret_cast<std::uintptr_t>(p);
+    bool inside = false;
+    std::size_t kib = 0;
+    for (std::string line; std::getline(smaps, line);)
+    {
+        std::istringstream in{ line };
+        std::string key;
+        in >> key;
+        auto dash = key.find('-');
+        if (dash != std::string::npos && key.back() != ':')
+        {
+            // Header of the next mapping: "start-end perms ..."
+            if (inside) break;
+            auto start = std::stoull(key.substr(0, dash), nullptr, 16);
+            auto end = std::stoull(key.substr(dash + 1), nullptr, 16);
+            inside = start <= addr && addr < end;
+        }
+        else if (inside && (key == "AnonHugePages:" || key == "Private_Hugetlb:" || key == "Shared_Hugetlb:"))
+        {
+            std::size_t v = 0;
+            in >> v;
+            kib += v;
+        }
+    }
+    return kib;
+}
+
+struct alloc_result
+{
+    double touch_ms, naive_ms, parallel_ms;
+    std::size_t faults;
+    std::size_t dtlb_naive, dtlb_parallel;
+    std::size_t huge_kib;
+    std::size_t alignment;
+    double result;
+};
+
+template<typename Alloc>
+alloc_result run(std::vector<float> const& a_src, std::vector<float> const& b_src, int reps)
+{
+    const int N = static_cast<int>(a_src.size());
+    alloc_result res{};
+    auto faults = perf_counter::page_faults();
+    auto dtlb = perf_counter::dtlb_load_misses();
+
+    // Allocation and first touch
+    faults.start();
+    auto start_touch = tmark();
+    std::vector<float, Alloc> a_vec(a_src.begin(), a_src.end()), b_vec(b_src.begin(), b_src.end());
+    auto end_touch = tmark();
+    faults.stop();
+
+    res.touch_ms = std::chrono::duration<double, std::milli>(end_touch - start_touch).count();
+    res.faults = faults.value();
+    res.huge_kib = huge_backed_kib(a_vec.data()) + huge_backed_kib(b_vec.data());
+
+    // Largest power of two dividing the address, capped at a huge page
+    auto addr = reinterpret_cast<std::uintptr_t>(a_vec.data());
+    res.alignment = 1;
+    while (res.alignment < (std::size_t{ 2 } << 20) && addr % (res.alignment * 2) == 0) res.alignment *= 2;
+
+    dtlb.start();
+    auto start_naiv = tmark();
+    for (int r = 0; r < reps; ++r) res.result = cpu_scalar_prod_naive(a_vec, b_vec, N);
+    auto end_naiv = tmark();
+    dtlb.stop();
+    res.naive_ms = std::chrono::duration<double, std::milli>(end_naiv - start_naiv).count() / reps;
+    res.dtlb_naive = dtlb.value() / reps;
+
+    dtlb.start();
+    auto start_par = tmark();
+    for (int r = 0; r < reps; ++r) res.result = cpu_scalar_prod_parallel(a_vec, b_vec, N);
+    auto end_par = tmark();
+    dtlb.stop();
+    res.parallel_ms = std::chrono::duration<double, std::milli>(end_par - start_par).count() / reps;
+    res.dtlb_parallel = dtlb.value() / reps;
+
+    return res;
+}
+
+int main()
+{
+    try
+    {
+        // User defined input
+        const std::size_t N = 20'000'000;
+        const int reps = 10;
+        std::vector<float> a_src(N), b_src(N);
+
+        // Fill vectors with random values between -0.1 and 0.1
+        std::mt19937 mersenne_engine{42};  // Generates random integers
+        std::uniform_real_distribution<float> dist{-0.1f, 0.1f};
+        auto gen = [&dist, &mersenne_engine](){ return dist(mersenne_engine); };
+        generate(a_src.begin(), a_src.end(), gen);
+        generate(b_src.begin(), b_src.end(), gen);
+
+        struct variant { char const* name; alloc_result res; };
+        std::vector<variant> variants = {
+            { "std::allocator",              run<std::allocator<float>>(a_src, b_src, reps) },
+            { "aligned, 64 B",               run<aligned_allocator<float, 64>>(a_src, b_src, reps) },
+            { "aligned, 4 KiB",              run<aligned_allocator<float, 4096>>(a_src, b_src, reps) },
+            { "huge pages, transparent",     run<huge_page_allocator<float>>(a_src, b_src, reps) },
+            { "huge pages, hugetlbfs first", run<huge_page_allocator<float, huge_pages::explicit_first>>(a_src, b_src, reps) },
+        };
+
+        auto ref = variants.front().res.result;
+        bool same = std::all_of(variants.begin(), variants.end(), [ref](variant const& v){ return v.res.result == ref; });
+        std::cout << (same ? "Validation success.\n" : "Mismatch between allocators.\n");
+
+        const bool tlb = perf_counter::dtlb_load_misses().available();
+        if (!tlb) std::cout << "dTLB miss counter not available (no PMU or perf_event_paranoid), shown as -\n";
+
+        const double gb = 2.0 * N * sizeof(float) * 1e-9;
+        std::cout.precision(3);
+        std::cout << std::fixed;
+        std::cout << std::left << std::setw(30) << "Allocator" << std::right
+                  << std::setw(10) << "align" << std::setw(12) << "huge MiB" << std::setw(10) << "faults"
+                  << std::setw(12) << "touch ms" << std::setw(12) << "naive GB/s" << std::setw(14) << "dTLB naive"
+                  << std::setw(12) << "par. GB/s" << std::setw(14) << "dTLB par." << std::endl;
+        for (auto const& v : variants)
+        {
+            auto tlb_cell = [tlb](std::size_t misses){ return tlb ? std::to_string(misses) : std::string{ "-" }; };
+            std::cout << std::left << std::setw(30) << v.name << std::right
+                      << std::setw(10) << v.res.alignment
+                      << std::setw(12) << v.res.huge_kib / 1024.0
+                      << std::setw(10) << v.res.faults
+                      << std::setw(12) << v.res.touch_ms
+                      << std::setw(12) << gb / (v.res.naive_ms * 1e-3)
+                      << std::setw(14) << tlb_cell(v.res.dtlb_naive)
+                      << std::setw(12) << gb / (v.res.parallel_ms * 1e-3)
+                      << std::setw(14) << tlb_cell(v.res.dtlb_parallel) << std::endl;
+        }
+    }
+    catch (std::exception& error) // If STL/CRT error occurs
+    {
+        std::cerr << error.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,52 @@
+// STREAM kernels (McCalpin) and a peak arithmetic kernel for the roofline
+// calibration. One element per work-item, consecutive work-items touch
+// consecutive elements so the accesses coalesce.
+
+kernel void stream_copy(global const float* a, global float* c)
+{
+    const size_t i = get_global_id(0);
+    c[i] = a[i];
+}
+
+kernel void stream_scale(global float* b, global const float* c, float q)
+{
+    const size_t i = get_global_id(0);
+    b[i] = q * c[i];
+}
+
+kernel void stream_add(global const float* a, global const float* b, global float* c)
+{
+    const size_t i = get_global_id(0);
+    c[i] = a[i] + b[i];
+}
+
+kernel void stream_triad(global float* a, global const float* b, global const float* c, float q)
+{
+    const size_t i = get_global_id(0);
+    a[i] = b[i] + q * c[i];
+}
+
+// PEAK_ITERS rounds of 8 independent float4 multiply-adds per work-item:
+// 64 flops per round, enough independent chains to hide the latency.
+// The result is stored so the compiler cannot drop the arithmetic.
+#ifndef PEAK_ITERS
+#define PEAK_ITERS 1024
+#endif
+
+kernel void peak_flops(global float* out, float a, float b)
+{
+    const float s = (float)get_global_id(0) * 1e-7f;
+    float4 x0 = (float4)(s, s + 1e-3f, s + 2e-3f, s + 3e-3f);
+    float4 x1 = x0 + 0.1f, x2 = x0 + 0.2f, x3 = x0 + 0.3f,
+           x4 = x0 + 0.4f, x5 = x0 + 0.5f, x6 = x0 + 0.6f, x7 = x0 + 0.7f;
+
+    #pragma unroll 16
+    for (int i = 0; i < PEAK_ITERS; ++i)
+    {
+        x0 = mad(x0, a, b); x1 = mad(x1, a, b); x2 = mad(x2, a, b); x3 = mad(x3, a, b);
+        x4 = mad(x4, a, b); x5 = mad(x5, a, b); x6 = mad(x6, a, b); x7 = mad(x7, a, b);
+    }
+
+    const float4 r = (x0 + x1) + (x2 + x3) + (x4 + x5) + (x6 + x7);
+    out[get_global_id(0)] = r.x + r.y + r.z + r.w;
+}
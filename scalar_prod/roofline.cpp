@@ -0,0 +1,287 @@
+#include <CL/cl2.hpp>
+
+#include <vector>       // std::vector
+#include <exception>    // std::runtime_error, std::exception
+#include <iostream>     // std::cout
+#include <iomanip>      // std::setw
+#include <algorithm>    // std::min
+#include <numeric>      // std::accumulate
+#include <cstdlib>      // EXIT_FAILURE
+#include <future>       // std::async
+#include <thread>       // std::thread::hardware_concurrency
+#include <chrono>       // std::chrono::duration
+#include <string>       // std::string
+
+//Own
+#include "tmark.hpp"
+#include "gpu_reduce.hpp"
+#include "aligned_allocator.hpp"
+#include "roofline.hpp"
+
+// Calibrates the roofline of the host and of every OpenCL device:
+// STREAM copy, scale, add and triad bandwidth (best of 'reps', arrays far
+// larger than any cache) and peak single precision GFLOP/s. The results
+// are written to roofline.txt, where the other programs look up the
+// target they ran on to report their kernels as a fraction of the bound.
+//
+//  usage: roofline [output file]
+
+namespace
+{
+    template<typename F>
+    double best_seconds(int reps, F f)
+    {
+        double best = 1e30;
+        for (int r = 0; r < reps; ++r)
+        {
+            auto start = tmark();
+            f();
+            auto end = tmark();
+            best = std::min(best, std::chrono::duration<double>(end - start).count());
+        }
+        return best;
+    }
+
+    // Runs body(start, end) on 'n' threads over [0, size)
+    template<typename F>
+    void parallel_for(std::size_t size, int n, F body)
+    {
+        std::vector<std::future<void>> futures(n);
+        for (int k = 0; k < n; ++k)
+            futures[k] = std::async(std::launch::async, body, k * size / n, (k + 1) * size / n);
+        for (auto& f : futures) f.get();
+    }
+
+#if defined(__GNUC__)
+    // Eight independent vector chains stay in registers, enough to cover
+    // the latency of the multiply-add units
+    template<typename V>
+    __attribute__((always_inline)) inline float peak_chains(float a, float b, long iters)
+    {
+        V x0{}, x1{}, x2{}, x3{}, x4{}, x5{}, x6{}, x7{};
+        x1 += 0.1f; x2 += 0.2f; x3 += 0.3f; x4 += 0.4f; x5 += 0.5f; x6 += 0.6f; x7 += 0.7f;
+        for (long i = 0; i < iters; ++i)
+        {
+            x0 = x0 * a + b; x1 = x1 * a + b; x2 = x2 * a + b; x3 = x3 * a + b;
+            x4 = x4 * a + b; x5 = x5 * a + b; x6 = x6 * a + b; x7 = x7 * a + b;
+        }
+        V r = (x0 + x1) + (x2 + x3) + (x4 + x5) + (x6 + x7);
+        float s = 0.0f;
+        for (unsigned l = 0; l < sizeof(V) / sizeof(float); ++l) s += r[l];
+        return s;
+    }
+
+    typedef float float4_v  __attribute__((vector_size(16)));
+    float peak_default(float a, float b, long iters) { return peak_chains<float4_v>(a, b, iters); }
+
+#if defined(__x86_64__) || defined(__i386__)
+    typedef float float8_v  __attribute__((vector_size(32)));
+    typedef float float16_v __attribute__((vector_size(64)));
+
+    // Contraction is off in ISO mode, allow it here so mul + add fuse
+    __attribute__((target("avx2,fma"), optimize("fp-contract=fast")))
+    float peak_avx2(float a, float b, long iters) { return peak_chains<float8_v>(a, b, iters); }
+
+    __attribute__((target("avx512f,fma"), optimize("fp-contract=fast")))
+    float peak_avx512(float a, float b, long iters) { return peak_chains<float16_v>(a, b, iters); }
+#endif
+
+    // Widest variant the CPU runs, and the number of lanes it computes
+    float (*host_peak_kernel(int& lanes, char const*& isa))(float, float, long)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) { lanes = 8 * 16; isa = "AVX-512 FMA"; return peak_avx512; }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) { lanes = 8 * 8; isa = "AVX2 FMA"; return peak_avx2; }
+#endif
+        lanes = 8 * 4; isa = "128 bit";
+        return peak_default;
+    }
+#else
+    float peak_default(float a, float b, long iters)
+    {
+        float x[32];
+        for (int l = 0; l < 32; ++l) x[l] = l * 1e-3f;
+        for (long i = 0; i < iters; ++i)
+            for (int l = 0; l < 32; ++l) x[l] = x[l] * a + b;
+        float s = 0.0f;
+        for (int l = 0; l < 32; ++l) s += x[l];
+        return s;
+    }
+
+    float (*host_peak_kernel(int& lanes, char const*& isa))(float, float, long)
+    {
+        lanes = 32; isa = "scalar";
+        return peak_default;
+    }
+#endif
+
+    roofline host_roofline(std::size_t N, int reps)
+    {
+        const int n = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        const float q = 3.0f;
+        std::vector<float, huge_page_allocator<float>> a(N), b(N), c(N);
+
+        // First touch by the threads that use the slices later
+        parallel_for(N, n, [&](std::size_t s, std::size_t e){
+            for (auto i = s; i < e; ++i) { a[i] = 1.0f; b[i] = 2.0f; c[i] = 0.0f; }
+        });
+
+        roofline r;
+        r.name = "host";
+        const double bytes2 = 2.0 * N * sizeof(float), bytes3 = 3.0 * N * sizeof(float);
+        r.copy  = bytes2 * 1e-9 / best_seconds(reps, [&]{ parallel_for(N, n, [&](std::size_t s, std::size_t e){ for (auto i = s; i < e; ++i) c[i] = a[i]; }); });
+        r.scale = bytes2 * 1e-9 / best_seconds(reps, [&]{ parallel_for(N, n, [&](std::size_t s, std::size_t e){ for (auto i = s; i < e; ++i) b[i] = q * c[i]; }); });
+        r.add   = bytes3 * 1e-9 / best_seconds(reps, [&]{ parallel_for(N, n, [&](std::size_t s, std::size_t e){ for (auto i = s; i < e; ++i) c[i] = a[i] + b[i]; }); });
+        r.triad = bytes3 * 1e-9 / best_seconds(reps, [&]{ parallel_for(N, n, [&](std::size_t s, std::size_t e){ for (auto i = s; i < e; ++i) a[i] = b[i] + q * c[i]; }); });
+
+        int lanes;
+        char const* isa;
+        auto kernel = host_peak_kernel(lanes, isa);
+        const long iters = 50'000'000;
+        // One result per worker (chunk k of n is [k, k + 1)), summed after
+        // the join so the loops stay live without a shared write
+        std::vector<float> partial(n);
+        volatile float sink = 0.0f;
+        auto seconds = best_seconds(3, [&]{
+            parallel_for(n, n, [&](std::size_t s, std::size_t){ partial[s] = kernel(0.999f, 0.001f, iters); });
+            sink = sink + std::accumulate(partial.begin(), partial.end(), 0.0f);
+        });
+        r.gflops = 2.0 * lanes * iters * n / seconds * 1e-9;
+
+        std::cout << "host: " << n << " threads, " << isa << " peak loop" << std::endl;
+        return r;
+    }
+
+    roofline device_roofline(cl::Device const& device, std::string const& source, int reps)
+    {
+        cl::Context context{ device };
+        cl::CommandQueue queue{ context, device, CL_QUEUE_PROFILING_ENABLE };
+
+        cl::Program program{ context, source };
+        program.build({ device });
+
+        auto copy  = cl::KernelFunctor<cl::Buffer, cl::Buffer>(program, "stream_copy");
+        auto scale = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl_float>(program, "stream_scale");
+        auto add   = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer>(program, "stream_add");
+        auto triad = cl::KernelFunctor<cl::Buffer, cl::Buffer, cl::Buffer, cl_float>(program, "stream_triad");
+        auto peak  = cl::KernelFunctor<cl::Buffer, cl_float, cl_float>(program, "peak_flops");
+
+        // 64M floats per array unless the device cannot hold them
+        std::size_t N = std::size_t{ 1 } << 26;
+        const auto max_alloc = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+        const auto global_mem = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+        while (N * sizeof(float) > max_alloc || 3 * N * sizeof(float) > global_mem / 2) N /= 2;
+
+        cl::Buffer a{ context, CL_MEM_READ_WRITE, N * sizeof(float) },
+                   b{ context, CL_MEM_READ_WRITE, N * sizeof(float) },
+                   c{ context, CL_MEM_READ_WRITE, N * sizeof(float) };
+        queue.enqueueFillBuffer(a, 1.0f, 0, N * sizeof(float));
+        queue.enqueueFillBuffer(b, 2.0f, 0, N * sizeof(float));
+        queue.enqueueFillBuffer(c, 0.0f, 0, N * sizeof(float));
+        queue.finish();
+
+        // Kernel time from the profiling timestamps, best of 'reps'
+        auto best = [&](auto launch)
+        {
+            double res = 1e30;
+            for (int r = 0; r < reps; ++r)
+            {
+                cl::Event e = launch();
+                e.wait();
+                res = std::min(res, (e.getProfilingInfo<CL_PROFILING_COMMAND_END>() -
+                                     e.getProfilingInfo<CL_PROFILING_COMMAND_START>()) * 1e-9);
+            }
+            return res;
+        };
+
+        const cl_float q = 3.0f;
+        const double bytes2 = 2.0 * N * sizeof(float), bytes3 = 3.0 * N * sizeof(float);
+        roofline r;
+        r.name  = trimmed_name(device.getInfo<CL_DEVICE_NAME>());
+        r.copy  = bytes2 * 1e-9 / best([&]{ return copy (cl::EnqueueArgs{ queue, N }, a, c); });
+        r.scale = bytes2 * 1e-9 / best([&]{ return scale(cl::EnqueueArgs{ queue, N }, b, c, q); });
+        r.add   = bytes3 * 1e-9 / best([&]{ return add  (cl::EnqueueArgs{ queue, N }, a, b, c); });
+        r.triad = bytes3 * 1e-9 / best([&]{ return triad(cl::EnqueueArgs{ queue, N }, a, b, c, q); });
+
+        // Enough work-items to fill every compute unit many times over
+        const std::size_t items = std::size_t{ 1 } << 20, flops_per_item = 1024 * 64;
+        cl::Buffer out{ context, CL_MEM_WRITE_ONLY, items * sizeof(float) };
+        r.gflops = static_cast<double>(items * flops_per_item) * 1e-9 /
+                   best([&]{ return peak(cl::EnqueueArgs{ queue, items }, out, 0.999f, 0.001f); });
+        return r;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string output = argc > 1 ? argv[1] : roofline_file;
+
+    try
+    {
+        // User defined input
+        const std::size_t N = std::size_t{ 1 } << 25;     // host: 3 x 128 MiB
+        const int reps = 10;
+
+        std::vector<roofline> rooflines;
+        rooflines.push_back(host_roofline(N, reps));
+
+        auto source = load_source("./../../scalar_prod/roofline.cl");
+
+        std::vector<cl::Platform> platforms;
+        cl::Platform::get(&platforms);
+        for (auto const& platform : platforms)
+        {
+            std::vector<cl::Device> devices;
+            platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);
+            for (auto const& device : devices)
+            {
+                std::cout << "Device: " << device.getInfo<CL_DEVICE_NAME>()
+                          << " (" << platform.getInfo<CL_PLATFORM_VENDOR>() << ")" << std::endl;
+                rooflines.push_back(device_roofline(device, source, reps));
+            }
+        }
+
+        std::cout.precision(4);
+        std::cout << std::left << std::setw(40) << "Target" << std::right
+                  << std::setw(10) << "copy" << std::setw(10) << "scale" << std::setw(10) << "add"
+                  << std::setw(10) << "triad" << std::setw(12) << "GFLOP/s" << std::setw(12) << "ridge" << std::endl;
+        for (auto const& r : rooflines)
+            std::cout << std::left << std::setw(40) << r.name.substr(0, 39) << std::right
+                      << std::setw(10) << r.copy << std::setw(10) << r.scale << std::setw(10) << r.add
+                      << std::setw(10) << r.triad << std::setw(12) << r.gflops
+                      << std::setw(12) << r.gflops / r.bandwidth() << std::endl;
+        std::cout << "Bandwidths in GB/s, ridge point in flop/byte (kernels below it are memory-bound)" << std::endl;
+
+        save_rooflines(rooflines, output);
+        std::cout << "Written to " << output << std::endl;
+    }
+    catch (cl::BuildError& error) // If kernel failed to build
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+
+        for (const auto& log : error.getBuildLog())
+        {
+            std::cerr <<
+                "\tBuild log for device: " <<
+                log.first.getInfo<CL_DEVICE_NAME>() <<
+                std::endl << std::endl <<
+                log.second <<
+                std::endl << std::endl;
+        }
+
+        std::exit(error.err());
+    }
+    catch (cl::Error& error) // If any OpenCL error occurs
+    {
+        std::cerr << error.what() << "(" << error.err() << ")" << std::endl;
+        std::exit(error.err());
+    }
+    catch (std::exception& error) // If STL/CRT error occurs
+    {
+        std::cerr << error.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -54,4 +54,89 @@ kernel void reduce(global float* front,
         barrier(CLK_LOCAL_MEM_FENCE);
     }
     if (lid == 0) back[wid] = shared[0];
-}
\ No newline at end of file
+}
+
+// Work-efficient (Blelloch) scan of one tile of 2 * local_size elements.
+// The scan of the tile is written to 'back', the total of the tile to
+// 'sums'. Local size must be a power of two.
+kernel void scan_block(global float* front,
+                       global float* back,
+                       global float* sums,
+                       local float* shared,
+                       unsigned int length,
+                       float zero_elem,
+                       unsigned int inclusive)
+{
+    const size_t lid = get_local_id(0),
+                 lsi = get_local_size(0),
+                 wid = get_group_id(0);
+
+    const size_t wg_stride = lsi * 2,
+                 first = wid * wg_stride + lid,
+                 second = first + lsi;
+
+    // Keep own inputs in registers for the inclusive fix-up
+    const float x0 = first  < length ? front[first]  : zero_elem,
+                x1 = second < length ? front[second] : zero_elem;
+    shared[lid]       = x0;
+    shared[lid + lsi] = x1;
+
+    // Up-sweep: build partial sums in place
+    size_t offset = 1;
+    for (size_t d = lsi; d != 0; d /= 2)
+    {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid < d)
+        {
+            const size_t ai = offset * (2 * lid + 1) - 1,
+                         bi = offset * (2 * lid + 2) - 1;
+            shared[bi] = op(shared[ai], shared[bi]);
+        }
+        offset *= 2;
+    }
+
+    if (lid == 0)
+    {
+        sums[wid] = shared[wg_stride - 1];
+        shared[wg_stride - 1] = zero_elem;
+    }
+
+    // Down-sweep: distribute prefixes towards the leaves
+    for (size_t d = 1; d < wg_stride; d *= 2)
+    {
+        offset /= 2;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid < d)
+        {
+            const size_t ai = offset * (2 * lid + 1) - 1,
+                         bi = offset * (2 * lid + 2) - 1;
+            const float t = shared[ai];
+            shared[ai] = shared[bi];
+            shared[bi] = op(shared[bi], t);
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (first < length)
+        back[first]  = inclusive ? op(shared[lid], x0) : shared[lid];
+    if (second < length)
+        back[second] = inclusive ? op(shared[lid + lsi], x1) : shared[lid + lsi];
+}
+
+// Prefix every tile of 'data' with the scanned tile totals of 'offsets'.
+// Must be launched with the same geometry as scan_block.
+kernel void scan_add(global float* data,
+                     global float* offsets,
+                     unsigned int length)
+{
+    const size_t lid = get_local_id(0),
+                 lsi = get_local_size(0),
+                 wid = get_group_id(0);
+
+    const size_t first = wid * lsi * 2 + lid,
+                 second = first + lsi;
+
+    const float prefix = offsets[wid];
+    if (first < length)  data[first]  = op(prefix, data[first]);
+    if (second < length) data[second] = op(prefix, data[second]);
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+
+#include "cpu_blas1.hpp"
+
+// Lazy vector expressions. Building 'term(a) + term(b)' only records the
+// operation; the tree is walked element by element inside a single loop on
+// the host, or turned into the body of a single OpenCL kernel (gpu_expr.hpp).
+namespace expr
+{
+    // Collects the distinct vectors and the scalars of an expression while
+    // emitting its OpenCL source. They become the arguments of the kernel.
+    struct codegen
+    {
+        std::vector<std::vector<float> const*> leaves;
+        std::vector<float> scalars;
+
+        std::size_t leaf(std::vector<float> const* v)
+        {
+            auto it = std::find(leaves.begin(), leaves.end(), v);
+            if (it != leaves.end()) return static_cast<std::size_t>(it - leaves.begin());
+            leaves.push_back(v);
+            return leaves.size() - 1;
+        }
+
+        std::string params() const
+        {
+            std::string res;
+            for (std::size_t k = 0; k < leaves.size(); ++k)  res += "global const float* v" + std::to_string(k) + ", ";
+            for (std::size_t k = 0; k < scalars.size(); ++k) res += "float s" + std::to_string(k) + ", ";
+            return res;
+        }
+    };
+
+    // CRTP base of every node
+    template<typename E>
+    struct vec_expr
+    {
+        E const& self() const { return static_cast<E const&>(*this); }
+    };
+
+    // Leaf referring to a vector owned by the caller
+    template<typename T>
+    struct terminal : vec_expr<terminal<T>>
+    {
+        std::vector<T> const& v;
+
+        explicit terminal(std::vector<T> const& v) : v{ v } {}
+
+        T operator[](std::size_t i) const { return v[i]; }
+        std::size_t size() const { return v.size(); }
+        std::string emit(codegen& cg) const
+        {
+            static_assert(std::is_same<T, float>::value, "Kernels read their vectors as float: only std::vector<float> can reach the device");
+            return "v" + std::to_string(cg.leaf(&v)) + "[i]";
+        }
+    };
+
+    // Scalar broadcast to every element; passed as a kernel argument so
+    // changing its value does not require a new program
+    template<typename T>
+    struct scalar : vec_expr<scalar<T>>
+    {
+        T value;
+
+        explicit scalar(T value) : value{ value } {}
+
+        T operator[](std::size_t) const { return value; }
+        std::size_t size() const { return 0; }
+        std::string emit(codegen& cg) const
+        {
+            cg.scalars.push_back(static_cast<float>(value));
+            return "s" + std::to_string(cg.scalars.size() - 1);
+        }
+    };
+
+    struct op_add { static constexpr char const* symbol = " + "; template<typename A, typename B> auto operator()(A a, B b) const { return a + b; } };
+    struct op_sub { static constexpr char const* symbol = " - "; template<typename A, typename B> auto operator()(A a, B b) const { return a - b; } };
+    struct op_mul { static constexpr char const* symbol = " * "; template<typename A, typename B> auto operator()(A a, B b) const { return a * b; } };
+    struct op_div { static constexpr char const* symbol = " / "; template<typename A, typename B> auto operator()(A a, B b) const { return a / b; } };
+
+    template<typename Op, typename L, typename R>
+    struct binary : vec_expr<binary<Op, L, R>>
+    {
+        L l;
+        R r;
+
+        binary(L const& l, R const& r) : l{ l }, r{ r } {}
+
+        auto operator[](std::size_t i) const { return Op{}(l[i], r[i]); }
+        std::size_t size() const { return std::max(l.size(), r.size()); }
+        std::string emit(codegen& cg) const
+        {
+            auto lhs = l.emit(cg);
+            return "(" + lhs + Op::symbol + r.emit(cg) + ")";
+        }
+    };
+
+    template<typename T>
+    terminal<T> term(std::vector<T> const& v) { return terminal<T>{ v }; }
+
+    template<typename S>
+    using if_scalar = std::enable_if_t<std::is_arithmetic<S>::value, scalar<S>>;
+
+#define EXPR_BINARY_OPERATOR(sym, Op)                                                       \
+    template<typename L, typename R>                                                        \
+    binary<Op, L, R> operator sym(vec_expr<L> const& l, vec_expr<R> const& r)               \
+    { return { l.self(), r.self() }; }                                                      \
+    template<typename L, typename S>                                                        \
+    binary<Op, L, if_scalar<S>> operator sym(vec_expr<L> const& l, S s)                     \
+    { return { l.self(), scalar<S>{ s } }; }                                                \
+    template<typename S, typename R>                                                        \
+    binary<Op, if_scalar<S>, R> operator sym(S s, vec_expr<R> const& r)                     \
+    { return { scalar<S>{ s }, r.self() }; }
+
+    EXPR_BINARY_OPERATOR(+, op_add)
+    EXPR_BINARY_OPERATOR(-, op_sub)
+    EXPR_BINARY_OPERATOR(*, op_mul)
+    EXPR_BINARY_OPERATOR(/, op_div)
+
+#undef EXPR_BINARY_OPERATOR
+
+    // Fused host dot product: one threaded loop, no temporaries. Independent
+    // lanes let the compiler vectorize the double accumulation.
+    template<typename L, typename R>
+    double dot(vec_expr<L> const& lhs, vec_expr<R> const& rhs)
+    {
+        auto const& l = lhs.self();
+        auto const& r = rhs.self();
+
+        return cpu_parallel_sum(static_cast<int>(std::max(l.size(), r.size())), [&](int start, int end)
+        {
+            static const int lanes = 8;
+            double acc[lanes] = {};
+            int body = start + (end - start) / lanes * lanes;
+            for ( int i = start; i < body; i += lanes )
+                for ( int k = 0; k < lanes; ++k )
+                    acc[k] += static_cast<double>(l[i + k] * r[i + k]);
+
+            double sum = 0.0;
+            for ( int k = 0; k < lanes; ++k ) sum += acc[k];
+            for ( int i = body; i < end; ++i ) sum += l[i] * r[i];
+            return sum;
+        });
+    }
+
+    // Fused host materialization of an expression into 'out'
+    template<typename T, typename E>
+    void eval(std::vector<T>& out, vec_expr<E> const& e)
+    {
+        auto const& x = e.self();
+        out.resize(x.size());
+        cpu_parallel_sum(static_cast<int>(x.size()), [&](int start, int end)
+        {
+            for ( int i = start; i < end; ++i ) out[i] = static_cast<T>(x[i]);
+            return 0.0;
+        });
+    }
+}